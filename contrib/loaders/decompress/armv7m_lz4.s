@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+	Inflate a LZ4 block, as produced by src/helper/lz4.c.
+	The input is trusted, it is not checked for overruns.
+
+	parameters:
+	r0 - compressed data in - end of output out
+	r1 - compressed size
+	r2 - output buffer
+*/
+
+	.text
+	.syntax unified
+	.cpu cortex-m0
+	.thumb
+	.thumb_func
+
+	.align	2
+
+_start:
+	adds	r1, r0, r1		/* r1 = end of input */
+sequence:
+	ldrb	r3, [r0]		/* token */
+	adds	r0, r0, #1
+	lsrs	r4, r3, #4		/* literal length */
+	cmp		r4, #15
+	bne		literals
+	bl		length
+literals:
+	cmp		r4, #0
+	beq		offset
+literal_copy:
+	ldrb	r5, [r0]
+	adds	r0, r0, #1
+	strb	r5, [r2]
+	adds	r2, r2, #1
+	subs	r4, r4, #1
+	bne		literal_copy
+offset:
+	cmp		r0, r1			/* the last sequence has no match */
+	bhs		done
+	ldrb	r5, [r0]
+	ldrb	r6, [r0, #1]
+	adds	r0, r0, #2
+	lsls	r6, r6, #8
+	orrs	r6, r6, r5
+	subs	r6, r2, r6		/* r6 = match source */
+	movs	r4, #15
+	ands	r4, r4, r3		/* match length - 4 */
+	cmp		r4, #15
+	bne		match
+	bl		length
+match:
+	adds	r4, r4, #4
+match_copy:
+	ldrb	r5, [r6]
+	adds	r6, r6, #1
+	strb	r5, [r2]
+	adds	r2, r2, #1
+	subs	r4, r4, #1
+	bne		match_copy
+	b		sequence
+
+length:						/* add the length extension bytes to r4 */
+	ldrb	r5, [r0]
+	adds	r0, r0, #1
+	adds	r4, r4, r5
+	cmp		r5, #255
+	beq		length
+	bx		lr
+
+done:
+	mov		r0, r2
+	bkpt	#0
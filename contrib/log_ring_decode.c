@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Decode the binary log ring written by the OpenOCD "log_ring" command
+ * into the usual text log format.
+ *
+ *	gcc -o log_ring_decode log_ring_decode.c
+ *	log_ring_decode openocd_log_ring.bin
+ *
+ * All numbers in the dump are little endian. The file holds:
+ *
+ *	"OCDRING2"
+ *	u32 number of call sites, then for each of them
+ *		u32 line, string file, string function, string format
+ *	u32 number of messages, oldest first, then for each of them
+ *		u32 call site, u32 message count, u64 time in ms,
+ *		u8 level, u8 number of arguments, then for each argument
+ *			u8 type, then a u64 value ('i', 'u', 'f') or a string
+ *			('s', 'm' for a message already formatted by OpenOCD;
+ *			'S' and 'M' if it was cut or lost, shown followed by "[...]")
+ *
+ * Strings are stored as u32 length followed by the characters.
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct site {
+	uint32_t line;
+	char *file;
+	char *function;
+	char *format;
+};
+
+static const char * const level_strings[] = {
+	"User : ",
+	"Error: ",
+	"Warn : ",
+	"Info : ",
+	"Debug: ",
+	"Debug: ",
+};
+
+static FILE *in;
+
+static bool read_u32(uint32_t *value)
+{
+	uint8_t buf[4];
+
+	if (fread(buf, sizeof(buf), 1, in) != 1)
+		return false;
+	*value = buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+	return true;
+}
+
+static bool read_u64(uint64_t *value)
+{
+	uint32_t low, high;
+
+	if (!read_u32(&low) || !read_u32(&high))
+		return false;
+	*value = (uint64_t)high << 32 | low;
+	return true;
+}
+
+static char *read_string(void)
+{
+	uint32_t len;
+	char *string;
+
+	if (!read_u32(&len) || len > 0x100000)
+		return NULL;
+	string = malloc(len + 1);
+	if (!string)
+		return NULL;
+	if (len && fread(string, len, 1, in) != 1) {
+		free(string);
+		return NULL;
+	}
+	string[len] = '\0';
+	return string;
+}
+
+struct arg {
+	char type;
+	/* the string was cut */
+	bool truncated;
+	uint64_t value;
+	char *string;
+};
+
+#define TRUNCATED_MARK "[...]"
+
+/* print one conversion of the format, spec holds e.g. "%08llx" */
+static void print_arg(const char *spec, size_t spec_len, const struct arg *arg)
+{
+	char fmt[32];
+	char conversion = spec[spec_len - 1];
+	/* flags, width and precision, up to the length modifier */
+	size_t head = strcspn(spec + 1, "hlLqjzt") + 1;
+
+	if (spec_len >= sizeof(fmt) - 3)
+		return;
+	if (head > spec_len - 1)
+		head = spec_len - 1;
+
+	if (arg->type == 's' && conversion == 's') {
+		memcpy(fmt, spec, spec_len);
+		fmt[spec_len] = '\0';
+		printf(fmt, arg->string);
+		if (arg->truncated)
+			fputs(TRUNCATED_MARK, stdout);
+	} else if (arg->type == 'f') {
+		double d;
+		memcpy(&d, &arg->value, sizeof(d));
+		memcpy(fmt, spec, spec_len);
+		fmt[spec_len] = '\0';
+		printf(fmt, d);
+	} else if (conversion == 'p') {
+		printf("0x%llx", (unsigned long long)arg->value);
+	} else if (conversion == 'c') {
+		putchar((int)arg->value);
+	} else {
+		/* print all integers as long long */
+		bool short_int = spec[head] == 'h';
+		bool char_int = short_int && spec[head + 1] == 'h';
+		memcpy(fmt, spec, head);
+		strcpy(fmt + head, "ll");
+		fmt[head + 2] = conversion;
+		fmt[head + 3] = '\0';
+
+		if (arg->type == 'i') {
+			long long value = (long long)arg->value;
+			if (char_int)
+				value = (signed char)value;
+			else if (short_int)
+				value = (short)value;
+			printf(fmt, value);
+		} else {
+			unsigned long long value = arg->value;
+			if (char_int)
+				value = (unsigned char)value;
+			else if (short_int)
+				value = (unsigned short)value;
+			printf(fmt, value);
+		}
+	}
+}
+
+static void print_message(const char *format, const struct arg *args, unsigned int num_args)
+{
+	unsigned int i = 0;
+
+	if (num_args == 1 && args[0].type == 'm') {
+		fputs(args[0].string, stdout);
+		if (args[0].truncated)
+			fputs(TRUNCATED_MARK, stdout);
+		return;
+	}
+
+	for (const char *p = format; *p; p++) {
+		if (*p != '%') {
+			putchar(*p);
+			continue;
+		}
+		if (p[1] == '%') {
+			putchar('%');
+			p++;
+			continue;
+		}
+
+		size_t spec_len = strcspn(p + 1, "diouxXcspeEfFgGaA") + 2;
+		if (p[spec_len - 1] == '\0' || i >= num_args) {
+			fputs(p, stdout);
+			return;
+		}
+		print_arg(p, spec_len, &args[i++]);
+		p += spec_len - 1;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	char magic[8];
+	uint32_t num_sites, num_entries;
+	struct site *sites;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s dump_file\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	in = fopen(argv[1], "rb");
+	if (!in) {
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	if (fread(magic, sizeof(magic), 1, in) != 1 || memcmp(magic, "OCDRING2", 8)) {
+		fprintf(stderr, "%s: not an OpenOCD log ring dump\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	if (!read_u32(&num_sites) || num_sites > 0x100000)
+		goto corrupt;
+	sites = calloc(num_sites, sizeof(*sites));
+	if (!sites)
+		goto corrupt;
+	for (uint32_t i = 0; i < num_sites; i++) {
+		if (!read_u32(&sites[i].line))
+			goto corrupt;
+		sites[i].file = read_string();
+		sites[i].function = read_string();
+		sites[i].format = read_string();
+		if (!sites[i].file || !sites[i].function || !sites[i].format)
+			goto corrupt;
+	}
+
+	if (!read_u32(&num_entries))
+		goto corrupt;
+	for (uint32_t i = 0; i < num_entries; i++) {
+		uint32_t site, count;
+		uint64_t time;
+		uint8_t header[2];
+		struct arg args[256];
+
+		if (!read_u32(&site) || !read_u32(&count) || !read_u64(&time)
+				|| fread(header, sizeof(header), 1, in) != 1
+				|| site >= num_sites)
+			goto corrupt;
+
+		for (unsigned int j = 0; j < header[1]; j++) {
+			int type = fgetc(in);
+			if (type == EOF)
+				goto corrupt;
+			args[j].truncated = isupper(type);
+			type = tolower(type);
+			args[j].type = type;
+			args[j].string = NULL;
+			if (type == 's' || type == 'm') {
+				args[j].string = read_string();
+				if (!args[j].string)
+					goto corrupt;
+			} else if (!read_u64(&args[j].value)) {
+				goto corrupt;
+			}
+		}
+
+		int level = (int8_t)header[0];
+		if (level < -1 || level > 4)
+			level = 4;
+		printf("%s%" PRIu32 " %" PRIu64 " %s:%" PRIu32 " %s(): ", level_strings[level + 1],
+			count, time, sites[site].file, sites[site].line, sites[site].function);
+		print_message(sites[site].format, args, header[1]);
+		putchar('\n');
+
+		for (unsigned int j = 0; j < header[1]; j++)
+			free(args[j].string);
+	}
+
+	fclose(in);
+	return EXIT_SUCCESS;
+
+corrupt:
+	fprintf(stderr, "%s: truncated or corrupt dump\n", argv[1]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+"""
+OpenOCD binary RPC example and benchmark.
+
+Switches a Tcl RPC connection to the binary framing enabled by the
+'tcl_binary_rpc' command, then reads and writes target memory with
+pipelined requests. All numbers are little endian:
+
+    request: u32 length of the rest, u32 id, u8 type, payload
+    reply:   u32 length of the rest, u32 id, u8 status, payload
+
+Request types are 'c' (Tcl command), 'r' (u64 address, u32 byte count,
+u8 width) and 'w' (u64 address, u8 width, data). Status is 0 for success,
+1 for an error (the payload is the message) and 2 for an asynchronous
+notification, always with id 0.
+
+Usage:
+    ./ocd_rpc_binary.py [address] [--bench count]
+
+The benchmark reads 'count' words at 'address' (0x20000000 by default,
+the start of SRAM on most Cortex-M devices) first with the text
+'read_memory' command, one request at a time, then with pipelined binary
+requests, at most 32 in flight, and prints the rate of both.
+"""
+
+import collections
+import socket
+import struct
+import sys
+import time
+
+
+class OpenOcdBinary:
+    TEXT_TOKEN = b"\x1a"
+
+    def __init__(self, host="127.0.0.1", port=6666):
+        self.sock = socket.create_connection((host, port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b""
+        self.next_id = 1
+        self.binary = False
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, type, value, traceback):
+        self.sock.close()
+
+    def _recv_some(self):
+        chunk = self.sock.recv(65536)
+        if not chunk:
+            raise ConnectionError("connection closed by OpenOCD")
+        self.buf += chunk
+
+    def text(self, cmd):
+        """Run a command in text mode, return its result."""
+        assert not self.binary
+        self.sock.sendall(cmd.encode("utf-8") + self.TEXT_TOKEN)
+        while self.TEXT_TOKEN not in self.buf:
+            self._recv_some()
+        result, self.buf = self.buf.split(self.TEXT_TOKEN, 1)
+        return result.decode("utf-8")
+
+    def enable_binary(self):
+        self.text("tcl_binary_rpc")
+        self.binary = True
+
+    def _send(self, type, payload):
+        req_id = self.next_id
+        self.next_id += 1
+        self.sock.sendall(struct.pack("<IIB", len(payload) + 5, req_id, ord(type)) + payload)
+        return req_id
+
+    def _reply(self):
+        """Return the next (id, status, payload), skipping notifications."""
+        while True:
+            while len(self.buf) < 4 or len(self.buf) < 4 + struct.unpack_from("<I", self.buf)[0]:
+                self._recv_some()
+            length, req_id, status = struct.unpack_from("<IIB", self.buf)
+            payload = self.buf[9:4 + length]
+            self.buf = self.buf[4 + length:]
+            if status != 2:
+                return req_id, status, payload
+
+    def _result(self, req_id):
+        rid, status, payload = self._reply()
+        assert rid == req_id, "replies come in request order"
+        if status:
+            raise RuntimeError(payload.decode("utf-8", "replace"))
+        return payload
+
+    def send_command(self, cmd):
+        return self._send("c", cmd.encode("utf-8"))
+
+    def send_read(self, address, count, width=4):
+        return self._send("r", struct.pack("<QIB", address, count, width))
+
+    def send_write(self, address, data, width=4):
+        return self._send("w", struct.pack("<QB", address, width) + bytes(data))
+
+    def command(self, cmd):
+        return self._result(self.send_command(cmd)).decode("utf-8")
+
+    def read(self, address, count, width=4):
+        return self._result(self.send_read(address, count, width))
+
+    def write(self, address, data, width=4):
+        self._result(self.send_write(address, data, width))
+
+    def read_many(self, requests, window=32):
+        """Pipeline (address, count, width) reads, return the data in order.
+
+        At most 'window' requests are in flight: sending them all before
+        reading any reply would fill both socket buffers and deadlock.
+        """
+        pending = collections.deque()
+        results = []
+        for r in requests:
+            if len(pending) >= window:
+                results.append(self._result(pending.popleft()))
+            pending.append(self.send_read(*r))
+        while pending:
+            results.append(self._result(pending.popleft()))
+        return results
+
+
+def bench(host, address, count):
+    with OpenOcdBinary(host) as ocd:
+        start = time.perf_counter()
+        for i in range(count):
+            ocd.text("read_memory 0x%x 32 1" % (address + 4 * (i % 64)))
+        text_time = time.perf_counter() - start
+
+        ocd.enable_binary()
+        start = time.perf_counter()
+        ocd.read_many([(address + 4 * (i % 64), 4, 4) for i in range(count)])
+        binary_time = time.perf_counter() - start
+
+    print("text:   %d reads in %.3f s, %.0f reads/s" % (count, text_time, count / text_time))
+    print("binary: %d reads in %.3f s, %.0f reads/s" % (count, binary_time, count / binary_time))
+
+
+if __name__ == "__main__":
+    args = sys.argv[1:]
+    count = None
+    if "--bench" in args:
+        i = args.index("--bench")
+        count = int(args[i + 1])
+        del args[i:i + 2]
+    address = int(args[0], 0) if args else 0x20000000
+
+    if count:
+        bench("127.0.0.1", address, count)
+        sys.exit(0)
+
+    with OpenOcdBinary() as ocd:
+        print(ocd.text("version"))
+        ocd.enable_binary()
+        print(ocd.command("capture halt"))
+
+        before = ocd.read(address, 16)
+        print("memory (before):", before.hex())
+        ocd.write(address, bytes(range(16)))
+        print("memory  (after):", ocd.read(address, 16).hex())
+        ocd.write(address, before)
+
+        ocd.command("resume")
@@ -16,6 +16,7 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <helper/time_support.h>
 
 /**
  * @file
@@ -727,8 +728,240 @@ static bool flash_write_check_gap(struct flash_bank *bank,
 }
 
 
+/* Image runs are read, written and verified in chunks of at most this many
+ * bytes, so large images are not held in memory at once. */
+#define FLASH_WRITE_CHUNK_SIZE (4 * 1024 * 1024)
+
+/**
+ * Size of the next chunk of a flash run starting at bank offset @a offset.
+ * Chunks end at sector boundaries; banks without a sector layout are
+ * written in one go.
+ */
+static uint32_t flash_write_chunk_size(struct flash_bank *bank,
+		uint32_t offset, uint32_t size)
+{
+	uint32_t chunk_size = 0;
+
+	if (size <= FLASH_WRITE_CHUNK_SIZE || !bank->sectors)
+		return size;
+
+	for (unsigned int sect = 0; sect < bank->num_sectors; sect++) {
+		uint32_t end = bank->sectors[sect].offset + bank->sectors[sect].size;
+		if (end <= offset)
+			continue;
+		if (end - offset > FLASH_WRITE_CHUNK_SIZE)
+			break;
+		chunk_size = end - offset;
+	}
+
+	return chunk_size ? chunk_size : size;
+}
+
+/* Position in the sorted image sections while reading a flash run */
+struct flash_run_pos {
+	unsigned int section;
+	uint32_t section_offset;
+	/* padding still to insert before the next section data */
+	uint32_t pad_remaining;
+};
+
+/**
+ * Fill @a buffer with the next @a size bytes of a flash run, image data
+ * and padding, starting at @a pos, which is advanced accordingly.
+ */
+static int flash_run_read(struct image *image, struct imagesection **sections,
+		const int *padding, uint8_t padded_value, struct flash_run_pos *pos,
+		uint8_t *buffer, uint32_t size)
+{
+	uint32_t buffer_idx = 0;
+
+	while (buffer_idx < size) {
+		size_t size_read;
+
+		/* padding before the run or between two sections */
+		if (pos->pad_remaining) {
+			uint32_t pad = MIN(pos->pad_remaining, size - buffer_idx);
+			memset(buffer + buffer_idx, padded_value, pad);
+			buffer_idx += pad;
+			pos->pad_remaining -= pad;
+			continue;
+		}
+
+		size_read = size - buffer_idx;
+		if (size_read > sections[pos->section]->size - pos->section_offset)
+			size_read = sections[pos->section]->size - pos->section_offset;
+
+		/* KLUDGE!
+		 *
+		 * #¤%#"%¤% we have to figure out the section # from the sorted
+		 * list of pointers to sections to invoke image_read_section()...
+		 */
+		intptr_t diff = (intptr_t)sections[pos->section] - (intptr_t)image->sections;
+		int t_section_num = diff / sizeof(struct imagesection);
+
+		LOG_DEBUG("image_read_section: section = %d, t_section_num = %d, "
+				"section_offset = %"PRIu32", buffer_idx = %"PRIu32", size_read = %zu",
+			pos->section, t_section_num, pos->section_offset,
+			buffer_idx, size_read);
+		int retval = image_read_section(image, t_section_num, pos->section_offset,
+				size_read, buffer + buffer_idx, &size_read);
+		if (retval != ERROR_OK)
+			return retval;
+		if (size_read == 0)
+			return ERROR_FAIL;
+
+		buffer_idx += size_read;
+		pos->section_offset += size_read;
+
+		if (pos->section_offset >= sections[pos->section]->size) {
+			/* see if we need to pad the section */
+			pos->pad_remaining = padding[pos->section];
+			pos->section++;
+			pos->section_offset = 0;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* Read the remaining @a size bytes of a flash run just to check them */
+static int flash_run_check(struct image *image, struct imagesection **sections,
+		const int *padding, uint8_t padded_value, struct flash_run_pos pos,
+		uint32_t size)
+{
+	const uint32_t scratch_size = 64 * 1024;
+	uint8_t *scratch = malloc(MIN(size, scratch_size));
+	int retval = ERROR_OK;
+
+	if (!scratch) {
+		LOG_ERROR("Out of memory for flash bank buffer");
+		return ERROR_FAIL;
+	}
+
+	while (size && retval == ERROR_OK) {
+		uint32_t len = MIN(size, scratch_size);
+		retval = flash_run_read(image, sections, padding, padded_value, &pos, scratch, len);
+		size -= len;
+	}
+
+	free(scratch);
+	return retval;
+}
+
+/**
+ * Check whether flash already holds @a buffer, without logging mismatches.
+ */
+static bool flash_range_matches(struct flash_bank *bank,
+		const uint8_t *buffer, uint32_t offset, uint32_t count)
+{
+	int retval = bank->driver->verify ? bank->driver->verify(bank, buffer, offset, count) :
+		default_flash_verify(bank, buffer, offset, count);
+
+	return retval == ERROR_OK;
+}
+
+/**
+ * Unlock, erase, write and verify one range of a bank, as requested.
+ */
+static int flash_program_range(struct flash_bank *bank,
+		const uint8_t *buffer, uint32_t offset, uint32_t count,
+		bool erase, bool unlock, bool verify)
+{
+	target_addr_t address = bank->base + offset;
+	int retval = ERROR_OK;
+
+	if (unlock)
+		retval = flash_unlock_address_range(bank->target, address, count);
+	if (retval == ERROR_OK && erase)
+		retval = flash_erase_address_range(bank->target, true, address, count);
+	if (retval == ERROR_OK)
+		retval = flash_driver_write(bank, buffer, offset, count);
+	if (retval == ERROR_OK && verify)
+		retval = flash_driver_verify(bank, buffer, offset, count);
+
+	return retval;
+}
+
+/**
+ * Program one range of changed sectors, adding the time taken to the
+ * skip info so the time saved can be estimated from it.
+ */
+static int flash_program_changed_range(struct flash_bank *bank,
+		const uint8_t *buffer, uint32_t offset, uint32_t count,
+		bool erase, bool unlock, bool verify, struct flash_skip_info *skip)
+{
+	struct duration bench;
+	duration_start(&bench);
+
+	int retval = flash_program_range(bank, buffer, offset, count, erase, unlock, verify);
+
+	if (duration_measure(&bench) == ERROR_OK)
+		skip->program_time += duration_elapsed(&bench);
+
+	return retval;
+}
+
+/**
+ * Program the part of a chunk that differs from the flash contents.
+ * Each sector is compared against the target first. Runs of differing
+ * sectors are programmed, matching sectors are left alone.
+ */
+static int flash_write_changed_sectors(struct flash_bank *bank,
+		const uint8_t *buffer, uint32_t offset, uint32_t count,
+		bool erase, bool unlock, bool verify,
+		uint32_t *written, struct flash_skip_info *skip)
+{
+	uint32_t end = offset + count;
+	uint32_t changed_start = offset, changed_size = 0;
+	unsigned int sect = 0;
+	int retval;
+
+	for (uint32_t pos = offset, unit_end; pos < end; pos = unit_end) {
+		/* compare sector by sector, or all at once without a sector layout */
+		unit_end = end;
+		if (bank->sectors) {
+			while (sect < bank->num_sectors &&
+					bank->sectors[sect].offset + bank->sectors[sect].size <= pos)
+				sect++;
+			if (sect < bank->num_sectors)
+				unit_end = MIN(end, bank->sectors[sect].offset + bank->sectors[sect].size);
+		}
+
+		if (!flash_range_matches(bank, buffer + (pos - offset), pos, unit_end - pos)) {
+			if (!changed_size)
+				changed_start = pos;
+			changed_size += unit_end - pos;
+			continue;
+		}
+
+		LOG_DEBUG("flash at " TARGET_ADDR_FMT " unchanged, skipping %" PRIu32 " bytes",
+			bank->base + pos, unit_end - pos);
+		skip->skipped += unit_end - pos;
+
+		if (changed_size) {
+			retval = flash_program_changed_range(bank, buffer + (changed_start - offset),
+					changed_start, changed_size, erase, unlock, verify, skip);
+			if (retval != ERROR_OK)
+				return retval;
+			*written += changed_size;
+			changed_size = 0;
+		}
+	}
+
+	if (changed_size) {
+		retval = flash_program_changed_range(bank, buffer + (changed_start - offset),
+				changed_start, changed_size, erase, unlock, verify, skip);
+		if (retval != ERROR_OK)
+			return retval;
+		*written += changed_size;
+	}
+
+	return ERROR_OK;
+}
+
 int flash_write_unlock_verify(struct target *target, struct image *image,
-	uint32_t *written, bool erase, bool unlock, bool write, bool verify)
+	uint32_t *written, struct flash_skip_info *skip, bool erase, bool unlock, bool write,
+	bool verify)
 {
 	int retval = ERROR_OK;
 
@@ -742,6 +975,10 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 
 	if (written)
 		*written = 0;
+	if (skip) {
+		skip->skipped = 0;
+		skip->program_time = 0;
+	}
 
 	if (erase) {
 		/* assume all sectors need erasing - stops any problems
@@ -766,7 +1003,6 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 
 	/* loop until we reach end of the image */
 	while (section < image->num_sections) {
-		uint32_t buffer_idx;
 		uint8_t *buffer;
 		unsigned int section_last;
 		target_addr_t run_address = sections[section]->base_address + section_offset;
@@ -894,96 +1130,116 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			run_size += delta;
 		}
 
-		/* allocate buffer */
-		buffer = malloc(run_size);
+		/* Read the image data before erasing anything, so a broken image
+		 * does not leave the flash erased. The first chunk is kept for
+		 * writing, the rest of a longer run is read once to check it and
+		 * again when it is written. */
+		struct flash_run_pos pos = {
+			.section = section,
+			.section_offset = section_offset,
+			.pad_remaining = padding_at_start,
+		};
+		uint32_t chunk_size = flash_write_chunk_size(c, run_address - c->base, run_size);
+
+		buffer = malloc(chunk_size);
 		if (!buffer) {
 			LOG_ERROR("Out of memory for flash bank buffer");
 			retval = ERROR_FAIL;
 			goto done;
 		}
 
-		if (padding_at_start)
-			memset(buffer, c->default_padded_value, padding_at_start);
-
-		buffer_idx = padding_at_start;
+		retval = flash_run_read(image, sections, padding, c->default_padded_value,
+				&pos, buffer, chunk_size);
+		if (retval == ERROR_OK && chunk_size < run_size)
+			retval = flash_run_check(image, sections, padding, c->default_padded_value,
+					pos, run_size - chunk_size);
+
+		/* unlock and erase the whole run first, so drivers can still
+		 * pick the fastest way to do it (e.g. a mass erase). When skipping
+		 * unchanged sectors, this is done for the differing ones only. */
+		bool write_changed = write && skip;
+		if (retval == ERROR_OK && unlock && !write_changed)
+			retval = flash_unlock_address_range(target, run_address, run_size);
+		if (retval == ERROR_OK && !write_changed) {
+			if (erase) {
+				/* calculate and erase sectors */
+				retval = flash_erase_address_range(target,
+						true, run_address, run_size);
+			}
+		}
 
-		/* read sections to the buffer */
-		while (buffer_idx < run_size) {
-			size_t size_read;
+		if (retval != ERROR_OK) {
+			/* abort operation */
+			free(buffer);
+			goto done;
+		}
 
-			size_read = run_size - buffer_idx;
-			if (size_read > sections[section]->size - section_offset)
-				size_read = sections[section]->size - section_offset;
+		/* write and verify the run in chunks of whole sectors */
+		uint32_t run_offset = 0;
+		while (run_offset < run_size) {
+			if (run_offset) {
+				chunk_size = flash_write_chunk_size(c,
+						run_address - c->base + run_offset, run_size - run_offset);
+
+				buffer = malloc(chunk_size);
+				if (!buffer) {
+					LOG_ERROR("Out of memory for flash bank buffer");
+					retval = ERROR_FAIL;
+					goto done;
+				}
 
-			/* KLUDGE!
-			 *
-			 * #¤%#"%¤% we have to figure out the section # from the sorted
-			 * list of pointers to sections to invoke image_read_section()...
-			 */
-			intptr_t diff = (intptr_t)sections[section] - (intptr_t)image->sections;
-			int t_section_num = diff / sizeof(struct imagesection);
-
-			LOG_DEBUG("image_read_section: section = %d, t_section_num = %d, "
-					"section_offset = %"PRIu32", buffer_idx = %"PRIu32", size_read = %zu",
-				section, t_section_num, section_offset,
-				buffer_idx, size_read);
-			retval = image_read_section(image, t_section_num, section_offset,
-					size_read, buffer + buffer_idx, &size_read);
-			if (retval != ERROR_OK || size_read == 0) {
-				free(buffer);
-				goto done;
+				retval = flash_run_read(image, sections, padding, c->default_padded_value,
+						&pos, buffer, chunk_size);
+				if (retval != ERROR_OK) {
+					free(buffer);
+					goto done;
+				}
 			}
 
-			buffer_idx += size_read;
-			section_offset += size_read;
-
-			/* see if we need to pad the section */
-			if (padding[section]) {
-				memset(buffer + buffer_idx, c->default_padded_value, padding[section]);
-				buffer_idx += padding[section];
-			}
+			target_addr_t chunk_address = run_address + run_offset;
 
-			if (section_offset >= sections[section]->size) {
-				section++;
-				section_offset = 0;
-			}
-		}
+			if (write_changed) {
+				uint32_t chunk_written = 0;
 
-		retval = ERROR_OK;
+				retval = flash_write_changed_sectors(c, buffer, chunk_address - c->base,
+						chunk_size, erase, unlock, verify, &chunk_written, skip);
+				free(buffer);
+				if (retval != ERROR_OK)
+					goto done;
 
-		if (unlock)
-			retval = flash_unlock_address_range(target, run_address, run_size);
-		if (retval == ERROR_OK) {
-			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
+				run_offset += chunk_size;
+				if (written)
+					*written += chunk_written;
+				continue;
 			}
-		}
 
-		if (retval == ERROR_OK) {
 			if (write) {
 				/* write flash sectors */
-				retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+				retval = flash_driver_write(c, buffer, chunk_address - c->base, chunk_size);
 			}
-		}
 
-		if (retval == ERROR_OK) {
-			if (verify) {
-				/* verify flash sectors */
-				retval = flash_driver_verify(c, buffer, run_address - c->base, run_size);
+			if (retval == ERROR_OK) {
+				if (verify) {
+					/* verify flash sectors */
+					retval = flash_driver_verify(c, buffer, chunk_address - c->base, chunk_size);
+				}
 			}
-		}
 
-		free(buffer);
+			free(buffer);
 
-		if (retval != ERROR_OK) {
-			/* abort operation */
-			goto done;
+			if (retval != ERROR_OK) {
+				/* abort operation */
+				goto done;
+			}
+
+			run_offset += chunk_size;
+
+			if (written)
+				*written += chunk_size;	/* add chunk size to total written counter */
 		}
 
-		if (written)
-			*written += run_size;	/* add run size to total written counter */
+		section = pos.section;
+		section_offset = pos.section_offset;
 	}
 
 done:
@@ -996,7 +1252,7 @@ done:
 int flash_write(struct target *target, struct image *image,
 	uint32_t *written, bool erase)
 {
-	return flash_write_unlock_verify(target, image, written, erase, false, true, false);
+	return flash_write_unlock_verify(target, image, written, NULL, erase, false, true, false);
 }
 
 struct flash_sector *alloc_block_array(uint32_t offset, uint32_t size,
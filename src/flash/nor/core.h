@@ -94,6 +94,10 @@ struct flash_bank {
 	 * erased value. Defaults to 0xFF. */
 	uint8_t default_padded_value;
 
+	/** Send data compressed to drivers staging it in target RAM, see
+	 * target_write_buffer_compressed(). Defaults to false. */
+	bool compressed_write;
+
 	/** Required alignment of flash write start address.
 	 * Default 0, no alignment. Can be any power of two or FLASH_WRITE_ALIGN_SECTOR */
 	uint32_t write_start_alignment;
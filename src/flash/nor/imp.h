@@ -37,8 +37,19 @@ int flash_driver_read(struct flash_bank *bank,
 int flash_driver_verify(struct flash_bank *bank,
 		const uint8_t *buffer, uint32_t offset, uint32_t count);
 
-/* write (optional verify) an image to flash memory of the given target */
+/** What flash_write_unlock_verify() did when skipping unchanged sectors */
+struct flash_skip_info {
+	/** bytes which already held the image data */
+	uint32_t skipped;
+	/** seconds spent programming the changed sectors, without comparing */
+	double program_time;
+};
+
+/* write (optional verify) an image to flash memory of the given target.
+ * If skip is not NULL, sectors which already hold the image data are
+ * not erased nor written, and what was skipped is returned there. */
 int flash_write_unlock_verify(struct target *target, struct image *image,
-		uint32_t *written, bool erase, bool unlock, bool write, bool verify);
+		uint32_t *written, struct flash_skip_info *skip, bool erase, bool unlock,
+		bool write, bool verify);
 
 #endif /* OPENOCD_FLASH_NOR_IMP_H */
@@ -224,12 +224,17 @@ static int rp2040_flash_write(struct flash_bank *bank, const uint8_t *buffer, ui
 	}
 
 	struct working_area *bounce = NULL;
+	uint32_t total = count;
+	uint32_t total_sent = 0;
 
 	int err = rp2040_stack_grab_and_prep(bank);
 	if (err != ERROR_OK)
 		goto cleanup;
 
 	unsigned int avail_pages = target_get_working_area_avail(target) / priv->dev->pagesize;
+	/* Leave half of the working area for the compressed data */
+	if (bank->compressed_write)
+		avail_pages /= 2;
 	/* We try to allocate working area rounded down to device page size,
 	 * al least 1 page, at most the write data size
 	 */
@@ -245,11 +250,16 @@ static int rp2040_flash_write(struct flash_bank *bank, const uint8_t *buffer, ui
 	while (count > 0) {
 		uint32_t write_size = count > chunk_size ? chunk_size : count;
 		LOG_DEBUG("Writing %d bytes to offset 0x%" PRIx32, write_size, offset);
-		err = target_write_buffer(target, bounce->address, write_size, buffer);
+		uint32_t sent = write_size;
+		if (bank->compressed_write)
+			err = target_write_buffer_compressed(target, bounce->address, write_size, buffer, &sent);
+		else
+			err = target_write_buffer(target, bounce->address, write_size, buffer);
 		if (err != ERROR_OK) {
 			LOG_ERROR("Could not load data into target bounce buffer");
 			break;
 		}
+		total_sent += sent;
 		uint32_t args[3] = {
 			offset, /* addr */
 			bounce->address, /* data */
@@ -267,6 +277,10 @@ static int rp2040_flash_write(struct flash_bank *bank, const uint8_t *buffer, ui
 		count -= write_size;
 	}
 
+	if (bank->compressed_write && err == ERROR_OK && total_sent)
+		LOG_INFO("compressed write sent %" PRIu32 " bytes for %" PRIu32 " (ratio %.2f)",
+			total_sent, total, (double)total / total_sent);
+
 cleanup:
 	target_free_working_area(target, bounce);
 
@@ -395,12 +395,14 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 
 	struct image image;
 	uint32_t written;
+	struct flash_skip_info skip;
 
 	int retval;
 
 	/* flash auto-erase is disabled by default*/
 	int auto_erase = 0;
 	bool auto_unlock = false;
+	bool skip_unchanged = false;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
@@ -413,6 +415,11 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "diff") == 0) {
+			skip_unchanged = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "skipping unchanged sectors");
 		} else
 			break;
 	}
@@ -442,8 +449,8 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock_verify(target, &image, &written, auto_erase,
-		auto_unlock, true, false);
+	retval = flash_write_unlock_verify(target, &image, &written,
+		skip_unchanged ? &skip : NULL, auto_erase, auto_unlock, true, false);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -453,6 +460,13 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 		command_print(CMD, "wrote %" PRIu32 " bytes from file %s "
 			"in %fs (%0.3f KiB/s)", written, CMD_ARGV[0],
 			duration_elapsed(&bench), duration_kbps(&bench, written));
+		/* estimate the time saved from the rate the changed sectors were
+		 * programmed at, leaving out the time spent comparing sectors */
+		if (skip_unchanged && written)
+			command_print(CMD, "skipped %" PRIu32 " unchanged bytes, saving about %fs",
+				skip.skipped, skip.program_time * skip.skipped / written);
+		else if (skip_unchanged)
+			command_print(CMD, "skipped %" PRIu32 " unchanged bytes", skip.skipped);
 	}
 
 	image_close(&image);
@@ -494,7 +508,7 @@ COMMAND_HANDLER(handle_flash_verify_image_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock_verify(target, &image, &verified, false,
+	retval = flash_write_unlock_verify(target, &image, &verified, NULL, false,
 		false, false, true);
 	if (retval != ERROR_OK) {
 		image_close(&image);
@@ -1073,6 +1087,25 @@ COMMAND_HANDLER(handle_flash_padded_value_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_flash_compressed_write_command)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct flash_bank *p;
+	int retval = CALL_COMMAND_HANDLER(flash_command_get_bank, 0, &p);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (CMD_ARGC == 2)
+		COMMAND_PARSE_ENABLE(CMD_ARGV[1], p->compressed_write);
+
+	command_print(CMD, "compressed write is %s for flash bank %u",
+			p->compressed_write ? "enabled" : "disabled", p->bank_number);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration flash_exec_command_handlers[] = {
 	{
 		.name = "probe",
@@ -1182,9 +1215,10 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [unlock] [diff] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
-			"and/or erase the region to be used. Allow optional "
+			"and/or erase the region to be used, and skip sectors "
+			"already holding the image data. Allow optional "
 			"offset from beginning of bank (defaults to zero)",
 	},
 	{
@@ -1229,6 +1263,14 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.usage = "bank_id value",
 		.help = "Set default flash padded value",
 	},
+	{
+		.name = "compressed_write",
+		.handler = handle_flash_compressed_write_command,
+		.mode = COMMAND_EXEC,
+		.usage = "bank_id ['enable'|'disable']",
+		.help = "Send flash data compressed, for drivers staging it "
+			"in target RAM",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
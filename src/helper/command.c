@@ -465,6 +465,115 @@ void command_print(struct command_invocation *cmd, const char *format, ...)
 	va_end(ap);
 }
 
+/* output is handed to the interpreter in blocks of this size */
+#define COMMAND_OUTPUT_BUFFER_BLOCK (64 * 1024)
+
+void command_output_buffer_init(struct command_output_buffer *out,
+		struct command_invocation *cmd)
+{
+	memset(out, 0, sizeof(*out));
+	out->cmd = cmd;
+}
+
+/* make room for at least 'needed' more characters */
+static bool command_output_buffer_reserve(struct command_output_buffer *out, size_t needed)
+{
+	if (out->size - out->len >= needed)
+		return true;
+
+	size_t size = MAX(MAX(2 * out->size, out->len + needed), (size_t)256);
+	char *buf = realloc(out->buf, size);
+	if (!buf) {
+		out->failed = true;
+		return false;
+	}
+	out->buf = buf;
+	out->size = size;
+	return true;
+}
+
+void command_output_buffer_flush(struct command_output_buffer *out)
+{
+	if (out->len && out->cmd)
+		Jim_AppendString(out->cmd->ctx->interp, out->cmd->output, out->buf, out->len);
+	out->len = 0;
+}
+
+void command_output_buffer_printf(struct command_output_buffer *out, const char *format, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, format);
+	len = vsnprintf(out->buf + out->len, out->size - out->len, format, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+
+	if ((size_t)len >= out->size - out->len) {
+		if (!command_output_buffer_reserve(out, len + 1))
+			return;
+		va_start(ap, format);
+		vsnprintf(out->buf + out->len, out->size - out->len, format, ap);
+		va_end(ap);
+	}
+	out->len += len;
+
+	if (out->len >= COMMAND_OUTPUT_BUFFER_BLOCK)
+		command_output_buffer_flush(out);
+}
+
+/**
+ * Append the values as elements of a Tcl list, formatted as with
+ * "0x%" PRIx64, separated from any element appended before by a space.
+ */
+void command_output_buffer_hex_list(struct command_output_buffer *out,
+		const uint64_t *values, size_t count)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+
+	for (size_t i = 0; i < count; i++) {
+		uint64_t value = values[i];
+		unsigned int digits = 1;
+
+		/* separator, prefix and up to 16 digits */
+		if (!command_output_buffer_reserve(out, 19))
+			return;
+
+		char *p = out->buf + out->len;
+		if (out->list_started)
+			*p++ = ' ';
+		*p++ = '0';
+		*p++ = 'x';
+		for (uint64_t v = value >> 4; v; v >>= 4)
+			digits++;
+		for (unsigned int j = digits; j > 0; j--, value >>= 4)
+			p[j - 1] = hex_digits[value & 0xf];
+		p += digits;
+
+		out->len = p - out->buf;
+		out->list_started = true;
+
+		if (out->len >= COMMAND_OUTPUT_BUFFER_BLOCK)
+			command_output_buffer_flush(out);
+	}
+}
+
+/** Flush the remaining output and release the buffer. */
+int command_output_buffer_done(struct command_output_buffer *out)
+{
+	command_output_buffer_flush(out);
+	free(out->buf);
+	out->buf = NULL;
+	out->size = 0;
+
+	if (out->failed) {
+		LOG_ERROR("Out of memory, command output truncated");
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
 static bool command_can_run(struct command_context *cmd_ctx, struct command *c, const char *full_name)
 {
 	if (c->mode == COMMAND_ANY || c->mode == cmd_ctx->mode)
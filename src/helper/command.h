@@ -391,6 +391,32 @@ __attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 2, 3)));
 void command_print_sameline(struct command_invocation *cmd, const char *format, ...)
 __attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 2, 3)));
 
+/**
+ * Buffered output for commands producing large results. The text is
+ * collected in a buffer growing geometrically and appended to the command
+ * output in large blocks, instead of one allocation and one append per
+ * command_print_sameline() call.
+ */
+struct command_output_buffer {
+	struct command_invocation *cmd;
+	char *buf;
+	size_t len;
+	size_t size;
+	/* a list element has been written, the next one needs a separator */
+	bool list_started;
+	/* some output was lost for lack of memory */
+	bool failed;
+};
+
+void command_output_buffer_init(struct command_output_buffer *out,
+		struct command_invocation *cmd);
+void command_output_buffer_printf(struct command_output_buffer *out, const char *format, ...)
+__attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 2, 3)));
+void command_output_buffer_hex_list(struct command_output_buffer *out,
+		const uint64_t *values, size_t count);
+void command_output_buffer_flush(struct command_output_buffer *out);
+int command_output_buffer_done(struct command_output_buffer *out);
+
 int command_run_line(struct command_context *context, char *line);
 int command_run_linef(struct command_context *context, const char *format, ...)
 __attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 2, 3)));
@@ -13,9 +13,60 @@
 #endif
 
 #include "crc32.h"
+#include "types.h"
 #include <stdint.h>
 #include <stddef.h>
 
+/*
+ * Slicing-by-8 lookup tables for the two common polynomials.
+ * Table 0 is the classic byte-at-a-time table, table k gives the CRC
+ * contribution of a byte followed by k zero bytes.
+ */
+static uint32_t crc32_le_table[8][256];
+static uint32_t crc32_be_table[8][256];
+
+static void crc32_le_init_table(void)
+{
+	static bool initialized;
+	if (initialized)
+		return;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY_LE : (c >> 1);
+		crc32_le_table[0][i] = c;
+	}
+	for (unsigned int i = 0; i < 256; i++)
+		for (unsigned int k = 1; k < 8; k++) {
+			uint32_t c = crc32_le_table[k - 1][i];
+			crc32_le_table[k][i] = (c >> 8) ^ crc32_le_table[0][c & 0xff];
+		}
+
+	initialized = true;
+}
+
+static void crc32_be_init_table(void)
+{
+	static bool initialized;
+	if (initialized)
+		return;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i << 24;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 0x80000000) ? (c << 1) ^ CRC32_POLY_BE : (c << 1);
+		crc32_be_table[0][i] = c;
+	}
+	for (unsigned int i = 0; i < 256; i++)
+		for (unsigned int k = 1; k < 8; k++) {
+			uint32_t c = crc32_be_table[k - 1][i];
+			crc32_be_table[k][i] = (c << 8) ^ crc32_be_table[0][c >> 24];
+		}
+
+	initialized = true;
+}
+
 static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 		unsigned int data_bits)
 {
@@ -30,21 +81,77 @@ static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 	return crc;
 }
 
+static uint32_t crc_be_step(uint32_t poly, uint32_t crc, uint8_t data_in)
+{
+	crc ^= (uint32_t)data_in << 24;
+	for (unsigned int i = 0; i < 8; i++)
+		crc = (crc & 0x80000000) ? (crc << 1) ^ poly : (crc << 1);
+
+	return crc;
+}
+
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 		size_t data_len)
 {
-	if (((uintptr_t)_data & 0x3) || (data_len & 0x3)) {
-		/* data is unaligned, processing data one byte at a time */
-		const uint8_t *data = _data;
+	const uint8_t *data = _data;
+
+	if (poly != CRC32_POLY_LE) {
+		/* no table for this polynomial, process data one bit at a time */
 		for (size_t i = 0; i < data_len; i++)
 			seed = crc_le_step(poly, seed, data[i], 8);
-	} else {
-		/* data is aligned, processing 32 bit at a time */
-		data_len >>= 2;
-		const uint32_t *data = _data;
+		return seed;
+	}
+
+	crc32_le_init_table();
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		uint32_t one = seed ^ le_to_h_u32(data);
+		uint32_t two = le_to_h_u32(data + 4);
+		seed = crc32_le_table[7][one & 0xff] ^
+			crc32_le_table[6][(one >> 8) & 0xff] ^
+			crc32_le_table[5][(one >> 16) & 0xff] ^
+			crc32_le_table[4][one >> 24] ^
+			crc32_le_table[3][two & 0xff] ^
+			crc32_le_table[2][(two >> 8) & 0xff] ^
+			crc32_le_table[1][(two >> 16) & 0xff] ^
+			crc32_le_table[0][two >> 24];
+	}
+
+	while (data_len--)
+		seed = (seed >> 8) ^ crc32_le_table[0][(seed ^ *data++) & 0xff];
+
+	return seed;
+}
+
+uint32_t crc32_be(uint32_t poly, uint32_t seed, const void *_data,
+		size_t data_len)
+{
+	const uint8_t *data = _data;
+
+	if (poly != CRC32_POLY_BE) {
+		/* no table for this polynomial, process data one bit at a time */
 		for (size_t i = 0; i < data_len; i++)
-			seed = crc_le_step(poly, seed, data[i], 32);
+			seed = crc_be_step(poly, seed, data[i]);
+		return seed;
 	}
 
+	crc32_be_init_table();
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		uint32_t one = seed ^ be_to_h_u32(data);
+		uint32_t two = be_to_h_u32(data + 4);
+		seed = crc32_be_table[7][one >> 24] ^
+			crc32_be_table[6][(one >> 16) & 0xff] ^
+			crc32_be_table[5][(one >> 8) & 0xff] ^
+			crc32_be_table[4][one & 0xff] ^
+			crc32_be_table[3][two >> 24] ^
+			crc32_be_table[2][(two >> 16) & 0xff] ^
+			crc32_be_table[1][(two >> 8) & 0xff] ^
+			crc32_be_table[0][two & 0xff];
+	}
+
+	while (data_len--)
+		seed = (seed << 8) ^ crc32_be_table[0][((seed >> 24) ^ *data++) & 0xff];
+
 	return seed;
 }
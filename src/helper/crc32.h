@@ -12,7 +12,8 @@
 #include <stddef.h>
 
 /** @file
- * A generic CRC32 implementation
+ * A generic CRC32 implementation, table driven (slicing-by-8) for
+ * CRC32_POLY_LE and CRC32_POLY_BE
  */
 
 /**
@@ -20,6 +21,11 @@
  */
 #define CRC32_POLY_LE	0xedb88320
 
+/**
+ * CRC32 polynomial in MSB-first (non-reflected) form, as used by GDB
+ */
+#define CRC32_POLY_BE	0x04c11db7
+
 /**
  * Calculate the CRC32 value of the given data
  * @param	poly		The polynomial of the CRC
@@ -34,4 +40,18 @@
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *data,
 		size_t data_len);
 
+/**
+ * Calculate the MSB-first (non-reflected) CRC32 value of the given data,
+ * e.g. the checksum GDB expects in reply to a qCRC packet
+ * @param	poly		The polynomial of the CRC
+ * @param	seed		The seed to use (mostly either `0` or `0xffffffff`)
+ * @param	data		The data to calculate the CRC32 of
+ * @param	data_len	The length of the data in @p data in bytes
+ * @return	The CRC value of the first @p data_len bytes at @p data
+ * @note	Like crc32_le(), the result can be used as @p seed for the next
+ *			chunk of data.
+ */
+uint32_t crc32_be(uint32_t poly, uint32_t seed, const void *data,
+		size_t data_len);
+
 #endif /* OPENOCD_HELPER_CRC32_H */
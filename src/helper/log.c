@@ -22,6 +22,7 @@
 #include <server/gdb_server.h>
 #include <server/server.h>
 
+#include <ctype.h>
 #include <stdarg.h>
 
 #ifdef _DEBUG_FREE_SPACE_
@@ -52,6 +53,63 @@ static const char * const log_strings[6] = {
 
 static int count;
 
+/* Binary ring log. Messages are stored as their call site plus the raw
+ * printf() arguments, and are only formatted when the ring is decoded,
+ * see contrib/log_ring_decode.c for the dump file layout. Call sites are
+ * identified by the address of their file name and format string, which
+ * are expected to be string literals. String arguments go to a separate
+ * byte ring, half of the size, as they vary from a few bytes to whole
+ * packet dumps. */
+#define LOG_RING_MAX_ARGS	8
+/* longest string kept, as a fraction of the string ring */
+#define LOG_RING_STRING_SHARE	4
+#define LOG_RING_DEFAULT_FILE	"openocd_log_ring.bin"
+#define LOG_RING_MAGIC		"OCDRING2"
+
+struct log_ring_site {
+	const char *file;
+	unsigned int line;
+	const char *function;
+	const char *format;
+};
+
+struct log_ring_entry {
+	uint32_t site;
+	uint32_t count;
+	int64_t time;
+	int8_t level;
+	uint8_t num_args;
+	/* 'i' signed, 'u' unsigned, 'f' double, 's' string,
+	 * 'm' message formatted at record time */
+	char types[LOG_RING_MAX_ARGS];
+	/* bit n set if string argument n was cut */
+	uint8_t truncated;
+	/* strings are stored as position in the string ring */
+	uint64_t args[LOG_RING_MAX_ARGS];
+};
+
+static struct {
+	struct log_ring_entry *entries;
+	unsigned int size;
+	unsigned int next;
+	unsigned int used;
+	/* string ring, positions count all bytes ever written */
+	char *strings;
+	size_t strings_size;
+	uint64_t strings_pos;
+	struct log_ring_site *sites;
+	unsigned int num_sites;
+	unsigned int sites_size;
+	/* open addressing hash of site indexes + 1, zero is empty */
+	uint32_t *hash;
+	unsigned int hash_size;
+	char *dump_file;
+	/* the first error is dumped to its own file, kept until the ring is reset */
+	char *error_dump_file;
+	bool error_dumped;
+	bool dumping;
+} log_ring;
+
 /* forward the log to the listeners */
 static void log_forward(const char *file, unsigned line, const char *function, const char *string)
 {
@@ -131,6 +189,378 @@ static void log_puts(enum log_levels level,
 		log_forward(file, line, function, string);
 }
 
+static unsigned int log_ring_hash(const char *file, unsigned int line, const char *format)
+{
+	uintptr_t h = (uintptr_t)format ^ ((uintptr_t)file >> 3) ^ (line * 2654435761u);
+
+	return (h ^ (h >> 16)) & (log_ring.hash_size - 1);
+}
+
+/* return the index of a call site, registering it on first use */
+static int log_ring_site(const char *file, unsigned int line,
+	const char *function, const char *format)
+{
+	unsigned int h = log_ring_hash(file, line, format);
+
+	while (log_ring.hash[h]) {
+		struct log_ring_site *site = &log_ring.sites[log_ring.hash[h] - 1];
+		if (site->format == format && site->file == file && site->line == line)
+			return log_ring.hash[h] - 1;
+		h = (h + 1) & (log_ring.hash_size - 1);
+	}
+
+	if (log_ring.num_sites == log_ring.sites_size) {
+		unsigned int sites_size = log_ring.sites_size ? 2 * log_ring.sites_size : 256;
+		struct log_ring_site *sites = realloc(log_ring.sites, sites_size * sizeof(*sites));
+		if (!sites)
+			return -1;
+		log_ring.sites = sites;
+		log_ring.sites_size = sites_size;
+	}
+
+	/* keep the hash at most half full */
+	if (2 * (log_ring.num_sites + 1) > log_ring.hash_size) {
+		unsigned int hash_size = 2 * log_ring.hash_size;
+		uint32_t *hash = calloc(hash_size, sizeof(*hash));
+		if (!hash)
+			return -1;
+		free(log_ring.hash);
+		log_ring.hash = hash;
+		log_ring.hash_size = hash_size;
+		for (unsigned int i = 0; i < log_ring.num_sites; i++) {
+			struct log_ring_site *site = &log_ring.sites[i];
+			unsigned int j = log_ring_hash(site->file, site->line, site->format);
+			while (log_ring.hash[j])
+				j = (j + 1) & (hash_size - 1);
+			log_ring.hash[j] = i + 1;
+		}
+		h = log_ring_hash(file, line, format);
+		while (log_ring.hash[h])
+			h = (h + 1) & (hash_size - 1);
+	}
+
+	struct log_ring_site *site = &log_ring.sites[log_ring.num_sites];
+	site->file = file;
+	site->line = line;
+	site->function = function;
+	site->format = format;
+	log_ring.hash[h] = ++log_ring.num_sites;
+
+	return log_ring.num_sites - 1;
+}
+
+/* copy a string to the string ring, cut if too long, return its position */
+static uint64_t log_ring_store_string(struct log_ring_entry *entry, unsigned int arg,
+	const char *str)
+{
+	size_t len = strlen(str);
+	size_t max_len = log_ring.strings_size / LOG_RING_STRING_SHARE - 1;
+	uint64_t pos = log_ring.strings_pos;
+	size_t offset = pos % log_ring.strings_size;
+
+	if (len > max_len) {
+		len = max_len;
+		entry->truncated |= 1 << arg;
+	}
+
+	size_t first = MIN(len, log_ring.strings_size - offset);
+	memcpy(log_ring.strings + offset, str, first);
+	memcpy(log_ring.strings, str + first, len - first);
+	log_ring.strings[(offset + len) % log_ring.strings_size] = '\0';
+	log_ring.strings_pos += len + 1;
+
+	return pos;
+}
+
+/* Collect the printf() arguments, return false for formats we can't
+ * store raw, e.g. too many arguments or '*' width. */
+static bool log_ring_collect_args(struct log_ring_entry *entry,
+	const char *format, va_list args)
+{
+	entry->num_args = 0;
+	entry->truncated = 0;
+	for (const char *p = format; *p; p++) {
+		if (*p != '%')
+			continue;
+		p++;
+		p += strspn(p, "-+ #0'");
+		p += strspn(p, "0123456789.");
+		if (*p == '*')
+			return false;
+
+		/* length modifier, only 'long long' sized arguments matter */
+		bool is_long_long = false;
+		bool is_size = false;
+		if (p[0] == 'l' && p[1] == 'l') {
+			is_long_long = true;
+			p += 2;
+		} else if (*p == 'l') {
+			is_long_long = sizeof(long) == sizeof(long long);
+			p++;
+		} else if (*p == 'j') {
+			is_long_long = true;
+			p++;
+		} else if (*p == 'z' || *p == 't') {
+			is_size = true;
+			p++;
+		} else {
+			p += strspn(p, "h");
+		}
+
+		/* long double */
+		if (*p == 'L')
+			return false;
+
+		if (*p == '%')
+			continue;
+		if (entry->num_args == LOG_RING_MAX_ARGS)
+			return false;
+
+		uint64_t *arg = &entry->args[entry->num_args];
+		char *type = &entry->types[entry->num_args];
+		switch (*p) {
+		case 'd':
+		case 'i':
+			*type = 'i';
+			if (is_long_long)
+				*arg = va_arg(args, long long);
+			else if (is_size)
+				*arg = va_arg(args, ssize_t);
+			else
+				*arg = va_arg(args, int);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+		case 'c':
+			*type = 'u';
+			if (is_long_long)
+				*arg = va_arg(args, unsigned long long);
+			else if (is_size)
+				*arg = va_arg(args, size_t);
+			else
+				*arg = va_arg(args, unsigned int);
+			break;
+		case 'p':
+			*type = 'u';
+			*arg = (uintptr_t)va_arg(args, void *);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A': {
+			double d = va_arg(args, double);
+			*type = 'f';
+			memcpy(arg, &d, sizeof(d));
+			break;
+		}
+		case 's': {
+			const char *str = va_arg(args, const char *);
+			if (!str)
+				str = "(null)";
+			*type = 's';
+			*arg = log_ring_store_string(entry, entry->num_args, str);
+			break;
+		}
+		default:
+			return false;
+		}
+		entry->num_args++;
+	}
+
+	return true;
+}
+
+static void log_ring_record(enum log_levels level, const char *file, unsigned int line,
+	const char *function, const char *format, va_list args)
+{
+	int site = log_ring_site(file, line, function, format);
+	if (site < 0)
+		return;
+
+	struct log_ring_entry *entry = &log_ring.entries[log_ring.next];
+	entry->site = site;
+	entry->count = count;
+	entry->time = timeval_ms() - start;
+	entry->level = level;
+
+	va_list args_copy;
+	va_copy(args_copy, args);
+	bool raw = log_ring_collect_args(entry, format, args_copy);
+	va_end(args_copy);
+
+	if (!raw) {
+		/* keep the text instead */
+		va_copy(args_copy, args);
+		char *message = alloc_vprintf(format, args_copy);
+		va_end(args_copy);
+		entry->num_args = 1;
+		entry->types[0] = 'm';
+		entry->truncated = 0;
+		entry->args[0] = log_ring_store_string(entry, 0, message ? message : "");
+		free(message);
+	}
+
+	log_ring.next = (log_ring.next + 1) % log_ring.size;
+	if (log_ring.used < log_ring.size)
+		log_ring.used++;
+}
+
+static bool log_ring_write_u32(FILE *file, uint32_t value)
+{
+	uint8_t buf[4];
+
+	h_u32_to_le(buf, value);
+	return fwrite(buf, sizeof(buf), 1, file) == 1;
+}
+
+static bool log_ring_write_u64(FILE *file, uint64_t value)
+{
+	uint8_t buf[8];
+
+	h_u64_to_le(buf, value);
+	return fwrite(buf, sizeof(buf), 1, file) == 1;
+}
+
+static bool log_ring_write_string(FILE *file, const char *string)
+{
+	size_t len = strlen(string);
+
+	return log_ring_write_u32(file, len) && fwrite(string, 1, len, file) == len;
+}
+
+/* Write a string argument, flagged by an upper case type if it was cut
+ * when recorded or has since been overwritten in the string ring. */
+static bool log_ring_write_string_arg(FILE *file, char type, bool truncated, uint64_t pos)
+{
+	size_t len = 0;
+
+	if (log_ring.strings_pos - pos > log_ring.strings_size) {
+		/* lost, only the flag is left */
+		truncated = true;
+	} else {
+		while (log_ring.strings[(pos + len) % log_ring.strings_size])
+			len++;
+	}
+
+	if (truncated)
+		type = toupper(type);
+	if (fwrite(&type, 1, 1, file) != 1 || !log_ring_write_u32(file, len))
+		return false;
+
+	size_t offset = pos % log_ring.strings_size;
+	size_t first = MIN(len, log_ring.strings_size - offset);
+	return fwrite(log_ring.strings + offset, 1, first, file) == first
+		&& fwrite(log_ring.strings, 1, len - first, file) == len - first;
+}
+
+static bool log_ring_write(FILE *file)
+{
+	if (fwrite(LOG_RING_MAGIC, 8, 1, file) != 1)
+		return false;
+
+	if (!log_ring_write_u32(file, log_ring.num_sites))
+		return false;
+	for (unsigned int i = 0; i < log_ring.num_sites; i++) {
+		struct log_ring_site *site = &log_ring.sites[i];
+		const char *f = strrchr(site->file, '/');
+		if (!log_ring_write_u32(file, site->line)
+				|| !log_ring_write_string(file, f ? f + 1 : site->file)
+				|| !log_ring_write_string(file, site->function)
+				|| !log_ring_write_string(file, site->format))
+			return false;
+	}
+
+	if (!log_ring_write_u32(file, log_ring.used))
+		return false;
+	unsigned int first = (log_ring.next + log_ring.size - log_ring.used) % log_ring.size;
+	for (unsigned int i = 0; i < log_ring.used; i++) {
+		struct log_ring_entry *entry = &log_ring.entries[(first + i) % log_ring.size];
+		uint8_t header[2] = { entry->level, entry->num_args };
+		if (!log_ring_write_u32(file, entry->site)
+				|| !log_ring_write_u32(file, entry->count)
+				|| !log_ring_write_u64(file, entry->time)
+				|| fwrite(header, sizeof(header), 1, file) != 1)
+			return false;
+		for (unsigned int j = 0; j < entry->num_args; j++) {
+			if (entry->types[j] == 's' || entry->types[j] == 'm') {
+				if (!log_ring_write_string_arg(file, entry->types[j],
+						entry->truncated & (1 << j), entry->args[j]))
+					return false;
+			} else if (fwrite(&entry->types[j], 1, 1, file) != 1
+					|| !log_ring_write_u64(file, entry->args[j])) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* write the ring to a file, oldest message first */
+static int log_ring_dump(const char *file_name)
+{
+	if (!log_ring.entries || log_ring.dumping)
+		return ERROR_OK;
+
+	/* errors reported while dumping must not trigger another dump */
+	log_ring.dumping = true;
+
+	int retval = ERROR_OK;
+	FILE *file = fopen(file_name, "wb");
+	if (!file) {
+		LOG_WARNING("failed to open log ring dump file \"%s\"", file_name);
+		retval = ERROR_FAIL;
+	} else {
+		if (!log_ring_write(file)) {
+			LOG_WARNING("failed to write log ring dump file \"%s\"", file_name);
+			retval = ERROR_FAIL;
+		}
+		fclose(file);
+	}
+
+	log_ring.dumping = false;
+
+	return retval;
+}
+
+static void log_ring_free(void)
+{
+	free(log_ring.entries);
+	free(log_ring.strings);
+	free(log_ring.sites);
+	free(log_ring.hash);
+	free(log_ring.dump_file);
+	free(log_ring.error_dump_file);
+	memset(&log_ring, 0, sizeof(log_ring));
+}
+
+static int log_ring_alloc(unsigned int size, size_t strings_size, const char *dump_file)
+{
+	log_ring_free();
+
+	log_ring.size = size;
+	log_ring.strings_size = strings_size;
+	log_ring.hash_size = 512;
+	log_ring.entries = calloc(size, sizeof(*log_ring.entries));
+	log_ring.strings = malloc(strings_size);
+	log_ring.hash = calloc(log_ring.hash_size, sizeof(*log_ring.hash));
+	log_ring.dump_file = strdup(dump_file);
+	log_ring.error_dump_file = alloc_printf("%s.error", dump_file);
+	if (!log_ring.entries || !log_ring.strings || !log_ring.hash || !log_ring.dump_file
+			|| !log_ring.error_dump_file) {
+		log_ring_free();
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
 void log_printf(enum log_levels level,
 	const char *file,
 	unsigned line,
@@ -166,6 +596,13 @@ void log_vprintf_lf(enum log_levels level, const char *file, unsigned line,
 	if (level > debug_level)
 		return;
 
+	if (log_ring.entries) {
+		log_ring_record(level, file, line, function, format, args);
+		/* debug messages are only kept in the ring */
+		if (level >= LOG_LVL_DEBUG)
+			return;
+	}
+
 	tmp = alloc_vprintf(format, args);
 
 	if (!tmp)
@@ -178,6 +615,13 @@ void log_vprintf_lf(enum log_levels level, const char *file, unsigned line,
 	strcat(tmp, "\n");
 	log_puts(level, file, line, function, tmp);
 	free(tmp);
+
+	/* only the first error, a repeating one would keep rewriting the
+	 * dump and replace the context of the first */
+	if (level == LOG_LVL_ERROR && log_ring.entries && !log_ring.error_dumped) {
+		log_ring.error_dumped = true;
+		log_ring_dump(log_ring.error_dump_file);
+	}
 }
 
 void log_printf_lf(enum log_levels level,
@@ -238,6 +682,48 @@ COMMAND_HANDLER(handle_log_output_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_log_ring_command)
+{
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC >= 1 && strcmp(CMD_ARGV[0], "off") == 0) {
+		if (CMD_ARGC != 1)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		log_ring_free();
+	} else if (CMD_ARGC >= 1 && strcmp(CMD_ARGV[0], "dump") == 0) {
+		if (!log_ring.entries) {
+			command_print(CMD, "log ring is disabled");
+			return ERROR_FAIL;
+		}
+		return log_ring_dump(CMD_ARGC == 2 ? CMD_ARGV[1] : log_ring.dump_file);
+	} else if (CMD_ARGC >= 1) {
+		unsigned int size_kib;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size_kib);
+		/* half for the messages, half for their string arguments */
+		size_t strings_size = (size_t)size_kib * 512;
+		unsigned int size = strings_size / sizeof(struct log_ring_entry);
+		if (size == 0 || size_kib > 1024 * 1024) {
+			command_print(CMD, "invalid log ring size %u KiB", size_kib);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		if (log_ring_alloc(size, strings_size,
+				CMD_ARGC == 2 ? CMD_ARGV[1] : LOG_RING_DEFAULT_FILE) != ERROR_OK) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+	}
+
+	if (log_ring.entries)
+		command_print(CMD, "log ring: %u of %u messages used, dump file \"%s\"%s",
+			log_ring.used, log_ring.size, log_ring.dump_file,
+			log_ring.error_dumped ? ", first error dumped" : "");
+	else
+		command_print(CMD, "log ring: disabled");
+
+	return ERROR_OK;
+}
+
 static const struct command_registration log_command_handlers[] = {
 	{
 		.name = "log_output",
@@ -246,6 +732,14 @@ static const struct command_registration log_command_handlers[] = {
 		.help = "redirect logging to a file (default: stderr)",
 		.usage = "[file_name | 'default']",
 	},
+	{
+		.name = "log_ring",
+		.handler = handle_log_ring_command,
+		.mode = COMMAND_ANY,
+		.help = "keep debug messages in a binary ring buffer, "
+			"dumped to a file on the first error and on exit",
+		.usage = "[size_kib [dump_file] | 'dump' [dump_file] | 'off']",
+	},
 	{
 		.name = "debug_level",
 		.handler = handle_debug_level_command,
@@ -286,6 +780,11 @@ void log_init(void)
 
 void log_exit(void)
 {
+	if (log_ring.entries) {
+		log_ring_dump(log_ring.dump_file);
+		log_ring_free();
+	}
+
 	if (log_output && log_output != stderr) {
 		/* Close log file, if it was open and wasn't stderr. */
 		fclose(log_output);
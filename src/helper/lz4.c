@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "lz4.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Greedy LZ77 with a single entry hash table, emitted in the LZ4 block
+ * format: a sequence of a token (literal length << 4 | match length - 4),
+ * literal length extension, literals, 16 bit little endian match offset
+ * and match length extension. Lengths of 15 continue in extension bytes,
+ * up to and including the first byte below 255. The last sequence holds
+ * literals only.
+ */
+
+#define LZ4_HASH_BITS		12
+#define LZ4_MIN_MATCH		4
+#define LZ4_MAX_OFFSET		0xffff
+/* the last match starts at least 12 bytes before the end of the data */
+#define LZ4_MATCH_LIMIT		12
+/* and the last 5 bytes are literals */
+#define LZ4_LAST_LITERALS	5
+
+struct lz4_output {
+	uint8_t *p;
+	uint8_t *end;
+	bool overflow;
+};
+
+static void lz4_put(struct lz4_output *out, const uint8_t *data, size_t len)
+{
+	if (out->overflow || (size_t)(out->end - out->p) < len) {
+		out->overflow = true;
+		return;
+	}
+	memcpy(out->p, data, len);
+	out->p += len;
+}
+
+static void lz4_put_byte(struct lz4_output *out, uint8_t byte)
+{
+	lz4_put(out, &byte, 1);
+}
+
+/* extension of a length whose token nibble is 15 */
+static void lz4_put_length(struct lz4_output *out, size_t len)
+{
+	for (len -= 15; len >= 255; len -= 255)
+		lz4_put_byte(out, 255);
+	lz4_put_byte(out, len);
+}
+
+/* length as stored in a token nibble */
+static uint8_t lz4_nibble(size_t len)
+{
+	return len < 15 ? len : 15;
+}
+
+static void lz4_put_sequence(struct lz4_output *out, const uint8_t *literals,
+		size_t literal_len, size_t offset, size_t match_len)
+{
+	uint8_t token = lz4_nibble(literal_len) << 4;
+
+	if (match_len)
+		token |= lz4_nibble(match_len - LZ4_MIN_MATCH);
+	lz4_put_byte(out, token);
+	if (literal_len >= 15)
+		lz4_put_length(out, literal_len);
+	lz4_put(out, literals, literal_len);
+
+	if (!match_len)
+		return;
+
+	lz4_put_byte(out, offset & 0xff);
+	lz4_put_byte(out, offset >> 8);
+	if (match_len - LZ4_MIN_MATCH >= 15)
+		lz4_put_length(out, match_len - LZ4_MIN_MATCH);
+}
+
+static uint32_t lz4_read_u32(const uint8_t *p)
+{
+	uint32_t value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static unsigned int lz4_hash(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+size_t lz4_compress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_size)
+{
+	struct lz4_output out = {
+		.p = dst,
+		.end = dst + dst_size,
+	};
+	size_t anchor = 0;
+	size_t pos = 0;
+
+	/* positions + 1, zero for none */
+	size_t *table = calloc(1 << LZ4_HASH_BITS, sizeof(*table));
+	if (!table)
+		return 0;
+
+	while (src_len >= LZ4_MATCH_LIMIT && pos < src_len - LZ4_MATCH_LIMIT && !out.overflow) {
+		uint32_t sequence = lz4_read_u32(src + pos);
+		unsigned int hash = lz4_hash(sequence);
+		size_t candidate = table[hash];
+		table[hash] = pos + 1;
+
+		if (!candidate || pos - (candidate - 1) > LZ4_MAX_OFFSET
+				|| lz4_read_u32(src + candidate - 1) != sequence) {
+			pos++;
+			continue;
+		}
+		candidate--;
+
+		size_t match_len = LZ4_MIN_MATCH;
+		while (pos + match_len < src_len - LZ4_LAST_LITERALS
+				&& src[candidate + match_len] == src[pos + match_len])
+			match_len++;
+
+		lz4_put_sequence(&out, src + anchor, pos - anchor, pos - candidate, match_len);
+		pos += match_len;
+		anchor = pos;
+	}
+
+	lz4_put_sequence(&out, src + anchor, src_len - anchor, 0, 0);
+	free(table);
+
+	if (out.overflow)
+		return 0;
+	return out.p - dst;
+}
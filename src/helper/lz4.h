@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_HELPER_LZ4_H
+#define OPENOCD_HELPER_LZ4_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @file
+ * A small compressor producing the LZ4 block format, simple enough to be
+ * inflated by a few instructions running on a target.
+ */
+
+/**
+ * Compress data to a LZ4 block
+ * @param	src			The data to compress
+ * @param	src_len		The length of the data in @p src in bytes
+ * @param	dst			The buffer receiving the compressed block
+ * @param	dst_size	The size of @p dst in bytes
+ * @return	The length of the compressed block, or 0 if it does not fit in
+ *			@p dst_size bytes or memory can not be allocated
+ * @note	Pass a @p dst_size smaller than @p src_len to give up early on
+ *			data which does not compress well enough.
+ */
+size_t lz4_compress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_size);
+
+#endif /* OPENOCD_HELPER_LZ4_H */
@@ -16,6 +16,7 @@
 #include "minidriver.h"
 #include "interface.h"
 #include "interfaces.h"
+#include <helper/time_support.h>
 #include <transport/transport.h>
 
 /**
@@ -48,6 +49,27 @@ static struct {
 	bool gpios_initialized; /* Initialization of GPIOs to their unset values performed at run time */
 } adapter_config;
 
+/* latency histogram buckets, bucket n counts operations taking less
+ * than 2^(n + 1) us, the last one everything slower */
+#define ADAPTER_STATS_BUCKETS 16
+
+static struct adapter_stats {
+	uint64_t count;
+	uint64_t items;
+	uint64_t total_us;
+	uint64_t max_us;
+	uint64_t histogram[ADAPTER_STATS_BUCKETS];
+} adapter_stats[ADAPTER_STATS_NUM];
+
+static const struct {
+	const char *name;
+	const char *unit;
+} adapter_stats_names[ADAPTER_STATS_NUM] = {
+	[ADAPTER_STATS_JTAG_QUEUE] = { "jtag_queue", "bits" },
+	[ADAPTER_STATS_SWD_RUN] = { "swd_run", "transfers" },
+	[ADAPTER_STATS_DAP_RUN] = { "dap_run", "-" },
+};
+
 static const struct gpio_map {
 	const char *name;
 	enum adapter_gpio_direction direction;
@@ -194,6 +216,8 @@ int adapter_quit(void)
 	free(adapter_config.serial);
 	free(adapter_config.usb_location);
 
+	jtag_command_queue_free();
+
 	struct jtag_tap *t = jtag_all_taps();
 	while (t) {
 		struct jtag_tap *n = t->next_tap;
@@ -1056,6 +1080,67 @@ COMMAND_HANDLER(handle_usb_location_command)
 }
 #endif /* HAVE_LIBUSB_GET_PORT_NUMBERS */
 
+void adapter_stats_add(enum adapter_stats_op op, uint64_t items, struct duration *duration)
+{
+	struct adapter_stats *stats = &adapter_stats[op];
+
+	if (duration_measure(duration) != ERROR_OK)
+		return;
+
+	uint64_t us = (uint64_t)duration->elapsed.tv_sec * 1000000 + duration->elapsed.tv_usec;
+	unsigned int bucket = 0;
+	while (bucket < ADAPTER_STATS_BUCKETS - 1 && (us >> (bucket + 1)))
+		bucket++;
+
+	stats->count++;
+	stats->items += items;
+	stats->total_us += us;
+	stats->max_us = MAX(stats->max_us, us);
+	stats->histogram[bucket]++;
+}
+
+COMMAND_HANDLER(handle_adapter_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(adapter_stats, 0, sizeof(adapter_stats));
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "%-12s %10s %12s %-10s %10s %8s %8s", "operation", "count",
+		"items", "unit", "total ms", "avg us", "max us");
+	for (unsigned int op = 0; op < ADAPTER_STATS_NUM; op++) {
+		struct adapter_stats *stats = &adapter_stats[op];
+		command_print(CMD, "%-12s %10" PRIu64 " %12" PRIu64 " %-10s %10" PRIu64
+			" %8" PRIu64 " %8" PRIu64, adapter_stats_names[op].name,
+			stats->count, stats->items, adapter_stats_names[op].unit,
+			stats->total_us / 1000, stats->count ? stats->total_us / stats->count : 0,
+			stats->max_us);
+	}
+
+	/* one row per operation, the columns are the histogram buckets */
+	char line[16 + 24 * ADAPTER_STATS_BUCKETS];
+	int len = snprintf(line, sizeof(line), "%-12s", "latency <");
+	for (unsigned int i = 0; i < ADAPTER_STATS_BUCKETS - 1; i++)
+		len += snprintf(line + len, sizeof(line) - len, " %7uus", 2u << i);
+	snprintf(line + len, sizeof(line) - len, " %9s", "longer");
+	command_print(CMD, "%s", line);
+
+	for (unsigned int op = 0; op < ADAPTER_STATS_NUM; op++) {
+		len = snprintf(line, sizeof(line), "%-12s", adapter_stats_names[op].name);
+		for (unsigned int i = 0; i < ADAPTER_STATS_BUCKETS; i++)
+			len += snprintf(line + len, sizeof(line) - len, " %9" PRIu64,
+				adapter_stats[op].histogram[i]);
+		command_print(CMD, "%s", line);
+	}
+
+	return ERROR_OK;
+}
+
 static const struct command_registration adapter_usb_command_handlers[] = {
 #ifdef HAVE_LIBUSB_GET_PORT_NUMBERS
 	{
@@ -1162,6 +1247,14 @@ static const struct command_registration adapter_command_handlers[] = {
 		.help = "Controls SRST and TRST lines.",
 		.usage = "|assert [srst|trst [deassert|assert srst|trst]]",
 	},
+	{
+		.name = "stats",
+		.handler = handle_adapter_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "Show or reset counters and latency histograms of "
+			"adapter operations",
+		.usage = "['reset']",
+	},
 	{
 		.name = "gpio",
 		.handler = adapter_gpio_config_handler,
@@ -65,7 +65,24 @@ struct adapter_gpio_config {
 	enum adapter_gpio_pull pull;
 };
 
+/** Adapter operations timed by the 'adapter stats' command */
+enum adapter_stats_op {
+	ADAPTER_STATS_JTAG_QUEUE,	/* jtag queue flush, items are bits shifted */
+	ADAPTER_STATS_SWD_RUN,		/* swd_driver run(), items are transfers */
+	ADAPTER_STATS_DAP_RUN,		/* dap_run(), items are not counted */
+	ADAPTER_STATS_NUM,
+};
+
 struct command_context;
+struct duration;
+
+/**
+ * Account one adapter operation in the 'adapter stats' counters.
+ * @param op The operation type.
+ * @param items Number of bits or transfers processed, see adapter_stats_op.
+ * @param duration Started with duration_start() before the operation.
+ */
+void adapter_stats_add(enum adapter_stats_op op, uint64_t items, struct duration *duration);
 
 /** Register the adapter's commands */
 int adapter_register_commands(struct command_context *ctx);
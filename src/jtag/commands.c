@@ -20,6 +20,7 @@
 #endif
 
 #include <jtag/jtag.h>
+#include <jtag/interface.h>
 #include <transport/transport.h>
 #include "commands.h"
 
@@ -27,10 +28,14 @@ struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
 	size_t used;
+	size_t size;
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
+/* number of pages kept for the next queue when the queue is reset */
+#define CMD_QUEUE_PAGES_KEPT 4
 static struct cmd_queue_page *cmd_queue_pages;
+/* page being filled, the pages after it are free */
 static struct cmd_queue_page *cmd_queue_pages_tail;
 
 static struct jtag_command *jtag_command_queue;
@@ -101,21 +106,23 @@ void *cmd_queue_alloc(size_t size)
 	size = (size + ALIGN_SIZE - 1) & (~(ALIGN_SIZE - 1));
 	/* Done... */
 
-	if (*p_page) {
+	if (cmd_queue_pages_tail) {
 		p_page = &cmd_queue_pages_tail;
-		if (CMD_QUEUE_PAGE_SIZE < (*p_page)->used + size)
+		if ((*p_page)->size < (*p_page)->used + size)
 			p_page = &((*p_page)->next);
 	}
 
-	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
-		(*p_page)->used = 0;
-		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
+	/* reuse the next free page if it is large enough */
+	if (!*p_page || (*p_page)->size < size) {
+		struct cmd_queue_page *page = malloc(sizeof(struct cmd_queue_page));
+		page->used = 0;
+		page->size = (size < CMD_QUEUE_PAGE_SIZE) ?
 					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
-		(*p_page)->next = NULL;
-		cmd_queue_pages_tail = *p_page;
+		page->address = malloc(page->size);
+		page->next = *p_page;
+		*p_page = page;
 	}
+	cmd_queue_pages_tail = *p_page;
 
 	offset = (*p_page)->used;
 	(*p_page)->used += size;
@@ -124,24 +131,39 @@ void *cmd_queue_alloc(size_t size)
 	return t + offset;
 }
 
-static void cmd_queue_free(void)
+/* Free the pages, except the first few of default size which are kept
+ * empty for the next queue to spare the allocator. */
+static void cmd_queue_free(unsigned int keep)
 {
-	struct cmd_queue_page *page = cmd_queue_pages;
+	struct cmd_queue_page **p_page = &cmd_queue_pages;
 
-	while (page) {
-		struct cmd_queue_page *last = page;
-		free(page->address);
-		page = page->next;
-		free(last);
+	while (*p_page) {
+		struct cmd_queue_page *page = *p_page;
+		if (keep && page->size == CMD_QUEUE_PAGE_SIZE) {
+			page->used = 0;
+			p_page = &page->next;
+			keep--;
+		} else {
+			*p_page = page->next;
+			free(page->address);
+			free(page);
+		}
 	}
 
-	cmd_queue_pages = NULL;
 	cmd_queue_pages_tail = NULL;
 }
 
 void jtag_command_queue_reset(void)
 {
-	cmd_queue_free();
+	cmd_queue_free(CMD_QUEUE_PAGES_KEPT);
+
+	jtag_command_queue = NULL;
+	next_command_pointer = &jtag_command_queue;
+}
+
+void jtag_command_queue_free(void)
+{
+	cmd_queue_free(0);
 
 	jtag_command_queue = NULL;
 	next_command_pointer = &jtag_command_queue;
@@ -152,6 +174,180 @@ struct jtag_command *jtag_command_queue_get(void)
 	return jtag_command_queue;
 }
 
+/* An IR scan shifting the same instructions as the previous one, without
+ * capturing anything */
+static bool jtag_ir_scan_is_repeat(const struct scan_command *prev, const struct scan_command *scan)
+{
+	if (prev->num_fields != scan->num_fields)
+		return false;
+
+	for (int i = 0; i < scan->num_fields; i++) {
+		const struct scan_field *prev_field = &prev->fields[i];
+		const struct scan_field *field = &scan->fields[i];
+
+		if (field->in_value || !field->out_value || !prev_field->out_value
+				|| field->num_bits != prev_field->num_bits
+				|| buf_cmp(field->out_value, prev_field->out_value, field->num_bits))
+			return false;
+	}
+
+	return true;
+}
+
+/* A path move from Run-Test/Idle taking the same route as a runtest end state */
+static bool jtag_pathmove_is_idle_exit(const struct pathmove_command *pathmove)
+{
+	tap_state_t goal = pathmove->path[pathmove->num_states - 1];
+	tap_state_t state = TAP_IDLE;
+
+	if (!tap_is_state_stable(goal) || goal == TAP_RESET)
+		return false;
+
+	int tms_bits = tap_get_tms_path(TAP_IDLE, goal);
+	if (tap_get_tms_path_len(TAP_IDLE, goal) != pathmove->num_states)
+		return false;
+
+	for (int i = 0; i < pathmove->num_states; i++, tms_bits >>= 1) {
+		state = tap_state_transition(state, tms_bits & 1);
+		if (pathmove->path[i] != state)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Simplify the queued commands before they are executed:
+ * - drop IR scans repeating the instruction already loaded, when they
+ *   capture nothing and leave the TAP in the state it is in;
+ * - merge consecutive runtest commands, consecutive path moves and
+ *   consecutive TMS sequences, and fold a state move following a runtest
+ *   into the end state of the runtest;
+ * - drop zero length runtest commands in Run-Test/Idle.
+ *
+ * @param state TAP state before the first command.
+ * @param bits_saved Incremented by the number of TCK cycles saved.
+ * @returns The number of commands removed from the queue.
+ */
+unsigned int jtag_command_queue_optimize(tap_state_t state, uint64_t *bits_saved)
+{
+	struct jtag_command **link = &jtag_command_queue;
+	struct jtag_command *prev = NULL;
+	/* last IR scan, NULL when the instruction is not known */
+	const struct scan_command *ir_scan = NULL;
+	unsigned int removed = 0;
+
+	while (*link) {
+		struct jtag_command *cmd = *link;
+		bool drop = false;
+
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			if (!cmd->cmd.scan->ir_scan) {
+				state = cmd->cmd.scan->end_state;
+				break;
+			}
+			if (ir_scan && state == cmd->cmd.scan->end_state
+					&& jtag_ir_scan_is_repeat(ir_scan, cmd->cmd.scan)) {
+				/* move to Shift-IR, shift, then Exit1-IR, Update-IR and back */
+				*bits_saved += tap_get_tms_path_len(state, TAP_IRSHIFT)
+					+ jtag_scan_size(cmd->cmd.scan) + 2;
+				drop = true;
+				break;
+			}
+			ir_scan = cmd->cmd.scan;
+			state = cmd->cmd.scan->end_state;
+			break;
+		case JTAG_RUNTEST:
+			if (cmd->cmd.runtest->num_cycles == 0 && state == TAP_IDLE
+					&& cmd->cmd.runtest->end_state == TAP_IDLE) {
+				drop = true;
+			} else if (prev && prev->type == JTAG_RUNTEST
+					&& prev->cmd.runtest->end_state == TAP_IDLE) {
+				prev->cmd.runtest->num_cycles += cmd->cmd.runtest->num_cycles;
+				prev->cmd.runtest->end_state = cmd->cmd.runtest->end_state;
+				drop = true;
+			}
+			state = cmd->cmd.runtest->end_state;
+			break;
+		case JTAG_PATHMOVE: {
+			struct pathmove_command *pathmove = cmd->cmd.pathmove;
+
+			if (pathmove->num_states == 0) {
+				drop = true;
+				break;
+			}
+
+			for (int i = 0; i < pathmove->num_states; i++)
+				if (pathmove->path[i] == TAP_IRUPDATE)
+					ir_scan = NULL;
+			state = pathmove->path[pathmove->num_states - 1];
+
+			if (!prev)
+				break;
+			if (prev->type == JTAG_RUNTEST && prev->cmd.runtest->end_state == TAP_IDLE
+					&& jtag_pathmove_is_idle_exit(pathmove)) {
+				prev->cmd.runtest->end_state = state;
+				drop = true;
+			} else if (prev->type == JTAG_PATHMOVE) {
+				struct pathmove_command *first = prev->cmd.pathmove;
+				int num_states = first->num_states + pathmove->num_states;
+				tap_state_t *path = cmd_queue_alloc(num_states * sizeof(*path));
+
+				memcpy(path, first->path, first->num_states * sizeof(*path));
+				memcpy(path + first->num_states, pathmove->path,
+					pathmove->num_states * sizeof(*path));
+				first->path = path;
+				first->num_states = num_states;
+				drop = true;
+			}
+			break;
+		}
+		case JTAG_TMS:
+			/* arbitrary TMS sequence, state and instruction are unknown */
+			state = TAP_INVALID;
+			ir_scan = NULL;
+			if (prev && prev->type == JTAG_TMS) {
+				struct tms_command *first = prev->cmd.tms;
+				unsigned int num_bits = first->num_bits + cmd->cmd.tms->num_bits;
+				uint8_t *bits = cmd_queue_alloc(DIV_ROUND_UP(num_bits, 8));
+
+				buf_cpy(first->bits, bits, first->num_bits);
+				buf_set_buf(cmd->cmd.tms->bits, 0, bits, first->num_bits,
+					cmd->cmd.tms->num_bits);
+				first->bits = bits;
+				first->num_bits = num_bits;
+				drop = true;
+			}
+			break;
+		case JTAG_TLR_RESET:
+			state = TAP_RESET;
+			ir_scan = NULL;
+			break;
+		case JTAG_RESET:
+			/* TRST, or SRST if it pulls TRST */
+			state = TAP_INVALID;
+			ir_scan = NULL;
+			break;
+		default:
+			break;
+		}
+
+		if (drop) {
+			*link = cmd->next;
+			removed++;
+		} else {
+			prev = cmd;
+			link = &cmd->next;
+		}
+	}
+
+	/* the tail may have been dropped */
+	next_command_pointer = link;
+
+	return removed;
+}
+
 /**
  * Copy a struct scan_field for insertion into the queue.
  *
@@ -153,7 +153,9 @@ void *cmd_queue_alloc(size_t size);
 
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
+void jtag_command_queue_free(void);
 struct jtag_command *jtag_command_queue_get(void);
+unsigned int jtag_command_queue_optimize(tap_state_t state, uint64_t *bits_saved);
 
 void jtag_scan_field_clone(struct scan_field *dst, const struct scan_field *src);
 enum scan_type jtag_scan_type(const struct scan_command *cmd);
@@ -25,6 +25,7 @@
 #include "interface.h"
 #include <transport/transport.h>
 #include <helper/jep106.h>
+#include <helper/time_support.h>
 #include "helper/system.h"
 
 #ifdef HAVE_STRINGS_H
@@ -90,6 +91,11 @@ tap_state_t cmd_queue_cur_state = TAP_RESET;
 static bool jtag_verify_capture_ir = true;
 static int jtag_verify = 1;
 
+/* simplify the command queue before it is executed */
+static bool jtag_optimize_queue;
+static uint64_t jtag_optimize_removed;
+static uint64_t jtag_optimize_bits_saved;
+
 /* how long the OpenOCD should wait before attempting JTAG communication after reset lines
  *deasserted (in ms) */
 static int adapter_nsrst_delay;	/* default to no nSRST delay */
@@ -929,6 +935,36 @@ void jtag_check_value_mask(struct scan_field *field, uint8_t *value, uint8_t *ma
 	jtag_set_error(retval);
 }
 
+/* number of TCK cycles in the queue, for 'adapter stats' */
+static uint64_t jtag_command_queue_bits(struct jtag_command *cmd)
+{
+	uint64_t bits = 0;
+
+	for (; cmd; cmd = cmd->next) {
+		switch (cmd->type) {
+			case JTAG_SCAN:
+				bits += jtag_scan_size(cmd->cmd.scan);
+				break;
+			case JTAG_RUNTEST:
+				bits += cmd->cmd.runtest->num_cycles;
+				break;
+			case JTAG_STABLECLOCKS:
+				bits += cmd->cmd.stableclocks->num_cycles;
+				break;
+			case JTAG_TMS:
+				bits += cmd->cmd.tms->num_bits;
+				break;
+			case JTAG_PATHMOVE:
+				bits += cmd->cmd.pathmove->num_states;
+				break;
+			default:
+				break;
+		}
+	}
+
+	return bits;
+}
+
 int default_interface_jtag_execute_queue(void)
 {
 	if (!is_adapter_initialized()) {
@@ -951,8 +987,15 @@ int default_interface_jtag_execute_queue(void)
 			return ERROR_OK;
 	}
 
+	if (jtag_optimize_queue)
+		jtag_optimize_removed += jtag_command_queue_optimize(tap_get_state(),
+				&jtag_optimize_bits_saved);
+
 	struct jtag_command *cmd = jtag_command_queue_get();
+	struct duration duration;
+	duration_start(&duration);
 	int result = adapter_driver->jtag_ops->execute_queue(cmd);
+	adapter_stats_add(ADAPTER_STATS_JTAG_QUEUE, jtag_command_queue_bits(cmd), &duration);
 
 	while (debug_level >= LOG_LVL_DEBUG_IO && cmd) {
 		switch (cmd->type) {
@@ -1697,6 +1740,22 @@ bool jtag_will_verify(void)
 	return jtag_verify;
 }
 
+void jtag_set_optimize_queue(bool enable)
+{
+	jtag_optimize_queue = enable;
+}
+
+bool jtag_will_optimize_queue(void)
+{
+	return jtag_optimize_queue;
+}
+
+void jtag_get_optimize_queue_stats(uint64_t *removed, uint64_t *bits_saved)
+{
+	*removed = jtag_optimize_removed;
+	*bits_saved = jtag_optimize_bits_saved;
+}
+
 void jtag_set_verify_capture_ir(bool enable)
 {
 	jtag_verify_capture_ir = enable;
@@ -35,6 +35,7 @@
 #include <jtag/commands.h>
 #include <jtag/tcl.h>
 #include <target/cortex_m.h>
+#include <helper/time_support.h>
 
 #include "cmsis_dap.h"
 #include "libusb_helper.h"
@@ -69,6 +70,10 @@ static uint16_t cmsis_dap_pid[MAX_USB_IDS + 1] = { 0 };
 static int cmsis_dap_backend = -1;
 static bool swd_mode;
 
+/* limit of the number of in-flight SWD transfer packets, the probe's
+ * packet count applies in addition */
+static unsigned int cmsis_dap_max_pending = MAX_PENDING_REQUESTS;
+
 /* CMSIS-DAP General Commands */
 #define CMD_DAP_INFO              0x00
 #define CMD_DAP_LED               0x01
@@ -250,6 +255,17 @@ static uint8_t queued_seq_buf[1024]; /* TODO: make dynamic / move into cmsis obj
 
 static int queued_retval;
 
+/* SWD transfer statistics, see 'cmsis-dap stats' */
+static struct {
+	uint64_t packets;
+	uint64_t block_packets;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t stalls;
+	unsigned int max_in_flight;
+	struct timeval io_time;
+} cmsis_dap_stats;
+
 static uint8_t output_pins = SWJ_PIN_SRST | SWJ_PIN_TRST;
 
 static struct cmsis_dap *cmsis_dap_handle;
@@ -867,6 +883,12 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 	if (dap->pending_fifo_block_count > packet_count)
 		LOG_ERROR("internal: too much pending writes %u", dap->pending_fifo_block_count);
 
+	cmsis_dap_stats.packets++;
+	if (block_cmd)
+		cmsis_dap_stats.block_packets++;
+	cmsis_dap_stats.max_in_flight = MAX(cmsis_dap_stats.max_in_flight,
+		dap->pending_fifo_block_count);
+
 	return;
 
 skip:
@@ -990,8 +1012,16 @@ skip:
 	dap->pending_fifo_block_count--;
 }
 
+static void cmsis_dap_stats_add_time(const struct duration *d)
+{
+	timeval_add_time(&cmsis_dap_stats.io_time, d->elapsed.tv_sec, d->elapsed.tv_usec);
+}
+
 static int cmsis_dap_swd_run_queue(void)
 {
+	struct duration io;
+	duration_start(&io);
+
 	if (cmsis_dap_handle->write_count + cmsis_dap_handle->read_count) {
 		if (cmsis_dap_handle->pending_fifo_block_count)
 			cmsis_dap_swd_read_process(cmsis_dap_handle, CMSIS_DAP_NON_BLOCKING);
@@ -1005,6 +1035,9 @@ static int cmsis_dap_swd_run_queue(void)
 	cmsis_dap_handle->pending_fifo_put_idx = 0;
 	cmsis_dap_handle->pending_fifo_get_idx = 0;
 
+	duration_measure(&io);
+	cmsis_dap_stats_add_time(&io);
+
 	int retval = queued_retval;
 	queued_retval = ERROR_OK;
 
@@ -1075,6 +1108,9 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 	if (cmd_size > tfer_max_command_size
 			|| resp_size > tfer_max_response_size
 			|| write_count + read_count > max_transfer_count) {
+		struct duration io;
+		duration_start(&io);
+
 		if (cmsis_dap_handle->pending_fifo_block_count)
 			cmsis_dap_swd_read_process(cmsis_dap_handle, CMSIS_DAP_NON_BLOCKING);
 
@@ -1082,8 +1118,14 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 		cmsis_dap_swd_write_from_queue(cmsis_dap_handle);
 
 		unsigned int packet_count = cmsis_dap_handle->quirk_mode ? 1 : cmsis_dap_handle->packet_count;
-		if (cmsis_dap_handle->pending_fifo_block_count >= packet_count)
+		if (cmsis_dap_handle->pending_fifo_block_count >= packet_count) {
+			/* pipeline full, wait for the oldest response */
+			cmsis_dap_stats.stalls++;
 			cmsis_dap_swd_read_process(cmsis_dap_handle, CMSIS_DAP_BLOCKING);
+		}
+
+		duration_measure(&io);
+		cmsis_dap_stats_add_time(&io);
 	}
 
 	assert(cmsis_dap_handle->pending_fifo[cmsis_dap_handle->pending_fifo_put_idx].transfer_count < pending_queue_len);
@@ -1106,8 +1148,10 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 		/* Queue a read transaction */
 		transfer->buffer = dst;
 		cmsis_dap_handle->read_count++;
+		cmsis_dap_stats.reads++;
 	} else {
 		cmsis_dap_handle->write_count++;
+		cmsis_dap_stats.writes++;
 	}
 	block->transfer_count++;
 }
@@ -1388,9 +1432,10 @@ static int cmsis_dap_init(void)
 	if (data[0] == 1) { /* byte */
 		unsigned int pkt_cnt = data[1];
 		if (pkt_cnt > 1)
-			cmsis_dap_handle->packet_count = MIN(MAX_PENDING_REQUESTS, pkt_cnt);
+			cmsis_dap_handle->packet_count = MIN(cmsis_dap_max_pending, pkt_cnt);
 
-		LOG_DEBUG("CMSIS-DAP: Packet Count = %u", pkt_cnt);
+		LOG_DEBUG("CMSIS-DAP: Packet Count = %u, using %u", pkt_cnt,
+			cmsis_dap_handle->packet_count);
 	}
 
 	LOG_DEBUG("Allocating FIFO for %u pending packets", cmsis_dap_handle->packet_count);
@@ -2236,6 +2281,61 @@ COMMAND_HANDLER(cmsis_dap_handle_quirk_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(cmsis_dap_handle_max_pending_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int max_pending;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], max_pending);
+		if (max_pending < 1 || max_pending > MAX_PENDING_REQUESTS) {
+			command_print(CMD, "max_pending must be between 1 and %u",
+				MAX_PENDING_REQUESTS);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		cmsis_dap_max_pending = max_pending;
+	}
+
+	command_print(CMD, "%u", cmsis_dap_max_pending);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(cmsis_dap_handle_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&cmsis_dap_stats, 0, sizeof(cmsis_dap_stats));
+		return ERROR_OK;
+	}
+
+	uint64_t transfers = cmsis_dap_stats.reads + cmsis_dap_stats.writes;
+	uint64_t io_us = cmsis_dap_stats.io_time.tv_sec * 1000000ULL
+		+ cmsis_dap_stats.io_time.tv_usec;
+
+	command_print(CMD, "packets:         %" PRIu64 " (%" PRIu64 " DAP_TransferBlock)",
+		cmsis_dap_stats.packets, cmsis_dap_stats.block_packets);
+	command_print(CMD, "transfers:       %" PRIu64 " reads, %" PRIu64 " writes",
+		cmsis_dap_stats.reads, cmsis_dap_stats.writes);
+	if (cmsis_dap_stats.packets)
+		command_print(CMD, "per packet:      %" PRIu64 " transfers",
+			transfers / cmsis_dap_stats.packets);
+	command_print(CMD, "in flight:       max %u of %u",
+		cmsis_dap_stats.max_in_flight,
+		cmsis_dap_handle ? cmsis_dap_handle->packet_count : 0);
+	command_print(CMD, "pipeline stalls: %" PRIu64, cmsis_dap_stats.stalls);
+	command_print(CMD, "I/O time:        %" PRIu64 " ms", io_us / 1000);
+	if (io_us)
+		command_print(CMD, "throughput:      %" PRIu64 " KiB/s",
+			transfers * 4 * 1000000 / io_us / 1024);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 	{
 		.name = "info",
@@ -2272,6 +2372,20 @@ static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 		.help = "allow expensive workarounds of known adapter quirks.",
 		.usage = "[enable | disable]",
 	},
+	{
+		.name = "max_pending",
+		.handler = &cmsis_dap_handle_max_pending_command,
+		.mode = COMMAND_CONFIG,
+		.help = "limit the number of SWD packets in flight.",
+		.usage = "[count]",
+	},
+	{
+		.name = "stats",
+		.handler = &cmsis_dap_handle_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "display or reset SWD transfer statistics.",
+		.usage = "['reset']",
+	},
 #if BUILD_CMSIS_DAP_USB
 	{
 		.name = "usb",
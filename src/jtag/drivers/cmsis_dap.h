@@ -15,8 +15,9 @@ struct pending_transfer_result {
 };
 
 /* Up to MIN(packet_count, MAX_PENDING_REQUESTS) requests may be issued
- * until the first response arrives */
-#define MAX_PENDING_REQUESTS 4
+ * until the first response arrives. Probes report their packet count,
+ * deep pipelines help to hide round trips on high latency USB links */
+#define MAX_PENDING_REQUESTS 16
 
 struct pending_request_block {
 	struct pending_transfer_result *transfers;
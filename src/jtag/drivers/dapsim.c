@@ -0,0 +1,873 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Simulated DAP adapter.
+ *
+ * Implements the DAP operations of a "dapdirect" adapter against an
+ * in-process model of a small Cortex-M3 system:
+ * - a SW-DP with power-up handshake and sticky error reporting;
+ * - one AHB-AP with TAR auto-increment (wrapping at 4 kB), packed and
+ *   sub-word transfers and the banked data registers;
+ * - the SCS debug registers needed to halt, single step, reset and
+ *   transfer core registers, plus RAM-like FPB and DWT registers;
+ * - RAM and flash regions, the flash being programmed through a
+ *   controller compatible with the STM32F1 one so that the stm32f1x
+ *   flash driver can erase and write it.
+ *
+ * No instruction is ever executed: a resumed core stays running, with
+ * registers and memory untouched, until it is halted again, and a single
+ * step only advances the PC. Target algorithms therefore can't run; do not
+ * give the target a work area, flash drivers then use host driven writes.
+ *
+ * Each queue run and each transfer can be given a fixed latency, modelling
+ * the round trip and the wire time of a real adapter, which makes the
+ * driver usable for repeatable throughput and latency measurements of
+ * the memory, register and flash paths without any hardware.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <jtag/interface.h>
+#include <jtag/jtag.h>
+#include <target/arm_adi_v5.h>
+#include <target/cortex_m.h>
+
+#define DAPSIM_DPIDR			0x1BA01477	/* ARM SW-DP, DPv1, as on STM32F1 */
+#define DAPSIM_AP_IDR			0x24770011	/* ARM AHB3-AP */
+#define DAPSIM_CPUID			0x412FC231	/* Cortex-M3 r2p1 */
+#define DAPSIM_TAR_BLOCK		4096
+
+#define DAPSIM_MAX_REGIONS		8
+#define DAPSIM_DEFAULT_FLASH	0x08000000
+#define DAPSIM_DEFAULT_RAM		0x20000000
+
+/* private peripheral bus, modelled as plain registers up to the SCS */
+#define DAPSIM_PPB_BASE			0xE0000000
+#define DAPSIM_PPB_END			0xE0100000
+#define DAPSIM_PPB_SIZE			0x10000
+
+/* device identification, as read by the stm32f1x flash driver */
+#define DAPSIM_DBGMCU_IDCODE	0xE0042000
+#define DAPSIM_DEVICE_ID		0x20036410	/* STM32F1 medium density */
+#define DAPSIM_FLASH_SIZE_REG	0x1FFFF7E0
+
+/* STM32F1 compatible flash controller */
+#define DAPSIM_FLASH_REGS		0x40022000
+#define DAPSIM_FLASH_REGS_SIZE	0x400
+#define DAPSIM_FLASH_PAGE		1024
+
+#define FLASH_KEYR				0x04
+#define FLASH_SR				0x0C
+#define FLASH_CR				0x10
+#define FLASH_AR				0x14
+#define FLASH_OBR				0x1C
+#define FLASH_WRPR				0x20
+
+#define FLASH_SR_PGERR			BIT(2)
+#define FLASH_SR_WRPRTERR		BIT(4)
+#define FLASH_SR_EOP			BIT(5)
+
+#define FLASH_CR_PG				BIT(0)
+#define FLASH_CR_PER			BIT(1)
+#define FLASH_CR_MER			BIT(2)
+#define FLASH_CR_STRT			BIT(6)
+#define FLASH_CR_LOCK			BIT(7)
+#define FLASH_CR_MASK			0x00001677
+
+#define FLASH_KEY1				0x45670123
+#define FLASH_KEY2				0xCDEF89AB
+
+/* ARMv7-M DCRSR register selectors */
+#define REGSEL_SP				13
+#define REGSEL_PC				15
+#define REGSEL_XPSR				16
+#define REGSEL_MSP				17
+#define REGSEL_PSP				18
+#define REGSEL_CONTROL			20	/* CONTROL, FAULTMASK, BASEPRI, PRIMASK */
+#define REGSEL_COUNT			128
+
+struct dapsim_region {
+	uint32_t base;
+	uint32_t size;
+	bool flash;
+	uint8_t *data;
+};
+
+static struct dapsim_region dapsim_regions[DAPSIM_MAX_REGIONS];
+static unsigned int dapsim_num_regions;
+
+static struct {
+	/* debug port */
+	uint32_t ctrl_stat;
+	uint32_t rdbuff;
+	bool fault;
+
+	/* memory access port */
+	uint32_t csw;
+	uint32_t tar;
+
+	/* core */
+	uint32_t ppb[DAPSIM_PPB_SIZE / 4];
+	uint32_t regs[REGSEL_COUNT];
+	uint32_t dhcsr;
+	bool halted;
+	bool reset_sticky;
+
+	/* flash controller */
+	uint32_t flash_sr;
+	uint32_t flash_cr;
+	uint32_t flash_ar;
+	bool flash_key1;
+} dapsim;
+
+static unsigned int dapsim_run_latency_us;
+static unsigned int dapsim_transfer_latency_ns;
+static unsigned int dapsim_queued;
+
+static struct {
+	uint64_t runs;
+	uint64_t dp_transfers;
+	uint64_t ap_transfers;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t faults;
+	uint64_t delay_us;
+} dapsim_stats;
+
+static uint32_t *dapsim_ppb_reg(uint32_t address)
+{
+	return &dapsim.ppb[(address - DAPSIM_PPB_BASE) / 4];
+}
+
+static struct dapsim_region *dapsim_find_region(uint32_t address, unsigned int size)
+{
+	for (unsigned int i = 0; i < dapsim_num_regions; i++) {
+		struct dapsim_region *region = &dapsim_regions[i];
+		if (address >= region->base && address - region->base + size <= region->size)
+			return region;
+	}
+	return NULL;
+}
+
+static struct dapsim_region *dapsim_boot_flash(void)
+{
+	for (unsigned int i = 0; i < dapsim_num_regions; i++)
+		if (dapsim_regions[i].flash)
+			return &dapsim_regions[i];
+	return NULL;
+}
+
+static uint32_t dapsim_region_read(struct dapsim_region *region, uint32_t address, unsigned int size)
+{
+	const uint8_t *data = region->data + (address - region->base);
+	uint32_t value = 0;
+
+	for (unsigned int i = 0; i < size; i++)
+		value |= (uint32_t)data[i] << (8 * i);
+	return value;
+}
+
+static void dapsim_region_write(struct dapsim_region *region, uint32_t address, unsigned int size,
+		uint32_t value)
+{
+	uint8_t *data = region->data + (address - region->base);
+
+	for (unsigned int i = 0; i < size; i++)
+		data[i] = value >> (8 * i);
+}
+
+static void dapsim_reset_core(void)
+{
+	struct dapsim_region *boot = dapsim_boot_flash();
+
+	memset(dapsim.regs, 0, sizeof(dapsim.regs));
+	dapsim.regs[14] = 0xFFFFFFFF;
+	dapsim.regs[REGSEL_XPSR] = 0x01000000;
+	if (boot && boot->size >= 8) {
+		dapsim.regs[REGSEL_MSP] = dapsim_region_read(boot, boot->base, 4) & ~3;
+		dapsim.regs[REGSEL_PC] = dapsim_region_read(boot, boot->base + 4, 4) & ~1;
+	}
+
+	dapsim.flash_sr = 0;
+	dapsim.flash_cr = FLASH_CR_LOCK;
+	dapsim.flash_ar = 0;
+	dapsim.flash_key1 = false;
+
+	/* the debug logic survives the reset, the vector catch takes effect */
+	dapsim.reset_sticky = true;
+	dapsim.halted = (dapsim.dhcsr & C_DEBUGEN) && (*dapsim_ppb_reg(DCB_DEMCR) & VC_CORERESET);
+	if (dapsim.halted)
+		*dapsim_ppb_reg(NVIC_DFSR) |= DFSR_VCATCH;
+}
+
+static unsigned int dapsim_regsel(uint32_t dcrsr)
+{
+	unsigned int regsel = dcrsr & (REGSEL_COUNT - 1);
+
+	/* SP is the banked stack pointer selected by CONTROL.SPSEL */
+	if (regsel == REGSEL_SP)
+		return (dapsim.regs[REGSEL_CONTROL] & BIT(25)) ? REGSEL_PSP : REGSEL_MSP;
+	return regsel;
+}
+
+static uint32_t dapsim_ppb_read(uint32_t address)
+{
+	uint32_t value;
+
+	if (address >= DAPSIM_PPB_BASE + DAPSIM_PPB_SIZE)
+		return address == DAPSIM_DBGMCU_IDCODE ? DAPSIM_DEVICE_ID : 0;
+
+	switch (address) {
+	case DCB_DHCSR:
+		value = dapsim.dhcsr | S_REGRDY;
+		value |= dapsim.halted ? S_HALT : S_RETIRE_ST;
+		if (dapsim.reset_sticky)
+			value |= S_RESET_ST;
+		dapsim.reset_sticky = false;
+		return value;
+	case NVIC_AIRCR:
+		return 0xFA050000 | (*dapsim_ppb_reg(address) & 0x8700);	/* VECTKEYSTAT */
+	default:
+		return *dapsim_ppb_reg(address);
+	}
+}
+
+static void dapsim_ppb_write(uint32_t address, uint32_t value)
+{
+	uint32_t *reg;
+
+	if (address >= DAPSIM_PPB_BASE + DAPSIM_PPB_SIZE)
+		return;
+
+	reg = dapsim_ppb_reg(address);
+	switch (address) {
+	case DCB_DHCSR:
+		if ((value & 0xFFFF0000) != DBGKEY)
+			break;
+		dapsim.dhcsr = value & (C_DEBUGEN | C_HALT | C_STEP | C_MASKINTS);
+		if (!(value & C_DEBUGEN)) {
+			dapsim.halted = false;
+		} else if (value & C_HALT) {
+			if (!dapsim.halted)
+				*dapsim_ppb_reg(NVIC_DFSR) |= DFSR_HALTED;
+			dapsim.halted = true;
+		} else if (dapsim.halted && (value & C_STEP)) {
+			/* pretend a 16-bit instruction was executed */
+			dapsim.regs[REGSEL_PC] += 2;
+			*dapsim_ppb_reg(NVIC_DFSR) |= DFSR_HALTED;
+		} else {
+			dapsim.halted = false;
+		}
+		break;
+	case DCB_DCRSR:
+		if (value & DCRSR_WNR)
+			dapsim.regs[dapsim_regsel(value)] = *dapsim_ppb_reg(DCB_DCRDR);
+		else
+			*dapsim_ppb_reg(DCB_DCRDR) = dapsim.regs[dapsim_regsel(value)];
+		break;
+	case NVIC_AIRCR:
+		if ((value & 0xFFFF0000) != AIRCR_VECTKEY)
+			break;
+		*reg = value & 0x8700;
+		if (value & (AIRCR_SYSRESETREQ | AIRCR_VECTRESET))
+			dapsim_reset_core();
+		break;
+	case NVIC_DFSR:
+		*reg &= ~value;
+		break;
+	case CPUID:
+		break;
+	case DWT_CTRL:
+		*reg = (*reg & 0xF0000000) | (value & 0x0FFFFFFF);
+		break;
+	case FP_CTRL:
+		if (value & BIT(1))
+			*reg = (*reg & ~1) | (value & 1);
+		break;
+	default:
+		*reg = value;
+		break;
+	}
+}
+
+static void dapsim_flash_erase(uint32_t address, uint32_t size)
+{
+	for (unsigned int i = 0; i < dapsim_num_regions; i++) {
+		struct dapsim_region *region = &dapsim_regions[i];
+		if (!region->flash)
+			continue;
+		uint32_t start = MAX(address, region->base);
+		uint32_t end = MIN(address + size, region->base + region->size);
+		if (start < end)
+			memset(region->data + (start - region->base), 0xFF, end - start);
+	}
+}
+
+static uint32_t dapsim_flash_reg_read(uint32_t offset)
+{
+	switch (offset) {
+	case FLASH_SR:
+		return dapsim.flash_sr;
+	case FLASH_CR:
+		return dapsim.flash_cr;
+	case FLASH_AR:
+		return dapsim.flash_ar;
+	case FLASH_OBR:
+		return 0x03FFFFFC;	/* no read protection, default user bytes */
+	case FLASH_WRPR:
+		return 0xFFFFFFFF;	/* no write protection */
+	default:
+		return 0;
+	}
+}
+
+static void dapsim_flash_reg_write(uint32_t offset, uint32_t value)
+{
+	switch (offset) {
+	case FLASH_KEYR:
+		if (!dapsim.flash_key1 && value == FLASH_KEY1) {
+			dapsim.flash_key1 = true;
+			return;
+		}
+		if (dapsim.flash_key1 && value == FLASH_KEY2)
+			dapsim.flash_cr &= ~FLASH_CR_LOCK;
+		else
+			dapsim.flash_cr |= FLASH_CR_LOCK;
+		dapsim.flash_key1 = false;
+		break;
+	case FLASH_SR:
+		dapsim.flash_sr &= ~(value & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR | FLASH_SR_EOP));
+		break;
+	case FLASH_CR:
+		if (dapsim.flash_cr & FLASH_CR_LOCK) {
+			dapsim.flash_cr |= value & FLASH_CR_LOCK;
+			break;
+		}
+		dapsim.flash_cr = value & FLASH_CR_MASK;
+		if (!(value & FLASH_CR_STRT))
+			break;
+		/* erase completes at once, the controller is never busy */
+		if (value & FLASH_CR_MER)
+			dapsim_flash_erase(0, 0xFFFFFFFF);
+		else if (value & FLASH_CR_PER)
+			dapsim_flash_erase(dapsim.flash_ar & ~(DAPSIM_FLASH_PAGE - 1), DAPSIM_FLASH_PAGE);
+		dapsim.flash_cr &= ~FLASH_CR_STRT;
+		dapsim.flash_sr |= FLASH_SR_EOP;
+		break;
+	case FLASH_AR:
+		dapsim.flash_ar = value;
+		break;
+	default:
+		break;
+	}
+}
+
+static void dapsim_flash_program(struct dapsim_region *region, uint32_t address, unsigned int size,
+		uint32_t value)
+{
+	if (!(dapsim.flash_cr & FLASH_CR_PG) || (dapsim.flash_cr & FLASH_CR_LOCK))
+		return;
+
+	/* halfword programming of erased locations only */
+	if (size != 2 || (dapsim_region_read(region, address, 2) != 0xFFFF && value)) {
+		dapsim.flash_sr |= FLASH_SR_PGERR;
+		return;
+	}
+	dapsim_region_write(region, address, 2, value);
+	dapsim.flash_sr |= FLASH_SR_EOP;
+}
+
+/* Word sized register, accessed by bytes or halfwords at some offset */
+static uint32_t dapsim_sub_word(uint32_t word, uint32_t address, unsigned int size)
+{
+	word >>= 8 * (address & 3);
+	return size == 4 ? word : word & ((1u << (8 * size)) - 1);
+}
+
+static uint32_t dapsim_merge_word(uint32_t word, uint32_t address, unsigned int size, uint32_t value)
+{
+	if (size == 4)
+		return value;
+	uint32_t mask = ((1u << (8 * size)) - 1) << (8 * (address & 3));
+	return (word & ~mask) | ((value << (8 * (address & 3))) & mask);
+}
+
+/* One naturally aligned bus access of 1, 2 or 4 bytes, false on a bus fault */
+static bool dapsim_bus_read(uint32_t address, unsigned int size, uint32_t *value)
+{
+	struct dapsim_region *region = dapsim_find_region(address, size);
+	uint32_t word_address = address & ~3;
+
+	if (region) {
+		*value = dapsim_region_read(region, address, size);
+	} else if (address >= DAPSIM_PPB_BASE && address < DAPSIM_PPB_END) {
+		*value = dapsim_sub_word(dapsim_ppb_read(word_address), address, size);
+	} else if (address - DAPSIM_FLASH_REGS < DAPSIM_FLASH_REGS_SIZE) {
+		*value = dapsim_sub_word(dapsim_flash_reg_read(word_address - DAPSIM_FLASH_REGS),
+				address, size);
+	} else if (word_address == DAPSIM_FLASH_SIZE_REG) {
+		struct dapsim_region *boot = dapsim_boot_flash();
+		uint32_t size_kb = boot ? boot->size / 1024 : 0;
+		*value = dapsim_sub_word(0xFFFF0000 | size_kb, address, size);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static bool dapsim_bus_write(uint32_t address, unsigned int size, uint32_t value)
+{
+	struct dapsim_region *region = dapsim_find_region(address, size);
+	uint32_t word_address = address & ~3;
+
+	if (region) {
+		if (region->flash)
+			dapsim_flash_program(region, address, size, value);
+		else
+			dapsim_region_write(region, address, size, value);
+	} else if (address >= DAPSIM_PPB_BASE && address < DAPSIM_PPB_END) {
+		uint32_t word = address < DAPSIM_PPB_BASE + DAPSIM_PPB_SIZE ?
+				*dapsim_ppb_reg(word_address) : 0;
+		dapsim_ppb_write(word_address, dapsim_merge_word(word, address, size, value));
+	} else if (address - DAPSIM_FLASH_REGS < DAPSIM_FLASH_REGS_SIZE) {
+		uint32_t offset = word_address - DAPSIM_FLASH_REGS;
+		uint32_t word = dapsim_flash_reg_read(offset);
+		dapsim_flash_reg_write(offset, dapsim_merge_word(word, address, size, value));
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static uint32_t dapsim_tar_increment(uint32_t tar, unsigned int size)
+{
+	return (tar & ~(DAPSIM_TAR_BLOCK - 1)) | ((tar + size) & (DAPSIM_TAR_BLOCK - 1));
+}
+
+static void dapsim_fault(void)
+{
+	dapsim.ctrl_stat |= SSTICKYERR;
+	dapsim.fault = true;
+	dapsim_stats.faults++;
+}
+
+/* DRW access, a packed transfer makes one bus access per byte lane unit */
+static void dapsim_drw(bool write, uint32_t *data)
+{
+	unsigned int size = 1u << (dapsim.csw & CSW_SIZE_MASK);
+	uint32_t addrinc = dapsim.csw & CSW_ADDRINC_MASK;
+	unsigned int count = (addrinc == CSW_ADDRINC_PACKED) ? 4 / size : 1;
+	uint32_t value = write ? *data : 0;
+
+	for (unsigned int i = 0; i < count; i++) {
+		uint32_t address = dapsim.tar & ~(size - 1);
+		unsigned int shift = 8 * (address & 3);
+		uint32_t unit;
+
+		if (write) {
+			if (!dapsim_bus_write(address, size, dapsim_sub_word(value, address, size))) {
+				dapsim_fault();
+				return;
+			}
+			dapsim_stats.bytes_written += size;
+		} else {
+			if (!dapsim_bus_read(address, size, &unit)) {
+				dapsim_fault();
+				return;
+			}
+			value |= unit << shift;
+			dapsim_stats.bytes_read += size;
+		}
+
+		if (addrinc != CSW_ADDRINC_OFF)
+			dapsim.tar = dapsim_tar_increment(dapsim.tar, size);
+	}
+
+	if (!write)
+		*data = value;
+}
+
+static uint32_t dapsim_ap_read(unsigned int reg)
+{
+	uint32_t value = 0;
+
+	switch (reg) {
+	case ADIV5_MEM_AP_REG_CSW:
+		return dapsim.csw;
+	case ADIV5_MEM_AP_REG_TAR:
+		return dapsim.tar;
+	case ADIV5_MEM_AP_REG_DRW:
+		dapsim_drw(false, &value);
+		return value;
+	case ADIV5_MEM_AP_REG_BD0:
+	case ADIV5_MEM_AP_REG_BD1:
+	case ADIV5_MEM_AP_REG_BD2:
+	case ADIV5_MEM_AP_REG_BD3:
+		if (!dapsim_bus_read((dapsim.tar & ~0xF) + (reg & 0xC), 4, &value))
+			dapsim_fault();
+		else
+			dapsim_stats.bytes_read += 4;
+		return value;
+	case ADIV5_MEM_AP_REG_BASE:
+		return 0xFFFFFFFF;	/* legacy format, no debug entry */
+	case ADIV5_AP_REG_IDR:
+		return DAPSIM_AP_IDR;
+	default:
+		return 0;
+	}
+}
+
+static void dapsim_ap_write(unsigned int reg, uint32_t value)
+{
+	switch (reg) {
+	case ADIV5_MEM_AP_REG_CSW:
+		/* transfers larger than a word are not implemented */
+		if ((value & CSW_SIZE_MASK) > CSW_32BIT)
+			value = (value & ~CSW_SIZE_MASK) | CSW_32BIT;
+		if ((value & CSW_ADDRINC_MASK) == CSW_ADDRINC_MASK)
+			value &= ~CSW_ADDRINC_MASK;
+		dapsim.csw = (value & ~CSW_TRIN_PROG) | CSW_DEVICE_EN;
+		break;
+	case ADIV5_MEM_AP_REG_TAR:
+		dapsim.tar = value;
+		break;
+	case ADIV5_MEM_AP_REG_DRW:
+		dapsim_drw(true, &value);
+		break;
+	case ADIV5_MEM_AP_REG_BD0:
+	case ADIV5_MEM_AP_REG_BD1:
+	case ADIV5_MEM_AP_REG_BD2:
+	case ADIV5_MEM_AP_REG_BD3:
+		if (!dapsim_bus_write((dapsim.tar & ~0xF) + (reg & 0xC), 4, value))
+			dapsim_fault();
+		else
+			dapsim_stats.bytes_written += 4;
+		break;
+	default:
+		break;
+	}
+}
+
+static int dapsim_dap_connect(struct adiv5_dap *dap)
+{
+	return dap_dp_init(dap);
+}
+
+static int dapsim_dap_send_sequence(struct adiv5_dap *dap, enum swd_special_seq seq)
+{
+	return ERROR_OK;
+}
+
+static int dapsim_dap_queue_dp_read(struct adiv5_dap *dap, unsigned int reg, uint32_t *data)
+{
+	uint32_t value;
+
+	switch (reg) {
+	case DP_DPIDR:
+		value = DAPSIM_DPIDR;
+		break;
+	case DP_CTRL_STAT:
+		value = dapsim.ctrl_stat;
+		break;
+	case DP_RDBUFF:
+		value = dapsim.rdbuff;
+		break;
+	default:
+		value = 0;
+		break;
+	}
+
+	if (data)
+		*data = value;
+	dapsim_stats.dp_transfers++;
+	dapsim_queued++;
+	return ERROR_OK;
+}
+
+static int dapsim_dap_queue_dp_write(struct adiv5_dap *dap, unsigned int reg, uint32_t data)
+{
+	switch (reg) {
+	case DP_ABORT:
+		if (data & STKERRCLR)
+			dapsim.ctrl_stat &= ~SSTICKYERR;
+		break;
+	case DP_CTRL_STAT:
+		/* sticky flags are write-one-to-clear, as with a JTAG-DP */
+		dapsim.ctrl_stat &= ~(data & SSTICKYERR);
+		dapsim.ctrl_stat &= ~(CDBGPWRUPREQ | CDBGPWRUPACK | CSYSPWRUPREQ | CSYSPWRUPACK);
+		if (data & CDBGPWRUPREQ)
+			dapsim.ctrl_stat |= CDBGPWRUPREQ | CDBGPWRUPACK;
+		if (data & CSYSPWRUPREQ)
+			dapsim.ctrl_stat |= CSYSPWRUPREQ | CSYSPWRUPACK;
+		break;
+	default:
+		break;
+	}
+
+	dapsim_stats.dp_transfers++;
+	dapsim_queued++;
+	return ERROR_OK;
+}
+
+static int dapsim_dap_queue_ap_read(struct adiv5_ap *ap, unsigned int reg, uint32_t *data)
+{
+	uint32_t value = 0;
+
+	/* only AP #0 exists; a pending sticky error makes the access fail */
+	if (ap->ap_num == 0 && !(dapsim.ctrl_stat & SSTICKYERR))
+		value = dapsim_ap_read(reg);
+
+	dapsim.rdbuff = value;
+	if (data)
+		*data = value;
+	dapsim_stats.ap_transfers++;
+	dapsim_queued++;
+	return ERROR_OK;
+}
+
+static int dapsim_dap_queue_ap_write(struct adiv5_ap *ap, unsigned int reg, uint32_t data)
+{
+	if (ap->ap_num == 0 && !(dapsim.ctrl_stat & SSTICKYERR))
+		dapsim_ap_write(reg, data);
+
+	dapsim_stats.ap_transfers++;
+	dapsim_queued++;
+	return ERROR_OK;
+}
+
+static int dapsim_dap_queue_ap_abort(struct adiv5_dap *dap, uint8_t *ack)
+{
+	dapsim.ctrl_stat &= ~SSTICKYERR;
+	dapsim.fault = false;
+	return ERROR_OK;
+}
+
+static int dapsim_dap_run(struct adiv5_dap *dap)
+{
+	if (!dapsim_queued)
+		return ERROR_OK;
+
+	uint64_t delay_us = dapsim_run_latency_us
+		+ ((uint64_t)dapsim_queued * dapsim_transfer_latency_ns) / 1000;
+	dapsim_queued = 0;
+	dapsim_stats.runs++;
+	if (delay_us) {
+		dapsim_stats.delay_us += delay_us;
+		jtag_sleep(delay_us);
+	}
+
+	if (dapsim.fault) {
+		/* report the FAULT and clear it, as the SWD layer does */
+		dapsim.fault = false;
+		dapsim.ctrl_stat &= ~SSTICKYERR;
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static int dapsim_add_region(uint32_t base, uint32_t size, bool flash)
+{
+	if (dapsim_num_regions == DAPSIM_MAX_REGIONS) {
+		LOG_ERROR("too many simulated memory regions");
+		return ERROR_FAIL;
+	}
+
+	uint8_t *data = malloc(size);
+	if (!data) {
+		LOG_ERROR("out of memory");
+		return ERROR_FAIL;
+	}
+	memset(data, flash ? 0xFF : 0, size);
+
+	struct dapsim_region *region = &dapsim_regions[dapsim_num_regions++];
+	region->base = base;
+	region->size = size;
+	region->flash = flash;
+	region->data = data;
+	return ERROR_OK;
+}
+
+static int dapsim_init(void)
+{
+	int retval;
+
+	if (!dapsim_num_regions) {
+		retval = dapsim_add_region(DAPSIM_DEFAULT_FLASH, 128 * 1024, true);
+		if (retval == ERROR_OK)
+			retval = dapsim_add_region(DAPSIM_DEFAULT_RAM, 20 * 1024, false);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	memset(&dapsim.ppb, 0, sizeof(dapsim.ppb));
+	*dapsim_ppb_reg(CPUID) = DAPSIM_CPUID;
+	*dapsim_ppb_reg(DWT_CTRL) = 4u << 28;	/* 4 comparators */
+	*dapsim_ppb_reg(FP_CTRL) = 0x260;		/* 6 code, 2 literal comparators */
+	dapsim.ctrl_stat = 0;
+	dapsim.csw = CSW_DEVICE_EN;
+	dapsim.dhcsr = 0;
+	dapsim_reset_core();
+
+	LOG_INFO("simulated Cortex-M3 with %u memory regions", dapsim_num_regions);
+	return ERROR_OK;
+}
+
+static int dapsim_quit(void)
+{
+	for (unsigned int i = 0; i < dapsim_num_regions; i++)
+		free(dapsim_regions[i].data);
+	dapsim_num_regions = 0;
+	return ERROR_OK;
+}
+
+static int dapsim_reset(int trst, int srst)
+{
+	if (srst)
+		dapsim_reset_core();
+	return ERROR_OK;
+}
+
+static int dapsim_speed(int speed)
+{
+	return ERROR_OK;
+}
+
+static int dapsim_khz(int khz, int *jtag_speed)
+{
+	*jtag_speed = khz;
+	return ERROR_OK;
+}
+
+static int dapsim_speed_div(int speed, int *khz)
+{
+	*khz = speed;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dapsim_handle_memory_command)
+{
+	uint32_t base, size;
+	bool flash;
+
+	if (CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!strcmp(CMD_ARGV[0], "flash"))
+		flash = true;
+	else if (!strcmp(CMD_ARGV[0], "ram"))
+		flash = false;
+	else
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], base);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], size);
+	if (!size || (size & 3) || (base & 3) || base + size - 1 < base) {
+		command_print(CMD, "region must be word aligned and non-empty");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	return dapsim_add_region(base, size, flash);
+}
+
+COMMAND_HANDLER(dapsim_handle_latency_command)
+{
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC >= 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], dapsim_run_latency_us);
+	if (CMD_ARGC == 2)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], dapsim_transfer_latency_ns);
+
+	command_print(CMD, "run latency %u us, transfer latency %u ns",
+		dapsim_run_latency_us, dapsim_transfer_latency_ns);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dapsim_handle_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&dapsim_stats, 0, sizeof(dapsim_stats));
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "runs:          %" PRIu64, dapsim_stats.runs);
+	command_print(CMD, "DP transfers:  %" PRIu64, dapsim_stats.dp_transfers);
+	command_print(CMD, "AP transfers:  %" PRIu64, dapsim_stats.ap_transfers);
+	command_print(CMD, "bytes read:    %" PRIu64, dapsim_stats.bytes_read);
+	command_print(CMD, "bytes written: %" PRIu64, dapsim_stats.bytes_written);
+	command_print(CMD, "bus faults:    %" PRIu64, dapsim_stats.faults);
+	command_print(CMD, "latency:       %" PRIu64 " us", dapsim_stats.delay_us);
+	return ERROR_OK;
+}
+
+static const struct command_registration dapsim_subcommand_handlers[] = {
+	{
+		.name = "memory",
+		.handler = dapsim_handle_memory_command,
+		.mode = COMMAND_CONFIG,
+		.help = "add a simulated RAM or flash region",
+		.usage = "('ram'|'flash') address size",
+	},
+	{
+		.name = "latency",
+		.handler = dapsim_handle_latency_command,
+		.mode = COMMAND_ANY,
+		.help = "set the latency added to each queue run and each transfer",
+		.usage = "[run_us [transfer_ns]]",
+	},
+	{
+		.name = "stats",
+		.handler = dapsim_handle_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show or reset the transfer statistics",
+		.usage = "['reset']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration dapsim_command_handlers[] = {
+	{
+		.name = "dapsim",
+		.mode = COMMAND_ANY,
+		.help = "simulated DAP adapter command group",
+		.usage = "",
+		.chain = dapsim_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct dap_ops dapsim_dap_ops = {
+	.connect = dapsim_dap_connect,
+	.send_sequence = dapsim_dap_send_sequence,
+	.queue_dp_read = dapsim_dap_queue_dp_read,
+	.queue_dp_write = dapsim_dap_queue_dp_write,
+	.queue_ap_read = dapsim_dap_queue_ap_read,
+	.queue_ap_write = dapsim_dap_queue_ap_write,
+	.queue_ap_abort = dapsim_dap_queue_ap_abort,
+	.run = dapsim_dap_run,
+};
+
+static const char *const dapsim_transports[] = { "dapdirect_swd", NULL };
+
+struct adapter_driver dapsim_adapter_driver = {
+	.name = "dapsim",
+	.transports = dapsim_transports,
+	.commands = dapsim_command_handlers,
+
+	.init = dapsim_init,
+	.quit = dapsim_quit,
+	.reset = dapsim_reset,
+	.speed = dapsim_speed,
+	.khz = dapsim_khz,
+	.speed_div = dapsim_speed_div,
+
+	.dap_swd_ops = &dapsim_dap_ops,
+};
@@ -52,6 +52,31 @@
 #define SIO_RESET_PURGE_RX 1
 #define SIO_RESET_PURGE_TX 2
 
+/* Number of command buffers. While one is filled, the others can be in
+ * flight on the USB bus. */
+#define MPSSE_BATCHES 4
+
+/* Progress of the write or the read data of a batch */
+struct transfer_result {
+	struct mpsse_batch *batch;
+	bool submitted;
+	bool done;
+	unsigned int transferred;
+};
+
+/* One command buffer, with the read data it expects back */
+struct mpsse_batch {
+	struct mpsse_ctx *ctx;
+	uint8_t *write_buffer;
+	unsigned int write_count;
+	uint8_t *read_buffer;
+	unsigned int read_count;
+	struct bit_copy_queue read_queue;
+	struct libusb_transfer *write_transfer;
+	struct transfer_result write_result;
+	struct transfer_result read_result;
+};
+
 struct mpsse_ctx {
 	struct libusb_context *usb_ctx;
 	struct libusb_device_handle *usb_dev;
@@ -63,18 +88,25 @@ struct mpsse_ctx {
 	uint16_t index;
 	uint8_t interface;
 	enum ftdi_chip_type type;
-	uint8_t *write_buffer;
 	unsigned write_size;
-	unsigned write_count;
-	uint8_t *read_buffer;
 	unsigned read_size;
-	unsigned read_count;
 	uint8_t *read_chunk;
 	unsigned read_chunk_size;
-	struct bit_copy_queue read_queue;
+	/* a single read transfer collects the data of all batches in flight,
+	 * a chunk may hold the end of one batch and the start of the next */
+	struct libusb_transfer *read_transfer;
+	bool read_submitted;
+	/* batches in flight are first_batch onwards, in submission order,
+	 * followed by the one being filled */
+	struct mpsse_batch batches[MPSSE_BATCHES];
+	unsigned int first_batch;
+	unsigned int batches_in_flight;
+	struct mpsse_batch *fill;
 	int retval;
 };
 
+static int mpsse_queue(struct mpsse_ctx *ctx);
+
 /* Returns true if the string descriptor indexed by str_index in device matches string */
 static bool string_descriptor_equal(struct libusb_device_handle *device, uint8_t str_index,
 	const char *string)
@@ -333,20 +365,34 @@ struct mpsse_ctx *mpsse_open(const uint16_t vids[], const uint16_t pids[], const
 	if (!ctx)
 		return NULL;
 
-	bit_copy_queue_init(&ctx->read_queue);
 	ctx->read_chunk_size = 16384;
 	ctx->read_size = 16384;
 	ctx->write_size = 16384;
-	ctx->read_chunk = malloc(ctx->read_chunk_size);
-	ctx->read_buffer = malloc(ctx->read_size);
+	for (unsigned int i = 0; i < MPSSE_BATCHES; i++) {
+		struct mpsse_batch *batch = &ctx->batches[i];
+
+		batch->ctx = ctx;
+		batch->write_result.batch = batch;
+		batch->read_result.batch = batch;
+		bit_copy_queue_init(&batch->read_queue);
+		batch->read_buffer = malloc(ctx->read_size);
 
-	/* Use calloc to make valgrind happy: buffer_write() sets payload
-	 * on bit basis, so some bits can be left uninitialized in write_buffer.
-	 * Although this is perfectly ok with MPSSE, valgrind reports
-	 * Syscall param ioctl(USBDEVFS_SUBMITURB).buffer points to uninitialised byte(s) */
-	ctx->write_buffer = calloc(1, ctx->write_size);
+		/* Use calloc to make valgrind happy: buffer_write() sets payload
+		 * on bit basis, so some bits can be left uninitialized in write_buffer.
+		 * Although this is perfectly ok with MPSSE, valgrind reports
+		 * Syscall param ioctl(USBDEVFS_SUBMITURB).buffer points to uninitialised byte(s) */
+		batch->write_buffer = calloc(1, ctx->write_size);
 
-	if (!ctx->read_chunk || !ctx->read_buffer || !ctx->write_buffer)
+		batch->write_transfer = libusb_alloc_transfer(0);
+
+		if (!batch->read_buffer || !batch->write_buffer || !batch->write_transfer)
+			goto error;
+	}
+	ctx->fill = &ctx->batches[0];
+
+	ctx->read_chunk = malloc(ctx->read_chunk_size);
+	ctx->read_transfer = libusb_alloc_transfer(0);
+	if (!ctx->read_chunk || !ctx->read_transfer)
 		goto error;
 
 	ctx->interface = channel;
@@ -405,10 +451,18 @@ void mpsse_close(struct mpsse_ctx *ctx)
 		libusb_close(ctx->usb_dev);
 	if (ctx->usb_ctx)
 		libusb_exit(ctx->usb_ctx);
-	bit_copy_discard(&ctx->read_queue);
 
-	free(ctx->write_buffer);
-	free(ctx->read_buffer);
+	for (unsigned int i = 0; i < MPSSE_BATCHES; i++) {
+		struct mpsse_batch *batch = &ctx->batches[i];
+
+		/* libusb_free_transfer() accepts NULL */
+		libusb_free_transfer(batch->write_transfer);
+		if (batch->ctx)
+			bit_copy_discard(&batch->read_queue);
+		free(batch->write_buffer);
+		free(batch->read_buffer);
+	}
+	libusb_free_transfer(ctx->read_transfer);
 	free(ctx->read_chunk);
 	free(ctx);
 }
@@ -422,10 +476,10 @@ void mpsse_purge(struct mpsse_ctx *ctx)
 {
 	int err;
 	LOG_DEBUG("-");
-	ctx->write_count = 0;
-	ctx->read_count = 0;
+	ctx->fill->write_count = 0;
+	ctx->fill->read_count = 0;
 	ctx->retval = ERROR_OK;
-	bit_copy_discard(&ctx->read_queue);
+	bit_copy_discard(&ctx->fill->read_queue);
 	err = libusb_control_transfer(ctx->usb_dev, FTDI_DEVICE_OUT_REQTYPE, SIO_RESET_REQUEST,
 			SIO_RESET_PURGE_RX, ctx->index, NULL, 0, ctx->usb_write_timeout);
 	if (err < 0) {
@@ -444,39 +498,45 @@ void mpsse_purge(struct mpsse_ctx *ctx)
 static unsigned buffer_write_space(struct mpsse_ctx *ctx)
 {
 	/* Reserve one byte for SEND_IMMEDIATE */
-	return ctx->write_size - ctx->write_count - 1;
+	return ctx->write_size - ctx->fill->write_count - 1;
 }
 
 static unsigned buffer_read_space(struct mpsse_ctx *ctx)
 {
-	return ctx->read_size - ctx->read_count;
+	return ctx->read_size - ctx->fill->read_count;
 }
 
 static void buffer_write_byte(struct mpsse_ctx *ctx, uint8_t data)
 {
+	struct mpsse_batch *batch = ctx->fill;
+
 	LOG_DEBUG_IO("%02x", data);
-	assert(ctx->write_count < ctx->write_size);
-	ctx->write_buffer[ctx->write_count++] = data;
+	assert(batch->write_count < ctx->write_size);
+	batch->write_buffer[batch->write_count++] = data;
 }
 
 static unsigned buffer_write(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_offset,
 	unsigned bit_count)
 {
+	struct mpsse_batch *batch = ctx->fill;
+
 	LOG_DEBUG_IO("%d bits", bit_count);
-	assert(ctx->write_count + DIV_ROUND_UP(bit_count, 8) <= ctx->write_size);
-	bit_copy(ctx->write_buffer + ctx->write_count, 0, out, out_offset, bit_count);
-	ctx->write_count += DIV_ROUND_UP(bit_count, 8);
+	assert(batch->write_count + DIV_ROUND_UP(bit_count, 8) <= ctx->write_size);
+	bit_copy(batch->write_buffer + batch->write_count, 0, out, out_offset, bit_count);
+	batch->write_count += DIV_ROUND_UP(bit_count, 8);
 	return bit_count;
 }
 
 static unsigned buffer_add_read(struct mpsse_ctx *ctx, uint8_t *in, unsigned in_offset,
 	unsigned bit_count, unsigned offset)
 {
+	struct mpsse_batch *batch = ctx->fill;
+
 	LOG_DEBUG_IO("%d bits, offset %d", bit_count, offset);
-	assert(ctx->read_count + DIV_ROUND_UP(bit_count, 8) <= ctx->read_size);
-	bit_copy_queued(&ctx->read_queue, in, in_offset, ctx->read_buffer + ctx->read_count, offset,
-		bit_count);
-	ctx->read_count += DIV_ROUND_UP(bit_count, 8);
+	assert(batch->read_count + DIV_ROUND_UP(bit_count, 8) <= ctx->read_size);
+	bit_copy_queued(&batch->read_queue, in, in_offset, batch->read_buffer + batch->read_count,
+		offset, bit_count);
+	batch->read_count += DIV_ROUND_UP(bit_count, 8);
 	return bit_count;
 }
 
@@ -513,7 +573,7 @@ void mpsse_clock_data(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_of
 		/* Guarantee buffer space enough for a minimum size transfer */
 		if (buffer_write_space(ctx) + (length < 8) < (out || (!out && !in) ? 4 : 3)
 				|| (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+			ctx->retval = mpsse_queue(ctx);
 
 		if (length < 8) {
 			/* Transfer remaining bits in bit mode */
@@ -587,7 +647,7 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 	while (length > 0) {
 		/* Guarantee buffer space enough for a minimum size transfer */
 		if (buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+			ctx->retval = mpsse_queue(ctx);
 
 		/* Byte transfer */
 		unsigned this_bits = length;
@@ -630,7 +690,7 @@ void mpsse_set_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t d
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_queue(ctx);
 
 	buffer_write_byte(ctx, 0x80);
 	buffer_write_byte(ctx, data);
@@ -647,7 +707,7 @@ void mpsse_set_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_queue(ctx);
 
 	buffer_write_byte(ctx, 0x82);
 	buffer_write_byte(ctx, data);
@@ -664,7 +724,7 @@ void mpsse_read_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t *data)
 	}
 
 	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_queue(ctx);
 
 	buffer_write_byte(ctx, 0x81);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -680,7 +740,7 @@ void mpsse_read_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t *data)
 	}
 
 	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_queue(ctx);
 
 	buffer_write_byte(ctx, 0x83);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -695,7 +755,7 @@ static void single_byte_boolean_helper(struct mpsse_ctx *ctx, bool var, uint8_t
 	}
 
 	if (buffer_write_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_queue(ctx);
 
 	buffer_write_byte(ctx, var ? val_if_true : val_if_false);
 }
@@ -716,7 +776,7 @@ void mpsse_set_divisor(struct mpsse_ctx *ctx, uint16_t divisor)
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = mpsse_queue(ctx);
 
 	buffer_write_byte(ctx, 0x86);
 	buffer_write_byte(ctx, divisor & 0xff);
@@ -776,127 +836,230 @@ int mpsse_set_frequency(struct mpsse_ctx *ctx, int frequency)
 	return frequency;
 }
 
-/* Context needed by the callbacks */
-struct transfer_result {
-	struct mpsse_ctx *ctx;
-	bool done;
-	unsigned transferred;
-};
+static struct mpsse_batch *batch_in_flight(struct mpsse_ctx *ctx, unsigned int n)
+{
+	return &ctx->batches[(ctx->first_batch + n) % MPSSE_BATCHES];
+}
+
+/* The oldest batch whose written commands still owe read data, if any */
+static struct mpsse_batch *batch_reading(struct mpsse_ctx *ctx)
+{
+	for (unsigned int i = 0; i < ctx->batches_in_flight; i++) {
+		struct mpsse_batch *batch = batch_in_flight(ctx, i);
+		if (!batch->read_result.done)
+			return batch->write_result.submitted ? batch : NULL;
+	}
+	return NULL;
+}
 
 static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 {
-	struct transfer_result *res = transfer->user_data;
-	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_ctx *ctx = transfer->user_data;
 
 	unsigned packet_size = ctx->max_packet_size;
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
 	/* Strip the two status bytes sent at the beginning of each USB packet
-	 * while copying the chunk buffer to the read buffer */
+	 * while copying the chunk buffer to the read buffers */
 	unsigned num_packets = DIV_ROUND_UP(transfer->actual_length, packet_size);
 	unsigned chunk_remains = transfer->actual_length;
 	for (unsigned i = 0; i < num_packets && chunk_remains > 2; i++) {
-		unsigned this_size = packet_size - 2;
-		if (this_size > chunk_remains - 2)
-			this_size = chunk_remains - 2;
-		if (this_size > ctx->read_count - res->transferred)
-			this_size = ctx->read_count - res->transferred;
-		memcpy(ctx->read_buffer + res->transferred,
-			ctx->read_chunk + packet_size * i + 2,
-			this_size);
-		res->transferred += this_size;
-		chunk_remains -= this_size + 2;
-		if (res->transferred == ctx->read_count) {
-			res->done = true;
-			break;
+		unsigned int packet_remains = MIN(packet_size, chunk_remains) - 2;
+		uint8_t *data = ctx->read_chunk + packet_size * i + 2;
+
+		chunk_remains -= packet_remains + 2;
+		while (packet_remains) {
+			struct mpsse_batch *batch = batch_reading(ctx);
+			if (!batch) {
+				LOG_DEBUG_IO("dropping %d unexpected bytes", packet_remains);
+				break;
+			}
+			struct transfer_result *res = &batch->read_result;
+			unsigned int this_size = MIN(packet_remains, batch->read_count - res->transferred);
+			memcpy(batch->read_buffer + res->transferred, data, this_size);
+			res->transferred += this_size;
+			data += this_size;
+			packet_remains -= this_size;
+			if (res->transferred == batch->read_count)
+				res->done = true;
 		}
 	}
 
-	LOG_DEBUG_IO("raw chunk %d, transferred %d of %d", transfer->actual_length, res->transferred,
-		ctx->read_count);
+	LOG_DEBUG_IO("raw chunk %d", transfer->actual_length);
 
-	if (!res->done)
-		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
-			res->done = true;
+	ctx->read_submitted = false;
+	if (transfer->status == LIBUSB_TRANSFER_CANCELLED || !batch_reading(ctx))
+		return;
+
+	if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS) {
+		/* the missing data is reported when the batch is retired */
+		for (struct mpsse_batch *batch = batch_reading(ctx); batch; batch = batch_reading(ctx))
+			batch->read_result.done = true;
+		return;
+	}
+	ctx->read_submitted = true;
 }
 
 static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
 {
 	struct transfer_result *res = transfer->user_data;
-	struct mpsse_ctx *ctx = res->ctx;
+	struct mpsse_batch *batch = res->batch;
 
 	res->transferred += transfer->actual_length;
 
-	LOG_DEBUG_IO("transferred %d of %d", res->transferred, ctx->write_count);
+	LOG_DEBUG_IO("transferred %d of %d", res->transferred, batch->write_count);
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
-	if (res->transferred == ctx->write_count)
+	if (res->transferred == batch->write_count || transfer->status == LIBUSB_TRANSFER_CANCELLED)
 		res->done = true;
 	else {
-		transfer->length = ctx->write_count - res->transferred;
-		transfer->buffer = ctx->write_buffer + res->transferred;
+		transfer->length = batch->write_count - res->transferred;
+		transfer->buffer = batch->write_buffer + res->transferred;
 		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
 			res->done = true;
 	}
 }
 
-int mpsse_flush(struct mpsse_ctx *ctx)
+/* Submit the transfers of the batches in flight as soon as they may go. The
+ * FTDI chip executes commands and returns read data in order, and a partial
+ * transfer is resubmitted from its callback, so only one write and one read
+ * transfer is on the bus at any time. The writes of later batches can go out
+ * while the read data of earlier ones is still coming in. */
+static int mpsse_submit_batches(struct mpsse_ctx *ctx)
 {
-	int retval = ctx->retval;
+	for (unsigned int i = 0; i < ctx->batches_in_flight; i++) {
+		struct mpsse_batch *batch = batch_in_flight(ctx, i);
+		struct mpsse_batch *prev = i ? batch_in_flight(ctx, i - 1) : NULL;
+		int retval;
+
+		if (!batch->write_result.submitted && (!prev || prev->write_result.done)) {
+			libusb_fill_bulk_transfer(batch->write_transfer, ctx->usb_dev, ctx->out_ep,
+				batch->write_buffer, batch->write_count, write_cb, &batch->write_result,
+				ctx->usb_write_timeout);
+			retval = libusb_submit_transfer(batch->write_transfer);
+			if (retval != LIBUSB_SUCCESS)
+				return retval;
+			batch->write_result.submitted = true;
+		}
 
-	if (retval != ERROR_OK) {
-		LOG_DEBUG_IO("Ignoring flush due to previous error");
-		assert(ctx->write_count == 0 && ctx->read_count == 0);
-		ctx->retval = ERROR_OK;
-		return retval;
 	}
 
-	LOG_DEBUG_IO("write %d%s, read %d", ctx->write_count, ctx->read_count ? "+1" : "",
-			ctx->read_count);
-	assert(ctx->write_count > 0 || ctx->read_count == 0); /* No read data without write data */
-
-	if (ctx->write_count == 0)
-		return retval;
-
-	struct libusb_transfer *read_transfer = NULL;
-	struct transfer_result read_result = { .ctx = ctx, .done = true };
-	if (ctx->read_count) {
-		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
-		read_result.done = false;
-		/* delay read transaction to ensure the FTDI chip can support us with data
-		   immediately after processing the MPSSE commands in the write transaction */
-	}
-
-	struct transfer_result write_result = { .ctx = ctx, .done = false };
-	struct libusb_transfer *write_transfer = libusb_alloc_transfer(0);
-	libusb_fill_bulk_transfer(write_transfer, ctx->usb_dev, ctx->out_ep, ctx->write_buffer,
-		ctx->write_count, write_cb, &write_result, ctx->usb_write_timeout);
-	retval = libusb_submit_transfer(write_transfer);
-	if (retval != LIBUSB_SUCCESS)
-		goto error_check;
-
-	if (ctx->read_count) {
-		read_transfer = libusb_alloc_transfer(0);
-		libusb_fill_bulk_transfer(read_transfer, ctx->usb_dev, ctx->in_ep, ctx->read_chunk,
-			ctx->read_chunk_size, read_cb, &read_result,
+	/* delay read transaction to ensure the FTDI chip can support us with data
+	   immediately after processing the MPSSE commands in the write transaction */
+	if (!ctx->read_submitted && batch_reading(ctx)) {
+		libusb_fill_bulk_transfer(ctx->read_transfer, ctx->usb_dev, ctx->in_ep,
+			ctx->read_chunk, ctx->read_chunk_size, read_cb, ctx,
 			ctx->usb_read_timeout);
-		retval = libusb_submit_transfer(read_transfer);
+		int retval = libusb_submit_transfer(ctx->read_transfer);
 		if (retval != LIBUSB_SUCCESS)
-			goto error_check;
+			return retval;
+		ctx->read_submitted = true;
 	}
 
-	/* Polling loop, more or less taken from libftdi */
+	return LIBUSB_SUCCESS;
+}
+
+static void mpsse_reset_batch(struct mpsse_batch *batch)
+{
+	batch->write_count = 0;
+	batch->read_count = 0;
+	batch->write_result = (struct transfer_result){ .batch = batch };
+	batch->read_result = (struct transfer_result){ .batch = batch };
+}
+
+/* Deliver the read data of completed batches, oldest first */
+static int mpsse_retire_batches(struct mpsse_ctx *ctx)
+{
+	while (ctx->batches_in_flight) {
+		struct mpsse_batch *batch = batch_in_flight(ctx, 0);
+
+		if (!batch->write_result.done || !batch->read_result.done)
+			break;
+
+		if (batch->write_result.transferred < batch->write_count) {
+			LOG_ERROR("ftdi device did not accept all data: %d, tried %d",
+				batch->write_result.transferred,
+				batch->write_count);
+			return ERROR_FAIL;
+		}
+		if (batch->read_result.transferred < batch->read_count) {
+			LOG_ERROR("ftdi device did not return all data: %d, expected %d",
+				batch->read_result.transferred,
+				batch->read_count);
+			return ERROR_FAIL;
+		}
+
+		if (batch->read_count)
+			bit_copy_execute(&batch->read_queue);
+		else
+			bit_copy_discard(&batch->read_queue);
+		mpsse_reset_batch(batch);
+
+		ctx->first_batch = (ctx->first_batch + 1) % MPSSE_BATCHES;
+		ctx->batches_in_flight--;
+	}
+
+	return ERROR_OK;
+}
+
+/* Cancel all batches in flight after an error and drop their read data */
+static void mpsse_abort_batches(struct mpsse_ctx *ctx)
+{
+	for (unsigned int i = 0; i < ctx->batches_in_flight; i++) {
+		struct mpsse_batch *batch = batch_in_flight(ctx, i);
+		if (batch->write_result.submitted && !batch->write_result.done)
+			libusb_cancel_transfer(batch->write_transfer);
+	}
+	if (ctx->read_submitted)
+		libusb_cancel_transfer(ctx->read_transfer);
+
+	for (unsigned int i = 0; i < ctx->batches_in_flight; i++) {
+		struct mpsse_batch *batch = batch_in_flight(ctx, i);
+		while ((batch->write_result.submitted && !batch->write_result.done)
+				|| ctx->read_submitted) {
+			struct timeval timeout_usb = { .tv_sec = 1 };
+			if (libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL)
+					!= LIBUSB_SUCCESS)
+				break;
+		}
+		bit_copy_discard(&batch->read_queue);
+		mpsse_reset_batch(batch);
+	}
+
+	ctx->first_batch = 0;
+	ctx->batches_in_flight = 0;
+	bit_copy_discard(&ctx->fill->read_queue);
+	mpsse_reset_batch(ctx->fill);
+	ctx->fill = &ctx->batches[0];
+}
+
+/* Handle USB events until at most max_in_flight batches are left in flight */
+static int mpsse_wait_batches(struct mpsse_ctx *ctx, unsigned int max_in_flight)
+{
+	/* the first pass only picks up transfers completed in the meantime */
+	struct timeval timeout_usb = { .tv_sec = 0 };
 	int64_t start = timeval_ms();
 	int64_t warn_after = 2000;
-	while (!write_result.done || !read_result.done) {
-		struct timeval timeout_usb;
-
-		timeout_usb.tv_sec = 1;
-		timeout_usb.tv_usec = 0;
+	int retval;
 
+	/* Polling loop, more or less taken from libftdi */
+	for (;;) {
 		retval = libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL);
+		if (retval != LIBUSB_SUCCESS && retval != LIBUSB_ERROR_INTERRUPTED)
+			break;
+
+		if (mpsse_retire_batches(ctx) != ERROR_OK) {
+			mpsse_abort_batches(ctx);
+			mpsse_purge(ctx);
+			return ERROR_FAIL;
+		}
+
+		retval = mpsse_submit_batches(ctx);
+		if (retval != LIBUSB_SUCCESS || ctx->batches_in_flight <= max_in_flight)
+			break;
+
 		keep_alive();
 
 		int64_t now = timeval_ms();
@@ -906,47 +1069,63 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 			warn_after *= 2;
 		}
 
-		if (retval == LIBUSB_ERROR_INTERRUPTED)
-			continue;
-
-		if (retval != LIBUSB_SUCCESS) {
-			libusb_cancel_transfer(write_transfer);
-			if (read_transfer)
-				libusb_cancel_transfer(read_transfer);
-		}
+		timeout_usb.tv_sec = 1;
+		timeout_usb.tv_usec = 0;
 	}
 
-error_check:
 	if (retval != LIBUSB_SUCCESS) {
 		LOG_ERROR("libusb_handle_events() failed with %s", libusb_error_name(retval));
-		retval = ERROR_FAIL;
-	} else if (write_result.transferred < ctx->write_count) {
-		LOG_ERROR("ftdi device did not accept all data: %d, tried %d",
-			write_result.transferred,
-			ctx->write_count);
-		retval = ERROR_FAIL;
-	} else if (read_result.transferred < ctx->read_count) {
-		LOG_ERROR("ftdi device did not return all data: %d, expected %d",
-			read_result.transferred,
-			ctx->read_count);
-		retval = ERROR_FAIL;
-	} else if (ctx->read_count) {
-		ctx->write_count = 0;
-		ctx->read_count = 0;
-		bit_copy_execute(&ctx->read_queue);
-		retval = ERROR_OK;
-	} else {
-		ctx->write_count = 0;
-		bit_copy_discard(&ctx->read_queue);
-		retval = ERROR_OK;
+		mpsse_abort_batches(ctx);
+		mpsse_purge(ctx);
+		return ERROR_FAIL;
 	}
 
+	return ERROR_OK;
+}
+
+/* Put the batch being filled in flight and start filling the next free one.
+ * Read data of the queued batch becomes available by the next mpsse_flush(). */
+static int mpsse_queue(struct mpsse_ctx *ctx)
+{
+	struct mpsse_batch *batch = ctx->fill;
+
+	LOG_DEBUG_IO("write %d%s, read %d", batch->write_count, batch->read_count ? "+1" : "",
+			batch->read_count);
+	assert(batch->write_count > 0 || batch->read_count == 0); /* No read data without write data */
+
+	if (batch->write_count == 0)
+		return ERROR_OK;
+
+	if (batch->read_count)
+		buffer_write_byte(ctx, 0x87); /* SEND_IMMEDIATE */
+	batch->read_result.done = batch->read_count == 0;
+
+	ctx->batches_in_flight++;
+
+	/* wait for the oldest batch only if all buffers are in use */
+	int retval = mpsse_wait_batches(ctx, MPSSE_BATCHES - 1);
 	if (retval != ERROR_OK)
-		mpsse_purge(ctx);
+		return retval;
+
+	ctx->fill = batch_in_flight(ctx, ctx->batches_in_flight);
+	return ERROR_OK;
+}
+
+int mpsse_flush(struct mpsse_ctx *ctx)
+{
+	int retval = ctx->retval;
 
-	libusb_free_transfer(write_transfer);
-	if (read_transfer)
-		libusb_free_transfer(read_transfer);
+	if (retval != ERROR_OK) {
+		LOG_DEBUG_IO("Ignoring flush due to previous error");
+		assert(ctx->fill->write_count == 0 && ctx->fill->read_count == 0);
+		assert(ctx->batches_in_flight == 0);
+		ctx->retval = ERROR_OK;
+		return retval;
+	}
+
+	retval = mpsse_queue(ctx);
+	if (retval != ERROR_OK)
+		return retval;
 
-	return retval;
+	return mpsse_wait_batches(ctx, 0);
 }
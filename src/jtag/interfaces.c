@@ -54,6 +54,9 @@ struct adapter_driver *adapter_drivers[] = {
 #if BUILD_JTAG_VPI == 1
 		&jtag_vpi_adapter_driver,
 #endif
+#if BUILD_DAPSIM == 1
+		&dapsim_adapter_driver,
+#endif
 #if BUILD_VDEBUG == 1
 		&vdebug_adapter_driver,
 #endif
@@ -251,6 +251,13 @@ void jtag_set_verify(bool enable);
 /** @returns True if data scan verification will be performed. */
 bool jtag_will_verify(void);
 
+/** Enable or disable the simplification of the command queue. */
+void jtag_set_optimize_queue(bool enable);
+/** @returns True if the command queue is simplified before execution. */
+bool jtag_will_optimize_queue(void);
+/** Get the commands removed and TCK cycles saved by the simplification. */
+void jtag_get_optimize_queue_stats(uint64_t *removed, uint64_t *bits_saved);
+
 /** Enable or disable verification of IR scan checking. */
 void jtag_set_verify_capture_ir(bool enable);
 /** @returns True if IR scan verification will be performed. */
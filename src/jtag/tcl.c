@@ -1029,6 +1029,27 @@ COMMAND_HANDLER(handle_verify_jtag_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_jtag_optimize_queue_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_set_optimize_queue(enable);
+	}
+
+	uint64_t removed, bits_saved;
+	jtag_get_optimize_queue_stats(&removed, &bits_saved);
+
+	const char *status = jtag_will_optimize_queue() ? "enabled" : "disabled";
+	command_print(CMD, "jtag queue optimization is %s, %" PRIu64 " commands removed, "
+		"%" PRIu64 " TCK cycles saved", status, removed, bits_saved);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_tms_sequence_command)
 {
 	if (CMD_ARGC > 1)
@@ -1172,6 +1193,15 @@ static const struct command_registration jtag_command_handlers[] = {
 			"verify values captured during IR and DR scans.",
 		.usage = "['enable'|'disable']",
 	},
+	{
+		.name = "jtag_optimize_queue",
+		.handler = handle_jtag_optimize_queue_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or assign flag controlling whether to "
+			"drop repeated IR scans and merge state moves "
+			"before executing the JTAG queue.",
+		.usage = "['enable'|'disable']",
+	},
 	{
 		.name = "tms_sequence",
 		.handler = handle_tms_sequence_command,
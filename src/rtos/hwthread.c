@@ -248,8 +248,10 @@ static int hwthread_get_thread_reg_list(struct rtos *rtos, int64_t thread_id,
 
 	int j = 0;
 	for (int i = 0; i < reg_list_size; i++) {
-		if (!reg_list[i] || reg_list[i]->exist == false || reg_list[i]->hidden)
+		if (!reg_list[i] || !reg_list[i]->exist || reg_list[i]->hidden) {
+			reg_list[i] = NULL;
 			continue;
+		}
 		j++;
 	}
 	*rtos_reg_list_size = j;
@@ -259,19 +261,18 @@ static int hwthread_get_thread_reg_list(struct rtos *rtos, int64_t thread_id,
 		return ERROR_FAIL;
 	}
 
+	retval = register_get_many(reg_list, reg_list_size);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Couldn't get registers.");
+		free(reg_list);
+		free(*rtos_reg_list);
+		return retval;
+	}
+
 	j = 0;
 	for (int i = 0; i < reg_list_size; i++) {
-		if (!reg_list[i] || reg_list[i]->exist == false || reg_list[i]->hidden)
+		if (!reg_list[i])
 			continue;
-		if (!reg_list[i]->valid) {
-			retval = reg_list[i]->type->get(reg_list[i]);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Couldn't get register %s.", reg_list[i]->name);
-				free(reg_list);
-				free(*rtos_reg_list);
-				return retval;
-			}
-		}
 		(*rtos_reg_list)[j].number = reg_list[i]->number;
 		(*rtos_reg_list)[j].size = reg_list[i]->size;
 		memcpy((*rtos_reg_list)[j].value, reg_list[i]->value,
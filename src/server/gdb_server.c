@@ -27,6 +27,7 @@
 #include "config.h"
 #endif
 
+#include <helper/align.h>
 #include <target/breakpoints.h>
 #include <target/target_request.h>
 #include <target/register.h>
@@ -101,8 +102,64 @@ struct gdb_connection {
 	enum gdb_output_flag output_flag;
 	/* Unique index for this GDB connection. */
 	unsigned int unique_index;
+	/* incoming packet buffer, size advertised to GDB as PacketSize */
+	char *packet_buffer;
+	unsigned int packet_size;
 };
 
+/* Memory read cache, one per target, allocated on first use if
+ * gdb_memory_cache is enabled. Direct mapped, filled with aligned blocks
+ * read from the halted target and dropped on any memory write through the
+ * target API, on any target event and on memory modifying packets. */
+#define GDB_MEM_CACHE_BLOCK_SIZE	64
+#define GDB_MEM_CACHE_BLOCKS		256
+
+struct gdb_mem_cache_block {
+	bool valid;
+	target_addr_t address;
+	uint8_t data[GDB_MEM_CACHE_BLOCK_SIZE];
+};
+
+struct gdb_mem_cache {
+	/* target->memory_writes when the cache was last emptied */
+	unsigned int memory_writes;
+	struct gdb_mem_cache_block blocks[GDB_MEM_CACHE_BLOCKS];
+};
+
+/* memory area never served from the cache, e.g. peripheral registers */
+struct gdb_mem_cache_region {
+	target_addr_t address;
+	target_addr_t size;
+};
+
+/* PacketSize advertised to new connections */
+#define GDB_PACKET_SIZE_MIN		1024
+#define GDB_PACKET_SIZE_MAX		(16 * 1024 * 1024)
+static unsigned int gdb_packet_size = GDB_BUFFER_SIZE;
+
+static bool gdb_mem_cache_enabled;
+static struct gdb_mem_cache_region *gdb_mem_cache_volatile;
+static unsigned int gdb_mem_cache_volatile_count;
+
+static struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t bypassed;
+	uint64_t invalidations;
+} gdb_mem_cache_stats;
+
+static void gdb_mem_cache_invalidate(struct target *target)
+{
+	struct gdb_mem_cache *cache = target->gdb_mem_cache;
+	if (!cache)
+		return;
+
+	for (unsigned int i = 0; i < GDB_MEM_CACHE_BLOCKS; i++)
+		cache->blocks[i].valid = false;
+	cache->memory_writes = target->memory_writes;
+	gdb_mem_cache_stats.invalidations++;
+}
+
 #if 0
 #define _DEBUG_GDB_IO_
 #endif
@@ -957,6 +1014,11 @@ static int gdb_target_callback_event_handler(struct target *target,
 	struct connection *connection = priv;
 	struct gdb_service *gdb_service = connection->service->priv;
 
+	/* resume, step, reset, flash programming or a halt of another core in
+	 * the SMP group may all change memory behind our back */
+	gdb_mem_cache_invalidate(target);
+	gdb_mem_cache_invalidate(gdb_service->target);
+
 	if (gdb_service->target != target)
 		return ERROR_OK;
 
@@ -982,6 +1044,18 @@ static int gdb_new_connection(struct connection *connection)
 	int initial_ack;
 	static unsigned int next_unique_id = 1;
 
+	if (!gdb_connection)
+		return ERROR_FAIL;
+
+	/* Extra byte for null-termination */
+	gdb_connection->packet_buffer = malloc(gdb_packet_size + 1);
+	if (!gdb_connection->packet_buffer) {
+		LOG_ERROR("Unable to allocate gdb packet buffer of %u bytes", gdb_packet_size);
+		free(gdb_connection);
+		return ERROR_FAIL;
+	}
+	gdb_connection->packet_size = gdb_packet_size;
+
 	target = get_target_from_connection(connection);
 	connection->priv = gdb_connection;
 	connection->cmd_ctx->current_target = target;
@@ -1118,6 +1192,7 @@ static int gdb_connection_closed(struct connection *connection)
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, target);
 
+	free(gdb_connection->packet_buffer);
 	free(connection->priv);
 	connection->priv = NULL;
 
@@ -1261,13 +1336,20 @@ static int gdb_get_registers_packet(struct connection *connection,
 		return gdb_error(connection, retval);
 
 	for (i = 0; i < reg_list_size; i++) {
-		if (!reg_list[i] || reg_list[i]->exist == false || reg_list[i]->hidden)
+		if (!reg_list[i] || !reg_list[i]->exist || reg_list[i]->hidden) {
+			/* not sent, don't read it either */
+			reg_list[i] = NULL;
 			continue;
+		}
 		reg_packet_size += DIV_ROUND_UP(reg_list[i]->size, 8) * 2;
 	}
 
 	assert(reg_packet_size > 0);
 
+	/* Read the pending registers in batches. Failures are ignored here, the
+	 * registers left invalid are read and reported one by one below. */
+	register_get_many(reg_list, reg_list_size);
+
 	reg_packet = malloc(reg_packet_size + 1); /* plus one for string termination null */
 	if (!reg_packet)
 		return ERROR_FAIL;
@@ -1490,6 +1572,131 @@ static int gdb_error(struct connection *connection, int retval)
 	return ERROR_OK;
 }
 
+static bool gdb_mem_cache_is_volatile(target_addr_t addr, target_addr_t size)
+{
+	for (unsigned int i = 0; i < gdb_mem_cache_volatile_count; i++) {
+		struct gdb_mem_cache_region *r = &gdb_mem_cache_volatile[i];
+		if (addr < r->address + r->size && r->address < addr + size)
+			return true;
+	}
+	return false;
+}
+
+/* Read target memory through the target's cache. Consecutive missing
+ * blocks are fetched with a single target_read_buffer(). */
+static int gdb_mem_cache_read(struct connection *connection, target_addr_t addr,
+		uint32_t len, uint8_t *buffer)
+{
+	struct target *target = get_target_from_connection(connection);
+
+	target_addr_t first = ALIGN_DOWN(addr, GDB_MEM_CACHE_BLOCK_SIZE);
+	target_addr_t end = addr + len;
+	target_addr_t span = ALIGN_UP(end, GDB_MEM_CACHE_BLOCK_SIZE) - first;
+
+	/* requests are limited to a quarter of the cache, so their blocks never alias */
+	if (!gdb_mem_cache_enabled || target->state != TARGET_HALTED
+			|| end < addr || len > GDB_MEM_CACHE_BLOCKS * GDB_MEM_CACHE_BLOCK_SIZE / 4
+			|| gdb_mem_cache_is_volatile(first, span)) {
+		gdb_mem_cache_stats.bypassed++;
+		return target_read_buffer(target, addr, len, buffer);
+	}
+
+	struct gdb_mem_cache *cache = target->gdb_mem_cache;
+	if (!cache) {
+		cache = calloc(1, sizeof(*cache));
+		if (!cache)
+			return target_read_buffer(target, addr, len, buffer);
+		cache->memory_writes = target->memory_writes;
+		target->gdb_mem_cache = cache;
+	}
+
+	/* written by a telnet or Tcl command or another connection */
+	if (cache->memory_writes != target->memory_writes)
+		gdb_mem_cache_invalidate(target);
+
+	uint8_t *fill = NULL;
+	target_addr_t block = first;
+	while (block < end) {
+		unsigned int index = (block / GDB_MEM_CACHE_BLOCK_SIZE) % GDB_MEM_CACHE_BLOCKS;
+		struct gdb_mem_cache_block *b = &cache->blocks[index];
+
+		if (b->valid && b->address == block) {
+			gdb_mem_cache_stats.hits++;
+			block += GDB_MEM_CACHE_BLOCK_SIZE;
+			continue;
+		}
+
+		/* collect the run of missing blocks */
+		target_addr_t run_end = block + GDB_MEM_CACHE_BLOCK_SIZE;
+		while (run_end < end) {
+			index = (run_end / GDB_MEM_CACHE_BLOCK_SIZE) % GDB_MEM_CACHE_BLOCKS;
+			b = &cache->blocks[index];
+			if (b->valid && b->address == run_end)
+				break;
+			run_end += GDB_MEM_CACHE_BLOCK_SIZE;
+		}
+
+		uint32_t run_len = run_end - block;
+		if (!fill) {
+			fill = malloc(span);
+			if (!fill)
+				return target_read_buffer(target, addr, len, buffer);
+		}
+
+		int retval = target_read_buffer(target, block, run_len, fill);
+		if (retval != ERROR_OK) {
+			/* the aligned blocks may reach into inaccessible memory,
+			 * let the exact request decide about the error */
+			free(fill);
+			gdb_mem_cache_stats.bypassed++;
+			return target_read_buffer(target, addr, len, buffer);
+		}
+
+		for (uint32_t offset = 0; offset < run_len; offset += GDB_MEM_CACHE_BLOCK_SIZE) {
+			index = ((block + offset) / GDB_MEM_CACHE_BLOCK_SIZE) % GDB_MEM_CACHE_BLOCKS;
+			b = &cache->blocks[index];
+			b->valid = true;
+			b->address = block + offset;
+			memcpy(b->data, fill + offset, GDB_MEM_CACHE_BLOCK_SIZE);
+			gdb_mem_cache_stats.misses++;
+		}
+
+		block = run_end;
+	}
+	free(fill);
+
+	/* all blocks are now cached, copy the requested bytes */
+	for (block = first; block < end; block += GDB_MEM_CACHE_BLOCK_SIZE) {
+		unsigned int index = (block / GDB_MEM_CACHE_BLOCK_SIZE) % GDB_MEM_CACHE_BLOCKS;
+		struct gdb_mem_cache_block *b = &cache->blocks[index];
+		target_addr_t from = MAX(block, addr);
+		target_addr_t to = MIN(block + GDB_MEM_CACHE_BLOCK_SIZE, end);
+		memcpy(buffer + (from - addr), b->data + (from - block), to - from);
+	}
+
+	return ERROR_OK;
+}
+
+/* Encode the reply of an 'x' packet: 'b' followed by the raw data, with
+ * '#', '$', '}' and '*' escaped as '}' and the byte xor 0x20. */
+static size_t gdb_escape_binary(char *out, const uint8_t *data, size_t len)
+{
+	size_t pos = 0;
+
+	out[pos++] = 'b';
+	for (size_t i = 0; i < len; i++) {
+		uint8_t c = data[i];
+		if (c == '#' || c == '$' || c == '}' || c == '*') {
+			out[pos++] = '}';
+			c ^= 0x20;
+		}
+		out[pos++] = c;
+	}
+
+	return pos;
+}
+
+/* handles both the hex 'm' and the binary 'x' memory read packets */
 static int gdb_read_memory_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
@@ -1497,6 +1704,7 @@ static int gdb_read_memory_packet(struct connection *connection,
 	char *separator;
 	uint64_t addr = 0;
 	uint32_t len = 0;
+	bool binary = packet[0] == 'x';
 
 	uint8_t *buffer;
 	char *hex_buffer;
@@ -1516,12 +1724,21 @@ static int gdb_read_memory_packet(struct connection *connection,
 	len = strtoul(separator + 1, NULL, 16);
 
 	if (!len) {
+		/* a zero length 'x' only checks for binary read support */
+		if (binary) {
+			gdb_put_packet(connection, "b", 1);
+			return ERROR_OK;
+		}
 		LOG_WARNING("invalid read memory packet received (len == 0)");
 		gdb_put_packet(connection, "", 0);
 		return ERROR_OK;
 	}
 
 	buffer = malloc(len);
+	if (!buffer) {
+		LOG_ERROR("Unable to allocate %" PRIu32 " bytes for memory read", len);
+		return gdb_error(connection, ERROR_FAIL);
+	}
 
 	LOG_DEBUG("addr: 0x%16.16" PRIx64 ", len: 0x%8.8" PRIx32 "", addr, len);
 
@@ -1529,7 +1746,7 @@ static int gdb_read_memory_packet(struct connection *connection,
 	if (target->rtos)
 		retval = rtos_read_buffer(target, addr, len, buffer);
 	if (retval == ERROR_NOT_IMPLEMENTED)
-		retval = target_read_buffer(target, addr, len, buffer);
+		retval = gdb_mem_cache_read(connection, addr, len, buffer);
 
 	if ((retval != ERROR_OK) && !gdb_report_data_abort) {
 		/* TODO : Here we have to lie and send back all zero's lest stack traces won't work.
@@ -1550,9 +1767,14 @@ static int gdb_read_memory_packet(struct connection *connection,
 	}
 
 	if (retval == ERROR_OK) {
+		/* worst case, every byte escaped plus the 'b' prefix */
 		hex_buffer = malloc(len * 2 + 1);
 
-		size_t pkt_len = hexify(hex_buffer, buffer, len, len * 2 + 1);
+		size_t pkt_len;
+		if (binary)
+			pkt_len = gdb_escape_binary(hex_buffer, buffer, len);
+		else
+			pkt_len = hexify(hex_buffer, buffer, len, len * 2 + 1);
 
 		gdb_put_packet(connection, hex_buffer, pkt_len);
 
@@ -1600,6 +1822,8 @@ static int gdb_write_memory_packet(struct connection *connection,
 	if (unhexify(buffer, separator, len) != len)
 		LOG_ERROR("unable to decode memory packet");
 
+	gdb_mem_cache_invalidate(target);
+
 	retval = ERROR_NOT_IMPLEMENTED;
 	if (target->rtos)
 		retval = rtos_write_buffer(target, addr, len, buffer);
@@ -1673,6 +1897,8 @@ static int gdb_write_memory_binary_packet(struct connection *connection,
 	if (len) {
 		LOG_DEBUG("addr: 0x%" PRIx64 ", len: 0x%8.8" PRIx32 "", addr, len);
 
+		gdb_mem_cache_invalidate(target);
+
 		retval = ERROR_NOT_IMPLEMENTED;
 		if (target->rtos)
 			retval = rtos_write_buffer(target, addr, len, (uint8_t *)separator);
@@ -1737,6 +1963,9 @@ static int gdb_breakpoint_watchpoint_packet(struct connection *connection,
 
 	LOG_DEBUG("[%s]", target_name(target));
 
+	/* software breakpoints are written to memory */
+	gdb_mem_cache_invalidate(target);
+
 	type = strtoul(packet + 1, &separator, 16);
 
 	if (type == 0)	/* memory breakpoint */
@@ -2758,6 +2987,9 @@ static int gdb_query_packet(struct connection *connection,
 			size_t len = unhexify((uint8_t *)cmd, packet + 6, (packet_size - 6) / 2);
 			cmd[len] = 0;
 
+			/* monitor commands may write memory */
+			gdb_mem_cache_invalidate(target);
+
 			/* We want to print all debug output to GDB connection */
 			gdb_connection->output_flag = GDB_OUTPUT_ALL;
 			target_call_timer_callbacks_now();
@@ -2885,8 +3117,9 @@ static int gdb_query_packet(struct connection *connection,
 			&buffer,
 			&pos,
 			&size,
-			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;vContSupported+",
-			GDB_BUFFER_SIZE,
+			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;"
+			"QStartNoAckMode+;vContSupported+;binary-upload+",
+			gdb_connection->packet_size,
 			((gdb_use_memory_map == 1) && (flash_get_bank_count() > 0)) ? '+' : '-',
 			(gdb_target_desc_supported == 1) ? '+' : '-');
 
@@ -3499,14 +3732,12 @@ static void gdb_sig_halted(struct connection *connection)
 
 static int gdb_input_inner(struct connection *connection)
 {
-	/* Do not allocate this on the stack */
-	static char gdb_packet_buffer[GDB_BUFFER_SIZE + 1]; /* Extra byte for null-termination */
-
 	struct target *target;
+	struct gdb_connection *gdb_con = connection->priv;
+	char *gdb_packet_buffer = gdb_con->packet_buffer;
 	char const *packet = gdb_packet_buffer;
 	int packet_size;
 	int retval;
-	struct gdb_connection *gdb_con = connection->priv;
 	static bool warn_use_ext;
 
 	target = get_target_from_connection(connection);
@@ -3523,7 +3754,7 @@ static int gdb_input_inner(struct connection *connection)
 	 * drain the rest of the buffer.
 	 */
 	do {
-		packet_size = GDB_BUFFER_SIZE;
+		packet_size = gdb_con->packet_size;
 		retval = gdb_get_packet(connection, gdb_packet_buffer, &packet_size);
 		if (retval != ERROR_OK)
 			return retval;
@@ -3563,6 +3794,7 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_set_register_packet(connection, packet, packet_size);
 					break;
 				case 'm':
+				case 'x':
 					gdb_con->output_flag = GDB_OUTPUT_NOTIF;
 					retval = gdb_read_memory_packet(connection, packet, packet_size);
 					gdb_con->output_flag = GDB_OUTPUT_NO;
@@ -3986,6 +4218,104 @@ COMMAND_HANDLER(handle_gdb_report_register_access_error)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_memory_cache_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		gdb_mem_cache_enabled = enable;
+	}
+
+	command_print(CMD, "gdb memory cache is %s",
+		gdb_mem_cache_enabled ? "enabled" : "disabled");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_gdb_packet_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int size;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+		if (size < GDB_PACKET_SIZE_MIN || size > GDB_PACKET_SIZE_MAX) {
+			command_print(CMD, "packet size must be between %u and %u bytes",
+				GDB_PACKET_SIZE_MIN, GDB_PACKET_SIZE_MAX);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		gdb_packet_size = size;
+	}
+
+	command_print(CMD, "%u", gdb_packet_size);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_gdb_memory_cache_volatile_command)
+{
+	if (CMD_ARGC == 0) {
+		for (unsigned int i = 0; i < gdb_mem_cache_volatile_count; i++)
+			command_print(CMD, "0x%8.8" TARGET_PRIxADDR " 0x%8.8" TARGET_PRIxADDR,
+				gdb_mem_cache_volatile[i].address, gdb_mem_cache_volatile[i].size);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "clear") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		free(gdb_mem_cache_volatile);
+		gdb_mem_cache_volatile = NULL;
+		gdb_mem_cache_volatile_count = 0;
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct gdb_mem_cache_region region;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], region.address);
+	COMMAND_PARSE_NUMBER(target_addr, CMD_ARGV[1], region.size);
+	if (region.size == 0)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	struct gdb_mem_cache_region *regions = realloc(gdb_mem_cache_volatile,
+		(gdb_mem_cache_volatile_count + 1) * sizeof(*regions));
+	if (!regions) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	regions[gdb_mem_cache_volatile_count++] = region;
+	gdb_mem_cache_volatile = regions;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_gdb_memory_cache_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&gdb_mem_cache_stats, 0, sizeof(gdb_mem_cache_stats));
+		return ERROR_OK;
+	}
+
+	uint64_t lookups = gdb_mem_cache_stats.hits + gdb_mem_cache_stats.misses;
+	command_print(CMD, "block hits:     %" PRIu64, gdb_mem_cache_stats.hits);
+	command_print(CMD, "block misses:   %" PRIu64, gdb_mem_cache_stats.misses);
+	command_print(CMD, "hit rate:       %u%%",
+		lookups ? (unsigned int)(gdb_mem_cache_stats.hits * 100 / lookups) : 0);
+	command_print(CMD, "uncached reads: %" PRIu64, gdb_mem_cache_stats.bypassed);
+	command_print(CMD, "invalidations:  %" PRIu64, gdb_mem_cache_stats.invalidations);
+
+	return ERROR_OK;
+}
+
 /* gdb_breakpoint_override */
 COMMAND_HANDLER(handle_gdb_breakpoint_override_command)
 {
@@ -4114,6 +4444,37 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable reporting register access errors",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_memory_cache",
+		.handler = handle_gdb_memory_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "enable or disable caching of memory read by gdb "
+			"while the target is halted",
+		.usage = "['enable'|'disable']"
+	},
+	{
+		.name = "gdb_packet_size",
+		.handler = handle_gdb_packet_size_command,
+		.mode = COMMAND_ANY,
+		.help = "display or set the maximum packet size advertised "
+			"to new gdb connections",
+		.usage = "[size]"
+	},
+	{
+		.name = "gdb_memory_cache_volatile",
+		.handler = handle_gdb_memory_cache_volatile_command,
+		.mode = COMMAND_ANY,
+		.help = "list, add or clear memory regions never served "
+			"from the gdb memory cache",
+		.usage = "['clear' | address size]"
+	},
+	{
+		.name = "gdb_memory_cache_stats",
+		.handler = handle_gdb_memory_cache_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "display or reset gdb memory cache statistics",
+		.usage = "['reset']"
+	},
 	{
 		.name = "gdb_breakpoint_override",
 		.handler = handle_gdb_breakpoint_override_command,
@@ -4150,6 +4511,7 @@ void gdb_service_free(void)
 {
 	free(gdb_port);
 	free(gdb_port_next);
+	free(gdb_mem_cache_volatile);
 }
 
 int gdb_get_actual_connections(void)
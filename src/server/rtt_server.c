@@ -28,46 +28,169 @@ struct rtt_service {
 	char *hello_message;
 };
 
-static int read_callback(unsigned int channel, const uint8_t *buffer,
-		size_t length, void *user_data)
-{
-	int ret;
+/*
+ * Channel data not yet accepted by a client is kept in a per connection
+ * ring buffer and the socket is non-blocking, so a slow client neither
+ * stalls the RTT polling nor the other clients.
+ */
+struct rtt_connection {
 	struct connection *connection;
-	size_t offset;
+	uint8_t *buffer;
+	size_t size;
+	/* position of the oldest byte and number of bytes in the buffer */
+	size_t head;
+	size_t used;
+	size_t max_used;
+	uint64_t sent;
+	uint64_t dropped;
+	uint64_t stalls;
+	struct rtt_connection *next;
+};
+
+#define RTT_SERVER_DEFAULT_BUFFER_SIZE	(256 * 1024)
+
+static size_t rtt_server_buffer_size = RTT_SERVER_DEFAULT_BUFFER_SIZE;
+static struct rtt_connection *rtt_connections;
+
+static bool rtt_write_would_block(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
 
-	connection = (struct connection *)user_data;
-	offset = 0;
+/* write as much as the client accepts without blocking */
+static int rtt_connection_send(struct rtt_connection *rc, const uint8_t *data,
+		size_t length, size_t *sent)
+{
+	*sent = 0;
 
-	while (offset < length) {
-		ret = connection_write(connection, buffer + offset, length - offset);
+	while (*sent < length) {
+		int ret = connection_write(rc->connection, data + *sent,
+			MIN(length - *sent, INT_MAX));
 
 		if (ret < 0) {
+			if (rtt_write_would_block()) {
+				rc->stalls++;
+				break;
+			}
 			LOG_ERROR("Failed to write data to socket.");
 			return ERROR_FAIL;
 		}
 
-		offset += ret;
+		if (!ret)
+			break;
+
+		*sent += ret;
+		rc->sent += ret;
 	}
 
 	return ERROR_OK;
 }
 
+/* queue data in the ring buffer, whatever doesn't fit is dropped */
+static void rtt_connection_push(struct rtt_connection *rc, const uint8_t *data,
+		size_t length)
+{
+	size_t count = MIN(length, rc->size - rc->used);
+	size_t tail = (rc->head + rc->used) % rc->size;
+	size_t first = MIN(count, rc->size - tail);
+
+	memcpy(rc->buffer + tail, data, first);
+	memcpy(rc->buffer, data + first, count - first);
+
+	rc->used += count;
+	rc->max_used = MAX(rc->max_used, rc->used);
+	rc->dropped += length - count;
+}
+
+/* send the ring buffer, at most two contiguous parts */
+static int rtt_connection_flush(struct rtt_connection *rc)
+{
+	while (rc->used) {
+		size_t length = MIN(rc->used, rc->size - rc->head);
+		size_t sent;
+
+		int ret = rtt_connection_send(rc, rc->buffer + rc->head, length, &sent);
+		if (ret != ERROR_OK)
+			return ret;
+
+		rc->head = (rc->head + sent) % rc->size;
+		rc->used -= sent;
+
+		if (sent < length)
+			break;
+	}
+
+	return ERROR_OK;
+}
+
+static int read_callback(unsigned int channel, const uint8_t *buffer,
+		size_t length, void *user_data)
+{
+	struct connection *connection = (struct connection *)user_data;
+	struct rtt_connection *rc = connection->priv;
+	size_t sent = 0;
+	int ret;
+
+	/* older data first */
+	ret = rtt_connection_flush(rc);
+	if (ret != ERROR_OK)
+		return ret;
+
+	if (!rc->used) {
+		ret = rtt_connection_send(rc, buffer, length, &sent);
+		if (ret != ERROR_OK)
+			return ret;
+	}
+
+	rtt_connection_push(rc, buffer + sent, length - sent);
+
+	return ERROR_OK;
+}
+
 static int rtt_new_connection(struct connection *connection)
 {
 	int ret;
 	struct rtt_service *service;
+	struct rtt_connection *rc;
 
 	service = connection->service->priv;
 
 	LOG_DEBUG("rtt: New connection for channel %u", service->channel);
 
+	rc = calloc(1, sizeof(*rc));
+	if (rc)
+		rc->buffer = malloc(rtt_server_buffer_size);
+	if (!rc || !rc->buffer) {
+		LOG_ERROR("Out of memory");
+		free(rc);
+		return ERROR_FAIL;
+	}
+	rc->connection = connection;
+	rc->size = rtt_server_buffer_size;
+	connection->priv = rc;
+
+	if (connection->service->type == CONNECTION_TCP)
+		socket_nonblock(connection->fd);
+
 	ret = rtt_register_sink(service->channel, &read_callback, connection);
 
-	if (ret != ERROR_OK)
+	if (ret != ERROR_OK) {
+		free(rc->buffer);
+		free(rc);
+		connection->priv = NULL;
 		return ret;
+	}
+
+	rc->next = rtt_connections;
+	rtt_connections = rc;
 
 	if (service->hello_message)
-		connection_write(connection, service->hello_message, strlen(service->hello_message));
+		read_callback(service->channel, (const uint8_t *)service->hello_message,
+			strlen(service->hello_message), connection);
 
 	return ERROR_OK;
 }
@@ -75,10 +198,27 @@ static int rtt_new_connection(struct connection *connection)
 static int rtt_connection_closed(struct connection *connection)
 {
 	struct rtt_service *service;
+	struct rtt_connection *rc = connection->priv;
 
 	service = (struct rtt_service *)connection->service->priv;
 	rtt_unregister_sink(service->channel, &read_callback, connection);
 
+	if (rc) {
+		if (rc->dropped)
+			LOG_INFO("rtt: %" PRIu64 " bytes of channel %u dropped for a slow client",
+				rc->dropped, service->channel);
+
+		for (struct rtt_connection **p = &rtt_connections; *p; p = &(*p)->next) {
+			if (*p == rc) {
+				*p = rc->next;
+				break;
+			}
+		}
+		free(rc->buffer);
+		free(rc);
+		connection->priv = NULL;
+	}
+
 	LOG_DEBUG("rtt: Connection for channel %u closed", service->channel);
 
 	return ERROR_OK;
@@ -165,6 +305,40 @@ COMMAND_HANDLER(handle_rtt_stop_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_rtt_buffer_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int size;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+		if (!size)
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		rtt_server_buffer_size = size;
+	}
+
+	command_print(CMD, "%zu", rtt_server_buffer_size);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_rtt_server_stats_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	for (struct rtt_connection *rc = rtt_connections; rc; rc = rc->next) {
+		struct rtt_service *service = rc->connection->service->priv;
+		command_print(CMD, "port %s channel %u: buffered %zu (max %zu) of %zu bytes, "
+			"sent %" PRIu64 ", dropped %" PRIu64 ", stalled %" PRIu64 " times",
+			rc->connection->service->port, service->channel, rc->used,
+			rc->max_used, rc->size, rc->sent, rc->dropped, rc->stalls);
+	}
+
+	return ERROR_OK;
+}
+
 static const struct command_registration rtt_server_subcommand_handlers[] = {
 	{
 		.name = "start",
@@ -180,6 +354,22 @@ static const struct command_registration rtt_server_subcommand_handlers[] = {
 		.help = "Stop a RTT server",
 		.usage = "<port>"
 	},
+	{
+		.name = "buffer_size",
+		.handler = handle_rtt_buffer_size_command,
+		.mode = COMMAND_ANY,
+		.help = "Set the size of the buffer for data not yet sent to a "
+			"client, used for new connections",
+		.usage = "[size]"
+	},
+	{
+		.name = "stats",
+		.handler = handle_rtt_server_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "Show buffer usage and dropped data of the RTT server "
+			"connections",
+		.usage = ""
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -54,6 +54,26 @@ static int polling_period = 100;
 /* address by name on which to listen for incoming TCP/IP connections */
 static char *bindto_name;
 
+#ifdef HAVE_POLL_H
+/* service or connection watched by the pollfd with the same index */
+struct poll_entry {
+	struct service *service;
+	struct connection *connection;
+};
+
+static struct pollfd *poll_fds;
+static struct poll_entry *poll_entries;
+static unsigned int poll_fds_count;
+static unsigned int poll_fds_size;
+#else
+/* used in select() */
+static fd_set read_fds;
+#endif
+
+/* set when a listener or connection has been added or removed,
+ * the poll() set is then rebuilt before the next wait */
+static bool poll_set_changed = true;
+
 static int add_connection(struct service *service, struct command_context *cmd_ctx)
 {
 	socklen_t address_size;
@@ -108,6 +128,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 
 		/* do not check for new connections again on stdin */
 		service->fd = -1;
+		poll_set_changed = true;
 
 		LOG_INFO("accepting '%s' connection from pipe", service->name);
 		retval = service->new_connection(c);
@@ -121,6 +142,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 		c->fd = service->fd;
 		/* do not check for new connections again on stdin */
 		service->fd = -1;
+		poll_set_changed = true;
 
 		char *out_file = alloc_printf("%so", service->port);
 		c->fd_out = open(out_file, O_WRONLY);
@@ -146,6 +168,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	for (p = &service->connections; *p; p = &(*p)->next)
 		;
 	*p = c;
+	poll_set_changed = true;
 
 	if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 		service->max_connections--;
@@ -174,6 +197,7 @@ static int remove_connection(struct service *service, struct connection *connect
 			/* delete connection */
 			*p = c->next;
 			free(c);
+			poll_set_changed = true;
 
 			if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 				service->max_connections++;
@@ -333,6 +357,7 @@ int add_service(const struct service_driver *driver, const char *port,
 	for (p = &services; *p; p = &(*p)->next)
 		;
 	*p = c;
+	poll_set_changed = true;
 
 	return ERROR_OK;
 }
@@ -373,6 +398,7 @@ int remove_service(const char *name, const char *port)
 
 			free(tmp->priv);
 			free_service(tmp);
+			poll_set_changed = true;
 
 			return ERROR_OK;
 		}
@@ -407,6 +433,16 @@ static int remove_services(void)
 	}
 
 	services = NULL;
+	poll_set_changed = true;
+
+#ifdef HAVE_POLL_H
+	free(poll_fds);
+	free(poll_entries);
+	poll_fds = NULL;
+	poll_entries = NULL;
+	poll_fds_count = 0;
+	poll_fds_size = 0;
+#endif
 
 	return ERROR_OK;
 }
@@ -419,17 +455,195 @@ void server_keep_clients_alive(void)
 				s->keep_client_alive(c);
 }
 
-int server_loop(struct command_context *command_context)
+static void service_accept(struct service *service, struct command_context *cmd_ctx)
 {
-	struct service *service;
+	if (service->max_connections != 0) {
+		add_connection(service, cmd_ctx);
+		return;
+	}
 
-	bool poll_ok = true;
+	if (service->type == CONNECTION_TCP) {
+		struct sockaddr_in sin;
+		socklen_t address_size = sizeof(sin);
+		int tmp_fd;
+		tmp_fd = accept(service->fd,
+				(struct sockaddr *)&service->sin,
+				&address_size);
+		close_socket(tmp_fd);
+	}
+	LOG_INFO("rejected '%s' connection, no more connections allowed",
+		service->name);
+}
+
+static int connection_input(struct service *service, struct connection *c)
+{
+	int retval = service->input(c);
+	if (retval == ERROR_OK)
+		return ERROR_OK;
+
+	if (service->type == CONNECTION_PIPE ||
+			service->type == CONNECTION_STDINOUT) {
+		/* if connection uses a pipe then
+		 * shutdown openocd on error */
+		shutdown_openocd = SHUTDOWN_REQUESTED;
+	}
+	remove_connection(service, c);
+	LOG_INFO("dropped '%s' connection", service->name);
+
+	return retval;
+}
+
+#ifdef HAVE_POLL_H
+/* Rebuild the pollfd array, only needed after listeners or connections changed */
+static int server_update_poll_set(void)
+{
+	unsigned int count = 0;
 
-	/* used in select() */
-	fd_set read_fds;
-	int fd_max;
+	for (struct service *s = services; s; s = s->next) {
+		if (s->fd != -1)
+			count++;
+		for (struct connection *c = s->connections; c; c = c->next)
+			count++;
+	}
+
+	if (count > poll_fds_size) {
+		unsigned int size = MAX(count, 2 * poll_fds_size);
+		struct pollfd *fds = realloc(poll_fds, size * sizeof(*fds));
+		if (!fds)
+			return ERROR_FAIL;
+		poll_fds = fds;
+
+		struct poll_entry *entries = realloc(poll_entries, size * sizeof(*entries));
+		if (!entries)
+			return ERROR_FAIL;
+		poll_entries = entries;
+
+		poll_fds_size = size;
+	}
+
+	unsigned int i = 0;
+	for (struct service *s = services; s; s = s->next) {
+		if (s->fd != -1) {
+			poll_fds[i].fd = s->fd;
+			poll_fds[i].events = POLLIN;
+			poll_entries[i].service = s;
+			poll_entries[i].connection = NULL;
+			i++;
+		}
+		for (struct connection *c = s->connections; c; c = c->next) {
+			/* poll() ignores negative file descriptors */
+			poll_fds[i].fd = c->fd;
+			poll_fds[i].events = POLLIN;
+			poll_entries[i].service = s;
+			poll_entries[i].connection = c;
+			i++;
+		}
+	}
+	poll_fds_count = count;
+	poll_set_changed = false;
+
+	return ERROR_OK;
+}
+
+static int server_wait_events(int timeout_ms)
+{
+	if (poll_set_changed && server_update_poll_set() != ERROR_OK) {
+		LOG_ERROR("Out of memory");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	return poll(poll_fds, poll_fds_count, timeout_ms);
+}
+
+static void server_clear_events(void)
+{
+	for (unsigned int i = 0; i < poll_fds_count; i++)
+		poll_fds[i].revents = 0;
+}
+
+static void server_dispatch_events(struct command_context *cmd_ctx)
+{
+	/* Adding or removing a listener or connection invalidates the
+	 * array; fds left unhandled are still readable at the next poll() */
+	for (unsigned int i = 0; i < poll_fds_count && !poll_set_changed; i++) {
+		struct service *service = poll_entries[i].service;
+		struct connection *c = poll_entries[i].connection;
+		bool ready = poll_fds[i].revents & (POLLIN | POLLHUP | POLLERR);
+
+		if (!c) {
+			/* handle new connections on listeners */
+			if (ready)
+				service_accept(service, cmd_ctx);
+		} else if ((c->fd >= 0 && ready) || c->input_pending) {
+			/* handle activity on connections */
+			connection_input(service, c);
+		}
+	}
+}
+#else
+static int server_wait_events(int timeout_ms)
+{
+	/* monitor sockets for activity */
+	int fd_max = 0;
+	FD_ZERO(&read_fds);
+
+	/* add service and connection fds to read_fds */
+	for (struct service *service = services; service; service = service->next) {
+		if (service->fd != -1) {
+			/* listen for new connections */
+			FD_SET(service->fd, &read_fds);
+
+			if (service->fd > fd_max)
+				fd_max = service->fd;
+		}
+
+		for (struct connection *c = service->connections; c; c = c->next) {
+			/* check for activity on the connection */
+			FD_SET(c->fd, &read_fds);
+			if (c->fd > fd_max)
+				fd_max = c->fd;
+		}
+	}
+
+	struct timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = timeout_ms * 1000;
+	return socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+}
+
+static void server_clear_events(void)
+{
+	FD_ZERO(&read_fds);
+}
+
+static void server_dispatch_events(struct command_context *cmd_ctx)
+{
+	for (struct service *service = services; service; service = service->next) {
+		/* handle new connections on listeners */
+		if ((service->fd != -1)
+			&& (FD_ISSET(service->fd, &read_fds)))
+			service_accept(service, cmd_ctx);
+
+		/* handle activity on connections */
+		for (struct connection *c = service->connections; c; ) {
+			if ((c->fd >= 0 && FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
+				struct connection *next = c->next;
+				if (connection_input(service, c) != ERROR_OK) {
+					c = next;
+					continue;
+				}
+			}
+			c = c->next;
+		}
+	}
+}
+#endif
+
+int server_loop(struct command_context *command_context)
+{
+	bool poll_ok = true;
 
-	/* used in accept() */
 	int retval;
 
 	int64_t next_event = timeval_ms() + polling_period;
@@ -440,49 +654,19 @@ int server_loop(struct command_context *command_context)
 #endif
 
 	while (shutdown_openocd == CONTINUE_MAIN_LOOP) {
-		/* monitor sockets for activity */
-		fd_max = 0;
-		FD_ZERO(&read_fds);
-
-		/* add service and connection fds to read_fds */
-		for (service = services; service; service = service->next) {
-			if (service->fd != -1) {
-				/* listen for new connections */
-				FD_SET(service->fd, &read_fds);
-
-				if (service->fd > fd_max)
-					fd_max = service->fd;
-			}
-
-			if (service->connections) {
-				struct connection *c;
-
-				for (c = service->connections; c; c = c->next) {
-					/* check for activity on the connection */
-					FD_SET(c->fd, &read_fds);
-					if (c->fd > fd_max)
-						fd_max = c->fd;
-				}
-			}
-		}
-
-		struct timeval tv;
-		tv.tv_sec = 0;
 		if (poll_ok) {
 			/* we're just polling this iteration, this is faster on embedded
 			 * hosts */
-			tv.tv_usec = 0;
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = server_wait_events(0);
 		} else {
-			/* Timeout socket_select() when a target timer expires or every polling_period */
+			/* Timeout when a target timer expires or every polling_period */
 			int timeout_ms = next_event - timeval_ms();
 			if (timeout_ms < 0)
 				timeout_ms = 0;
 			else if (timeout_ms > polling_period)
 				timeout_ms = polling_period;
-			tv.tv_usec = timeout_ms * 1000;
 			/* Only while we're sleeping we'll let others run */
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+			retval = server_wait_events(timeout_ms);
 		}
 
 		if (retval == -1) {
@@ -491,7 +675,7 @@ int server_loop(struct command_context *command_context)
 			errno = WSAGetLastError();
 
 			if (errno == WSAEINTR)
-				FD_ZERO(&read_fds);
+				server_clear_events();
 			else {
 				LOG_ERROR("error during select: %s", strerror(errno));
 				return ERROR_FAIL;
@@ -499,9 +683,9 @@ int server_loop(struct command_context *command_context)
 #else
 
 			if (errno == EINTR)
-				FD_ZERO(&read_fds);
+				server_clear_events();
 			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
+				LOG_ERROR("error during poll: %s", strerror(errno));
 				return ERROR_FAIL;
 			}
 #endif
@@ -510,14 +694,14 @@ int server_loop(struct command_context *command_context)
 		if (retval == 0) {
 			/* Execute callbacks of expired timers when
 			 * - there was nothing to do if poll_ok was true
-			 * - socket_select() timed out if poll_ok was false, now one or more
+			 * - the wait timed out if poll_ok was false, now one or more
 			 *   timers expired or the polling period elapsed
 			 */
 			target_call_timer_callbacks();
 			next_event = target_timer_next_event();
 			process_jim_events(command_context);
 
-			FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
+			server_clear_events();	/* eCos leaves read_fds unchanged in this case!  */
 
 			/* We timed out/there was nothing to do, timeout rather than poll next time
 			 **/
@@ -534,54 +718,7 @@ int server_loop(struct command_context *command_context)
 		 */
 		poll_ok = poll_ok || target_got_message();
 
-		for (service = services; service; service = service->next) {
-			/* handle new connections on listeners */
-			if ((service->fd != -1)
-				&& (FD_ISSET(service->fd, &read_fds))) {
-				if (service->max_connections != 0)
-					add_connection(service, command_context);
-				else {
-					if (service->type == CONNECTION_TCP) {
-						struct sockaddr_in sin;
-						socklen_t address_size = sizeof(sin);
-						int tmp_fd;
-						tmp_fd = accept(service->fd,
-								(struct sockaddr *)&service->sin,
-								&address_size);
-						close_socket(tmp_fd);
-					}
-					LOG_INFO(
-						"rejected '%s' connection, no more connections allowed",
-						service->name);
-				}
-			}
-
-			/* handle activity on connections */
-			if (service->connections) {
-				struct connection *c;
-
-				for (c = service->connections; c; ) {
-					if ((c->fd >= 0 && FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
-						retval = service->input(c);
-						if (retval != ERROR_OK) {
-							struct connection *next = c->next;
-							if (service->type == CONNECTION_PIPE ||
-									service->type == CONNECTION_STDINOUT) {
-								/* if connection uses a pipe then
-								 * shutdown openocd on error */
-								shutdown_openocd = SHUTDOWN_REQUESTED;
-							}
-							remove_connection(service, c);
-							LOG_INFO("dropped '%s' connection",
-								service->name);
-							c = next;
-							continue;
-						}
-					}
-					c = c->next;
-				}
-			}
-		}
+		server_dispatch_events(command_context);
 
 #ifdef _WIN32
 		MSG msg;
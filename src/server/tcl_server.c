@@ -17,6 +17,35 @@
 #define TCL_LINE_INITIAL		(4*1024)
 #define TCL_LINE_MAX			(4*1024*1024)
 
+/*
+ * Binary RPC framing, enabled per connection by 'tcl_binary_rpc'.
+ * All numbers are little endian. Each request is
+ *	u32 length of the rest, u32 id, u8 type, payload
+ * and gets one reply, in request order,
+ *	u32 length of the rest, u32 id, u8 status, payload
+ * Asynchronous notifications are sent as replies with id 0 and status
+ * TCL_RPC_NOTIFICATION, their payload being the text otherwise sent.
+ */
+#define TCL_RPC_HEADER_SIZE		9
+#define TCL_RPC_FRAME_MAX		(TCL_LINE_MAX + 16)
+
+enum tcl_rpc_request {
+	/* payload: Tcl command line; reply: command result */
+	TCL_RPC_COMMAND = 'c',
+	/* payload: u64 address, u32 byte count, u8 access width in bytes;
+	 * reply: the memory content, in target byte order */
+	TCL_RPC_READ_MEMORY = 'r',
+	/* payload: u64 address, u8 access width in bytes, the data */
+	TCL_RPC_WRITE_MEMORY = 'w',
+};
+
+enum tcl_rpc_status {
+	TCL_RPC_OK = 0,
+	/* payload: error message */
+	TCL_RPC_ERROR = 1,
+	TCL_RPC_NOTIFICATION = 2,
+};
+
 struct tcl_connection {
 	int tc_linedrop;
 	int tc_lineoffset;
@@ -26,6 +55,8 @@ struct tcl_connection {
 	enum target_state tc_laststate;
 	bool tc_notify;
 	bool tc_trace;
+	/* requests use the binary framing, tc_line holds the frames */
+	bool tc_binary;
 };
 
 static char *tcl_port;
@@ -35,6 +66,7 @@ static int tcl_new_connection(struct connection *connection);
 static int tcl_input(struct connection *connection);
 static int tcl_output(struct connection *connection, const void *buf, ssize_t len);
 static int tcl_closed(struct connection *connection);
+static int tcl_output_notification(struct connection *connection, const char *buf);
 
 static int tcl_target_callback_event_handler(struct target *target,
 		enum target_event event, void *priv)
@@ -47,14 +79,14 @@ static int tcl_target_callback_event_handler(struct target *target,
 
 	if (tclc->tc_notify) {
 		snprintf(buf, sizeof(buf), "type target_event event %s\r\n\x1a", target_event_name(event));
-		tcl_output(connection, buf, strlen(buf));
+		tcl_output_notification(connection, buf);
 	}
 
 	if (tclc->tc_laststate != target->state) {
 		tclc->tc_laststate = target->state;
 		if (tclc->tc_notify) {
 			snprintf(buf, sizeof(buf), "type target_state state %s\r\n\x1a", target_state_name(target));
-			tcl_output(connection, buf, strlen(buf));
+			tcl_output_notification(connection, buf);
 		}
 	}
 
@@ -72,7 +104,7 @@ static int tcl_target_callback_reset_handler(struct target *target,
 
 	if (tclc->tc_notify) {
 		snprintf(buf, sizeof(buf), "type target_reset mode %s\r\n\x1a", target_reset_mode_name(reset_mode));
-		tcl_output(connection, buf, strlen(buf));
+		tcl_output_notification(connection, buf);
 	}
 
 	return ERROR_OK;
@@ -96,7 +128,7 @@ static int tcl_target_callback_trace_handler(struct target *target,
 		buf = malloc(max_len);
 		hexify(hex, data, len, hex_len);
 		snprintf(buf, max_len, "%s%s%s", header, hex, trailer);
-		tcl_output(connection, buf, strlen(buf));
+		tcl_output_notification(connection, buf);
 		free(hex);
 		free(buf);
 	}
@@ -128,6 +160,186 @@ int tcl_output(struct connection *connection, const void *data, ssize_t len)
 	return ERROR_SERVER_REMOTE_CLOSED;
 }
 
+/* send one reply frame, the payload being split in two parts */
+static int tcl_rpc_reply(struct connection *connection, uint32_t id, enum tcl_rpc_status status,
+		const void *data, size_t len, const void *data2, size_t len2)
+{
+	uint8_t header[TCL_RPC_HEADER_SIZE];
+
+	h_u32_to_le(header, 5 + len + len2);
+	h_u32_to_le(header + 4, id);
+	header[8] = status;
+
+	int retval = tcl_output(connection, header, sizeof(header));
+	if (retval == ERROR_OK && len)
+		retval = tcl_output(connection, data, len);
+	if (retval == ERROR_OK && len2)
+		retval = tcl_output(connection, data2, len2);
+	return retval;
+}
+
+/* send a notification, terminated by ctrl-z, framed in binary mode */
+static int tcl_output_notification(struct connection *connection, const char *buf)
+{
+	struct tcl_connection *tclc = connection->priv;
+	size_t len = strlen(buf);
+
+	if (!tclc->tc_binary)
+		return tcl_output(connection, buf, len);
+
+	return tcl_rpc_reply(connection, 0, TCL_RPC_NOTIFICATION, buf, len - 1, NULL, 0);
+}
+
+static int tcl_rpc_error(struct connection *connection, uint32_t id, const char *msg)
+{
+	return tcl_rpc_reply(connection, id, TCL_RPC_ERROR, msg, strlen(msg), NULL, 0);
+}
+
+static int tcl_rpc_command(struct connection *connection, uint32_t id,
+		const uint8_t *payload, uint32_t len)
+{
+	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
+	const char *result;
+	int reslen;
+
+	char *line = strndup((const char *)payload, len);
+	if (!line)
+		return tcl_rpc_error(connection, id, "out of memory");
+
+	int retval = command_run_line(connection->cmd_ctx, line);
+	free(line);
+
+	result = Jim_GetString(Jim_GetResult(interp), &reslen);
+	return tcl_rpc_reply(connection, id, retval == ERROR_OK ? TCL_RPC_OK : TCL_RPC_ERROR,
+		result, reslen, NULL, 0);
+}
+
+static int tcl_rpc_memory(struct connection *connection, uint32_t id, uint8_t type,
+		const uint8_t *payload, uint32_t len)
+{
+	struct target *target = get_current_target_or_null(connection->cmd_ctx);
+	uint64_t address;
+	uint32_t count;
+	unsigned int width;
+	const uint8_t *data = NULL;
+
+	if (type == TCL_RPC_READ_MEMORY && len == 13) {
+		address = le_to_h_u64(payload);
+		count = le_to_h_u32(payload + 8);
+		width = payload[12];
+	} else if (type == TCL_RPC_WRITE_MEMORY && len >= 9) {
+		address = le_to_h_u64(payload);
+		width = payload[8];
+		data = payload + 9;
+		count = len - 9;
+	} else {
+		return tcl_rpc_error(connection, id, "malformed memory request");
+	}
+
+	if (!target)
+		return tcl_rpc_error(connection, id, "no current target");
+	if ((width != 1 && width != 2 && width != 4 && width != 8) || count % width)
+		return tcl_rpc_error(connection, id, "invalid access width");
+	if (count > TCL_LINE_MAX)
+		return tcl_rpc_error(connection, id, "count too large");
+
+	if (data) {
+		if (target_write_memory(target, address, width, count / width, data) != ERROR_OK)
+			return tcl_rpc_error(connection, id, "write_memory failed");
+		return tcl_rpc_reply(connection, id, TCL_RPC_OK, NULL, 0, NULL, 0);
+	}
+
+	uint8_t *buffer = malloc(count);
+	if (!buffer)
+		return tcl_rpc_error(connection, id, "out of memory");
+
+	int retval;
+	if (target_read_memory(target, address, width, count / width, buffer) != ERROR_OK)
+		retval = tcl_rpc_error(connection, id, "read_memory failed");
+	else
+		retval = tcl_rpc_reply(connection, id, TCL_RPC_OK, buffer, count, NULL, 0);
+	free(buffer);
+	return retval;
+}
+
+/* handle all the complete frames received, keep the incomplete one */
+static int tcl_rpc_process(struct connection *connection)
+{
+	struct tcl_connection *tclc = connection->priv;
+	uint8_t *buf = (uint8_t *)tclc->tc_line;
+	int start = 0;
+	int retval = ERROR_OK;
+
+	while (retval == ERROR_OK && tclc->tc_lineoffset - start >= 4) {
+		uint32_t len = le_to_h_u32(buf + start);
+		if (len < TCL_RPC_HEADER_SIZE - 4 || len > TCL_RPC_FRAME_MAX - 4) {
+			LOG_ERROR("tcl: invalid binary RPC frame length %" PRIu32, len);
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+
+		if ((uint32_t)(tclc->tc_lineoffset - start) < 4 + len) {
+			/* make room for the rest of the frame */
+			if ((int)(4 + len) > tclc->tc_line_size) {
+				char *tc_line_new = realloc(tclc->tc_line, 4 + len);
+				if (!tc_line_new)
+					return ERROR_SERVER_REMOTE_CLOSED;
+				tclc->tc_line = tc_line_new;
+				tclc->tc_line_size = 4 + len;
+				buf = (uint8_t *)tc_line_new;
+			}
+			break;
+		}
+
+		uint32_t id = le_to_h_u32(buf + start + 4);
+		uint8_t type = buf[start + 8];
+		const uint8_t *payload = buf + start + TCL_RPC_HEADER_SIZE;
+		uint32_t payload_len = len - (TCL_RPC_HEADER_SIZE - 4);
+		start += 4 + len;
+
+		switch (type) {
+		case TCL_RPC_COMMAND:
+			retval = tcl_rpc_command(connection, id, payload, payload_len);
+			break;
+		case TCL_RPC_READ_MEMORY:
+		case TCL_RPC_WRITE_MEMORY:
+			retval = tcl_rpc_memory(connection, id, type, payload, payload_len);
+			break;
+		default:
+			retval = tcl_rpc_error(connection, id, "unknown request type");
+			break;
+		}
+	}
+
+	memmove(buf, buf + start, tclc->tc_lineoffset - start);
+	tclc->tc_lineoffset -= start;
+	return retval;
+}
+
+static int tcl_rpc_input(struct connection *connection)
+{
+	struct tcl_connection *tclc = connection->priv;
+
+	/* tcl_rpc_process() left room for at least the next frame header */
+	if (tclc->tc_lineoffset == tclc->tc_line_size) {
+		char *tc_line_new = realloc(tclc->tc_line, tclc->tc_line_size * 2);
+		if (!tc_line_new)
+			return ERROR_SERVER_REMOTE_CLOSED;
+		tclc->tc_line = tc_line_new;
+		tclc->tc_line_size *= 2;
+	}
+
+	ssize_t rlen = connection_read(connection, tclc->tc_line + tclc->tc_lineoffset,
+		tclc->tc_line_size - tclc->tc_lineoffset);
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+	tclc->tc_lineoffset += rlen;
+
+	return tcl_rpc_process(connection);
+}
+
 /* connections */
 static int tcl_new_connection(struct connection *connection)
 {
@@ -173,6 +385,13 @@ static int tcl_input(struct connection *connection)
 	char *tc_line_new;
 	int tc_line_size_new;
 
+	tclc = connection->priv;
+	if (!tclc)
+		return ERROR_CONNECTION_REJECTED;
+
+	if (tclc->tc_binary)
+		return tcl_rpc_input(connection);
+
 	rlen = connection_read(connection, &in, sizeof(in));
 	if (rlen <= 0) {
 		if (rlen < 0)
@@ -180,10 +399,6 @@ static int tcl_input(struct connection *connection)
 		return ERROR_SERVER_REMOTE_CLOSED;
 	}
 
-	tclc = connection->priv;
-	if (!tclc)
-		return ERROR_CONNECTION_REJECTED;
-
 	/* push as much data into the line as possible */
 	for (i = 0; i < rlen; i++) {
 		/* buffer the data */
@@ -241,6 +456,21 @@ static int tcl_input(struct connection *connection)
 
 		tclc->tc_lineoffset = 0;
 		tclc->tc_linedrop = 0;
+
+		/* 'tcl_binary_rpc' was run, the rest of the data is framed */
+		if (tclc->tc_binary) {
+			int len = rlen - i - 1;
+			if (len > tclc->tc_line_size) {
+				tc_line_new = realloc(tclc->tc_line, len);
+				if (!tc_line_new)
+					return ERROR_SERVER_REMOTE_CLOSED;
+				tclc->tc_line = tc_line_new;
+				tclc->tc_line_size = len;
+			}
+			memcpy(tclc->tc_line, in + i + 1, len);
+			tclc->tc_lineoffset = len;
+			return tcl_rpc_process(connection);
+		}
 	}
 
 	return ERROR_OK;
@@ -323,6 +553,23 @@ COMMAND_HANDLER(handle_tcl_trace_command)
 	}
 }
 
+COMMAND_HANDLER(handle_tcl_binary_rpc_command)
+{
+	struct connection *connection = CMD_CTX->output_handler_priv;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!connection || strcmp(connection->service->name, "tcl")) {
+		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
+		return ERROR_FAIL;
+	}
+
+	struct tcl_connection *tclc = connection->priv;
+	tclc->tc_binary = true;
+	return ERROR_OK;
+}
+
 static const struct command_registration tcl_command_handlers[] = {
 	{
 		.name = "tcl_port",
@@ -347,6 +594,13 @@ static const struct command_registration tcl_command_handlers[] = {
 		.help = "Target trace output",
 		.usage = "[on|off]",
 	},
+	{
+		.name = "tcl_binary_rpc",
+		.handler = handle_tcl_binary_rpc_command,
+		.mode = COMMAND_EXEC,
+		.help = "Switch the current Tcl RPC connection to binary framing",
+		.usage = "",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
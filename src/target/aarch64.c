@@ -321,32 +321,110 @@ static int aarch64_wait_halt_one(struct target *target)
 	return retval;
 }
 
-static int aarch64_prepare_halt_smp(struct target *target, bool exc_target, struct target **p_first)
+/*
+ * List the examined PEs of the SMP group of target, optionally without
+ * target itself and only those in the given state (TARGET_UNKNOWN for any).
+ * Returns NULL if out of memory.
+ */
+static struct target **aarch64_smp_list(struct target *target, bool exc_target,
+		enum target_state state, unsigned int *count)
 {
-	int retval = ERROR_OK;
 	struct target_list *head;
-	struct target *first = NULL;
+	unsigned int num = 0;
 
-	LOG_DEBUG("target %s exc %i", target_name(target), exc_target);
+	*count = 0;
+	foreach_smp_target(head, target->smp_targets)
+		num++;
+
+	struct target **list = calloc(num ? num : 1, sizeof(*list));
+	if (!list)
+		return NULL;
 
 	foreach_smp_target(head, target->smp_targets) {
 		struct target *curr = head->target;
-		struct armv8_common *armv8 = target_to_armv8(curr);
 
 		if (exc_target && curr == target)
 			continue;
 		if (!target_was_examined(curr))
 			continue;
-		if (curr->state != TARGET_RUNNING)
+		if (state != TARGET_UNKNOWN && curr->state != state)
 			continue;
+		list[(*count)++] = curr;
+	}
+
+	return list;
+}
+
+/* Run once each DAP of the PEs in list, even after an error to flush the queues */
+static int aarch64_run_smp(struct target **list, unsigned int count, int retval)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		struct adiv5_dap *dap = target_to_armv8(list[i])->debug_ap->dap;
+		bool done = false;
+
+		for (unsigned int j = 0; j < i && !done; j++)
+			done = target_to_armv8(list[j])->debug_ap->dap == dap;
+		if (done)
+			continue;
+
+		int run_retval = dap_run(dap);
+		if (retval == ERROR_OK)
+			retval = run_retval;
+	}
+
+	return retval;
+}
+
+/*
+ * Read the same debug register of several PEs. All the reads are queued
+ * before running each DAP involved once, rather than one DAP run per PE.
+ */
+static int aarch64_read_dbgreg_smp(struct target **list, unsigned int count,
+		unsigned int reg, uint32_t *values)
+{
+	int retval = ERROR_OK;
+
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; i++) {
+		struct armv8_common *armv8 = target_to_armv8(list[i]);
+		retval = mem_ap_read_u32(armv8->debug_ap, armv8->debug_base + reg, &values[i]);
+	}
+
+	return aarch64_run_smp(list, count, retval);
+}
+
+static int aarch64_prepare_halt_smp(struct target *target, bool exc_target, struct target **p_first)
+{
+	int retval = ERROR_OK;
+	struct target *first = NULL;
+	unsigned int count;
+
+	LOG_DEBUG("target %s exc %i", target_name(target), exc_target);
+
+	struct target **list = aarch64_smp_list(target, exc_target, TARGET_RUNNING, &count);
+	uint32_t *dscr = calloc(count ? count : 1, sizeof(*dscr));
+	if (!list || !dscr) {
+		free(list);
+		free(dscr);
+		return ERROR_FAIL;
+	}
+
+	/* read DSCR of all the PEs at once */
+	retval = aarch64_read_dbgreg_smp(list, count, CPUV8_DBG_DSCR, dscr);
+
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; i++) {
+		struct target *curr = list[i];
+		struct armv8_common *armv8 = target_to_armv8(curr);
 
 		/* HACK: mark this target as prepared for halting */
 		curr->debug_reason = DBG_REASON_DBGRQ;
 
 		/* open the gate for channel 0 to let HALT requests pass to the CTM */
 		retval = arm_cti_ungate_channel(armv8->cti, 0);
+
+		/* allow Halting Debug Mode, queued for all the PEs */
 		if (retval == ERROR_OK)
-			retval = aarch64_set_dscr_bits(curr, DSCR_HDE, DSCR_HDE);
+			retval = mem_ap_write_u32(armv8->debug_ap,
+					armv8->debug_base + CPUV8_DBG_DSCR, dscr[i] | DSCR_HDE);
 		if (retval != ERROR_OK)
 			break;
 
@@ -355,6 +433,10 @@ static int aarch64_prepare_halt_smp(struct target *target, bool exc_target, stru
 		if (!first)
 			first = curr;
 	}
+	retval = aarch64_run_smp(list, count, retval);
+
+	free(dscr);
+	free(list);
 
 	if (p_first) {
 		if (exc_target && first)
@@ -399,6 +481,7 @@ static int aarch64_halt_smp(struct target *target, bool exc_target)
 {
 	struct target *next = target;
 	int retval;
+	int64_t start = timeval_ms();
 
 	/* prepare halt on all PEs of the group */
 	retval = aarch64_prepare_halt_smp(target, exc_target, &next);
@@ -413,30 +496,34 @@ static int aarch64_halt_smp(struct target *target, bool exc_target)
 	if (retval != ERROR_OK)
 		return retval;
 
-	/* wait for all PEs to halt */
+	unsigned int count;
+	struct target **list = aarch64_smp_list(target, false, TARGET_UNKNOWN, &count);
+	uint32_t *prsr = calloc(count ? count : 1, sizeof(*prsr));
+	if (!list || !prsr) {
+		free(list);
+		free(prsr);
+		return ERROR_FAIL;
+	}
+
+	/* wait for all PEs to halt, checking all of them in one batch */
 	int64_t then = timeval_ms();
 	for (;;) {
-		bool all_halted = true;
-		struct target_list *head;
-		struct target *curr;
-
-		foreach_smp_target(head, target->smp_targets) {
-			int halted;
+		struct target *curr = NULL;
 
-			curr = head->target;
-
-			if (!target_was_examined(curr))
-				continue;
+		retval = aarch64_read_dbgreg_smp(list, count, CPUV8_DBG_PRSR, prsr);
+		if (retval != ERROR_OK)
+			break;
 
-			retval = aarch64_check_state_one(curr, PRSR_HALT, PRSR_HALT, &halted, NULL);
-			if (retval != ERROR_OK || !halted) {
-				all_halted = false;
-				break;
-			}
+		for (unsigned int i = 0; i < count && !curr; i++) {
+			if (!(prsr[i] & PRSR_HALT))
+				curr = list[i];
 		}
 
-		if (all_halted)
+		if (!curr) {
+			LOG_DEBUG("SMP group of %s halted in %" PRId64 " ms",
+				target_name(target), timeval_ms() - start);
 			break;
+		}
 
 		if (timeval_ms() > then + 1000) {
 			retval = ERROR_TARGET_TIMEOUT;
@@ -455,6 +542,8 @@ static int aarch64_halt_smp(struct target *target, bool exc_target)
 			break;
 	}
 
+	free(prsr);
+	free(list);
 	return retval;
 }
 
@@ -463,6 +552,7 @@ static int update_halt_gdb(struct target *target, enum target_debug_reason debug
 	struct target *gdb_target = NULL;
 	struct target_list *head;
 	struct target *curr;
+	int64_t start = timeval_ms();
 
 	if (debug_reason == DBG_REASON_NOTHALTED) {
 		LOG_DEBUG("Halting remaining targets in SMP group");
@@ -497,6 +587,9 @@ static int update_halt_gdb(struct target *target, enum target_debug_reason debug
 	if (gdb_target && gdb_target != target)
 		aarch64_poll(gdb_target);
 
+	LOG_DEBUG("SMP group of %s stopped and its context saved in %" PRId64 " ms",
+		target_name(target), timeval_ms() - start);
+
 	return ERROR_OK;
 }
 
@@ -766,64 +859,50 @@ static int aarch64_prep_restart_smp(struct target *target, int handle_breakpoint
 }
 
 
-static int aarch64_step_restart_smp(struct target *target)
+/* Wait for the PEs of the SMP group, but target, to leave debug state */
+static int aarch64_wait_resume_smp(struct target *target)
 {
-	int retval = ERROR_OK;
-	struct target_list *head;
-	struct target *first = NULL;
-
-	LOG_DEBUG("%s", target_name(target));
-
-	retval = aarch64_prep_restart_smp(target, 0, &first);
-	if (retval != ERROR_OK)
-		return retval;
+	unsigned int count;
+	struct target **list = aarch64_smp_list(target, true, TARGET_UNKNOWN, &count);
+	uint32_t *prsr = calloc(count ? count : 1, sizeof(*prsr));
+	int retval;
 
-	if (first)
-		retval = aarch64_do_restart_one(first, RESTART_LAZY);
-	if (retval != ERROR_OK) {
-		LOG_DEBUG("error restarting target %s", target_name(first));
-		return retval;
+	if (!list || !prsr) {
+		free(list);
+		free(prsr);
+		return ERROR_FAIL;
 	}
 
 	int64_t then = timeval_ms();
 	for (;;) {
-		struct target *curr = target;
-		bool all_resumed = true;
-
-		foreach_smp_target(head, target->smp_targets) {
-			uint32_t prsr;
-			int resumed;
-
-			curr = head->target;
+		struct target *curr = NULL;
 
-			if (curr == target)
-				continue;
-
-			if (!target_was_examined(curr))
-				continue;
+		retval = aarch64_read_dbgreg_smp(list, count, CPUV8_DBG_PRSR, prsr);
+		if (retval != ERROR_OK)
+			break;
 
-			retval = aarch64_check_state_one(curr,
-					PRSR_SDR, PRSR_SDR, &resumed, &prsr);
-			if (retval != ERROR_OK || (!resumed && (prsr & PRSR_HALT))) {
-				all_resumed = false;
+		for (unsigned int i = 0; i < count; i++) {
+			if (!(prsr[i] & PRSR_SDR) && (prsr[i] & PRSR_HALT)) {
+				curr = list[i];
 				break;
 			}
 
-			if (curr->state != TARGET_RUNNING) {
-				curr->state = TARGET_RUNNING;
-				curr->debug_reason = DBG_REASON_NOTHALTED;
-				target_call_event_callbacks(curr, TARGET_EVENT_RESUMED);
+			if (list[i]->state != TARGET_RUNNING) {
+				list[i]->state = TARGET_RUNNING;
+				list[i]->debug_reason = DBG_REASON_NOTHALTED;
+				target_call_event_callbacks(list[i], TARGET_EVENT_RESUMED);
 			}
 		}
 
-		if (all_resumed)
+		if (!curr)
 			break;
 
 		if (timeval_ms() > then + 1000) {
-			LOG_ERROR("%s: timeout waiting for target resume", __func__);
+			LOG_ERROR("%s: timeout waiting for target %s to resume", __func__, target_name(curr));
 			retval = ERROR_TARGET_TIMEOUT;
 			break;
 		}
+
 		/*
 		 * HACK: on Hi6220 there are 8 cores organized in 2 clusters
 		 * and it looks like the CTI's are not connected by a common
@@ -834,11 +913,34 @@ static int aarch64_step_restart_smp(struct target *target)
 		retval = aarch64_do_restart_one(curr, RESTART_LAZY);
 		if (retval != ERROR_OK)
 			break;
-}
+	}
 
+	free(prsr);
+	free(list);
 	return retval;
 }
 
+static int aarch64_step_restart_smp(struct target *target)
+{
+	int retval = ERROR_OK;
+	struct target *first = NULL;
+
+	LOG_DEBUG("%s", target_name(target));
+
+	retval = aarch64_prep_restart_smp(target, 0, &first);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (first)
+		retval = aarch64_do_restart_one(first, RESTART_LAZY);
+	if (retval != ERROR_OK) {
+		LOG_DEBUG("error restarting target %s", target_name(first));
+		return retval;
+	}
+
+	return aarch64_wait_resume_smp(target);
+}
+
 static int aarch64_resume(struct target *target, int current,
 	target_addr_t address, int handle_breakpoints, int debug_execution)
 {
@@ -873,58 +975,8 @@ static int aarch64_resume(struct target *target, int current,
 	if (retval != ERROR_OK)
 		return retval;
 
-	if (target->smp) {
-		int64_t then = timeval_ms();
-		for (;;) {
-			struct target *curr = target;
-			struct target_list *head;
-			bool all_resumed = true;
-
-			foreach_smp_target(head, target->smp_targets) {
-				uint32_t prsr;
-				int resumed;
-
-				curr = head->target;
-				if (curr == target)
-					continue;
-				if (!target_was_examined(curr))
-					continue;
-
-				retval = aarch64_check_state_one(curr,
-						PRSR_SDR, PRSR_SDR, &resumed, &prsr);
-				if (retval != ERROR_OK || (!resumed && (prsr & PRSR_HALT))) {
-					all_resumed = false;
-					break;
-				}
-
-				if (curr->state != TARGET_RUNNING) {
-					curr->state = TARGET_RUNNING;
-					curr->debug_reason = DBG_REASON_NOTHALTED;
-					target_call_event_callbacks(curr, TARGET_EVENT_RESUMED);
-				}
-			}
-
-			if (all_resumed)
-				break;
-
-			if (timeval_ms() > then + 1000) {
-				LOG_ERROR("%s: timeout waiting for target %s to resume", __func__, target_name(curr));
-				retval = ERROR_TARGET_TIMEOUT;
-				break;
-			}
-
-			/*
-			 * HACK: on Hi6220 there are 8 cores organized in 2 clusters
-			 * and it looks like the CTI's are not connected by a common
-			 * trigger matrix. It seems that we need to halt one core in each
-			 * cluster explicitly. So if we find that a core has not halted
-			 * yet, we trigger an explicit resume for the second cluster.
-			 */
-			retval = aarch64_do_restart_one(curr, RESTART_LAZY);
-			if (retval != ERROR_OK)
-				break;
-		}
-	}
+	if (target->smp)
+		retval = aarch64_wait_resume_smp(target);
 
 	if (retval != ERROR_OK)
 		return retval;
@@ -39,6 +39,7 @@
 #include <helper/time_support.h>
 
 #include <transport/transport.h>
+#include <jtag/adapter.h>
 #include <jtag/interface.h>
 
 #include <jtag/swd.h>
@@ -54,6 +55,23 @@ static bool swd_multidrop_in_swd_state;
 static int swd_queue_dp_write_inner(struct adiv5_dap *dap, unsigned int reg,
 		uint32_t data);
 
+/* transfers queued since the last run, for 'adapter stats' */
+static unsigned int swd_queued_transfers;
+
+static void swd_read_reg(const struct swd_driver *swd, uint8_t cmd,
+		uint32_t *value, uint32_t ap_delay_clk)
+{
+	swd_queued_transfers++;
+	swd->read_reg(cmd, value, ap_delay_clk);
+}
+
+static void swd_write_reg(const struct swd_driver *swd, uint8_t cmd,
+		uint32_t value, uint32_t ap_delay_clk)
+{
+	swd_queued_transfers++;
+	swd->write_reg(cmd, value, ap_delay_clk);
+}
+
 
 static int swd_send_sequence(struct adiv5_dap *dap, enum swd_special_seq seq)
 {
@@ -67,7 +85,7 @@ static void swd_finish_read(struct adiv5_dap *dap)
 {
 	const struct swd_driver *swd = adiv5_dap_swd_driver(dap);
 	if (dap->last_read) {
-		swd->read_reg(swd_cmd(true, false, DP_RDBUFF), dap->last_read, 0);
+		swd_read_reg(swd, swd_cmd(true, false, DP_RDBUFF), dap->last_read, 0);
 		dap->last_read = NULL;
 	}
 }
@@ -77,15 +95,21 @@ static void swd_clear_sticky_errors(struct adiv5_dap *dap)
 	const struct swd_driver *swd = adiv5_dap_swd_driver(dap);
 	assert(swd);
 
-	swd->write_reg(swd_cmd(false, false, DP_ABORT),
+	swd_write_reg(swd, swd_cmd(false, false, DP_ABORT),
 		STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR, 0);
 }
 
 static int swd_run_inner(struct adiv5_dap *dap)
 {
 	const struct swd_driver *swd = adiv5_dap_swd_driver(dap);
+	struct duration duration;
 
-	return swd->run();
+	duration_start(&duration);
+	int retval = swd->run();
+	adapter_stats_add(ADAPTER_STATS_SWD_RUN, swd_queued_transfers, &duration);
+	swd_queued_transfers = 0;
+
+	return retval;
 }
 
 static inline int check_sync(struct adiv5_dap *dap)
@@ -129,7 +153,7 @@ static int swd_queue_dp_read_inner(struct adiv5_dap *dap, unsigned int reg,
 	if (retval != ERROR_OK)
 		return retval;
 
-	swd->read_reg(swd_cmd(true, false, reg), data, 0);
+	swd_read_reg(swd, swd_cmd(true, false, reg), data, 0);
 
 	return check_sync(dap);
 }
@@ -146,7 +170,7 @@ static int swd_queue_dp_write_inner(struct adiv5_dap *dap, unsigned int reg,
 	if (reg == DP_SELECT) {
 		dap->select = data | (dap->select & (0xffffffffull << 32));
 
-		swd->write_reg(swd_cmd(false, false, reg), data, 0);
+		swd_write_reg(swd, swd_cmd(false, false, reg), data, 0);
 
 		retval = check_sync(dap);
 		dap->select_valid = (retval == ERROR_OK);
@@ -164,7 +188,7 @@ static int swd_queue_dp_write_inner(struct adiv5_dap *dap, unsigned int reg,
 		retval = swd_queue_dp_bankselect(dap, reg);
 
 	if (retval == ERROR_OK) {
-		swd->write_reg(swd_cmd(false, false, reg), data, 0);
+		swd_write_reg(swd, swd_cmd(false, false, reg), data, 0);
 
 		retval = check_sync(dap);
 	}
@@ -480,7 +504,7 @@ static int swd_queue_ap_abort(struct adiv5_dap *dap, uint8_t *ack)
 	if (retval != ERROR_OK)
 		return retval;
 
-	swd->write_reg(swd_cmd(false, false, DP_ABORT),
+	swd_write_reg(swd, swd_cmd(false, false, DP_ABORT),
 		DAPABORT | STKCMPCLR | STKERRCLR | WDERRCLR | ORUNERRCLR, 0);
 	return check_sync(dap);
 }
@@ -586,7 +610,7 @@ static int swd_queue_ap_read(struct adiv5_ap *ap, unsigned reg,
 	if (retval != ERROR_OK)
 		return retval;
 
-	swd->read_reg(swd_cmd(true, true, reg), dap->last_read, ap->memaccess_tck);
+	swd_read_reg(swd, swd_cmd(true, true, reg), dap->last_read, ap->memaccess_tck);
 	dap->last_read = data;
 
 	return check_sync(dap);
@@ -613,7 +637,7 @@ static int swd_queue_ap_write(struct adiv5_ap *ap, unsigned reg,
 	if (retval != ERROR_OK)
 		return retval;
 
-	swd->write_reg(swd_cmd(false, true, reg), data, ap->memaccess_tck);
+	swd_write_reg(swd, swd_cmd(false, true, reg), data, ap->memaccess_tck);
 
 	return check_sync(dap);
 }
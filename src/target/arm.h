@@ -225,6 +225,11 @@ struct arm {
 	int (*write_core_reg)(struct target *target, struct reg *reg,
 			int num, enum arm_mode mode, uint8_t *value);
 
+	/** Optional. Retrieve several core registers in one batch, as done by
+	 * reg_arch_type::get_many. Registers of other targets are skipped. */
+	int (*read_core_regs)(struct target *target, struct reg **reg_list,
+			unsigned int count);
+
 	/** Read coprocessor register.  */
 	int (*mrc)(struct target *target, int cpnum,
 			uint32_t op1, uint32_t op2,
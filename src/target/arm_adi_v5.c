@@ -62,6 +62,7 @@
 #include "config.h"
 #endif
 
+#include "jtag/adapter.h"
 #include "jtag/interface.h"
 #include "arm.h"
 #include "arm_adi_v5.h"
@@ -91,6 +92,24 @@ static uint32_t max_tar_block_size(uint32_t tar_autoincr_block, target_addr_t ad
  *                                                                         *
 ***************************************************************************/
 
+/* documented in arm_adi_v5.h, also times the round trip for 'adapter stats' */
+int dap_run(struct adiv5_dap *dap)
+{
+	struct duration duration;
+
+	assert(dap->ops);
+	if (dap->num_pending_reads) {
+		int retval = dap_issue_pending_reads(dap);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+	duration_start(&duration);
+	int retval = dap->ops->run(dap);
+	adapter_stats_add(ADAPTER_STATS_DAP_RUN, 0, &duration);
+
+	return retval;
+}
+
 static int mem_ap_setup_csw(struct adiv5_ap *ap, uint32_t csw)
 {
 	csw |= ap->csw_default;
@@ -223,6 +242,65 @@ static int mem_ap_setup_transfer(struct adiv5_ap *ap, uint32_t csw, target_addr_
 	return ERROR_OK;
 }
 
+/* Issue the held back reads, all reads from one 16 byte block of an AP
+ * behind the first of them, so they share a single TAR write. */
+int dap_issue_pending_reads(struct adiv5_dap *dap)
+{
+	struct dap_pending_read reads[DAP_MAX_PENDING_READS];
+	bool issued[DAP_MAX_PENDING_READS] = { false };
+	unsigned int num = dap->num_pending_reads;
+	unsigned int tar_writes = 0;
+	unsigned int tar_writes_in_order = 0;
+
+	memcpy(reads, dap->pending_reads, num * sizeof(*reads));
+	dap->num_pending_reads = 0;
+
+	/* TAR writes issuing the reads in their original order would take */
+	for (unsigned int i = 0; i < num; i++) {
+		struct adiv5_ap *ap = reads[i].ap;
+		target_addr_t block = reads[i].address & ~0xfull;
+		bool tar_match = ap->tar_valid && ap->tar_value == block;
+		for (unsigned int j = i; j-- > 0;) {
+			if (reads[j].ap == ap) {
+				tar_match = (reads[j].address & ~0xfull) == block;
+				break;
+			}
+		}
+		if (!tar_match)
+			tar_writes_in_order++;
+	}
+
+	for (unsigned int i = 0; i < num; i++) {
+		if (issued[i])
+			continue;
+
+		struct adiv5_ap *ap = reads[i].ap;
+		target_addr_t block = reads[i].address & ~0xfull;
+		if (!ap->tar_valid || ap->tar_value != block)
+			tar_writes++;
+
+		int retval = mem_ap_setup_transfer(ap,
+				CSW_32BIT | (ap->csw_value & CSW_ADDRINC_MASK), block);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (unsigned int j = i; j < num; j++) {
+			if (issued[j] || reads[j].ap != ap || (reads[j].address & ~0xfull) != block)
+				continue;
+			retval = dap_queue_ap_read(ap, MEM_AP_REG_BD0(dap) | (reads[j].address & 0xC),
+					reads[j].value);
+			if (retval != ERROR_OK)
+				return retval;
+			issued[j] = true;
+		}
+	}
+
+	if (tar_writes_in_order > tar_writes)
+		dap->coalesce_saved += tar_writes_in_order - tar_writes;
+
+	return ERROR_OK;
+}
+
 /**
  * Asynchronous (queued) read of a word from memory or a system register.
  *
@@ -238,6 +316,21 @@ int mem_ap_read_u32(struct adiv5_ap *ap, target_addr_t address,
 		uint32_t *value)
 {
 	int retval;
+	struct adiv5_dap *dap = ap->dap;
+
+	if (dap->coalesce_reads) {
+		if (dap->num_pending_reads == DAP_MAX_PENDING_READS) {
+			retval = dap_issue_pending_reads(dap);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		dap->pending_reads[dap->num_pending_reads++] = (struct dap_pending_read){
+			.ap = ap,
+			.address = address,
+			.value = value,
+		};
+		return ERROR_OK;
+	}
 
 	/* Use banked addressing (REG_BDx) to avoid some link traffic
 	 * (updating TAR) when reading several consecutive addresses.
@@ -459,7 +552,8 @@ static int mem_ap_setup_transfer_verify_size_packing_fallback(struct adiv5_ap *a
 }
 
 /**
- * Synchronous write of a block of memory, using a specific access size.
+ * Queue the write of a block of memory, using a specific access size.
+ * The caller runs the queue with dap_run().
  *
  * @param ap The MEM-AP to access.
  * @param buffer The data buffer to write. No particular alignment is assumed.
@@ -471,7 +565,7 @@ static int mem_ap_setup_transfer_verify_size_packing_fallback(struct adiv5_ap *a
  *  should normally be true, except when writing to e.g. a FIFO.
  * @return ERROR_OK on success, otherwise an error code.
  */
-static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t size, uint32_t count,
+static int mem_ap_queue_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t size, uint32_t count,
 		target_addr_t address, bool addrinc)
 {
 	struct adiv5_dap *dap = ap->dap;
@@ -573,9 +667,24 @@ static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t siz
 			address += this_size;
 	}
 
-	/* REVISIT: Might want to have a queued version of this function that does not run. */
+	return retval;
+}
+
+/**
+ * Synchronous write of a block of memory, using a specific access size.
+ * See mem_ap_queue_write() for the parameters.
+ */
+static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t size, uint32_t count,
+		target_addr_t address, bool addrinc)
+{
+	int retval = mem_ap_queue_write(ap, buffer, size, count, address, addrinc);
+
+	/* rejected before any transfer was queued */
+	if (retval == ERROR_TARGET_UNALIGNED_ACCESS || retval == ERROR_TARGET_SIZE_NOT_SUPPORTED)
+		return retval;
+
 	if (retval == ERROR_OK)
-		retval = dap_run(dap);
+		retval = dap_run(ap->dap);
 
 	if (retval != ERROR_OK) {
 		target_addr_t tar;
@@ -731,6 +840,12 @@ int mem_ap_write_buf(struct adiv5_ap *ap,
 	return mem_ap_write(ap, buffer, size, count, address, true);
 }
 
+int mem_ap_write_buf_queued(struct adiv5_ap *ap,
+		const uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address)
+{
+	return mem_ap_queue_write(ap, buffer, size, count, address, true);
+}
+
 int mem_ap_read_buf_noincr(struct adiv5_ap *ap,
 		uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address)
 {
@@ -2239,6 +2354,7 @@ struct dap_lookup_data {
 	unsigned int type;
 	/* output */
 	uint64_t component_base;
+	uint64_t component_pid;
 	uint64_t ap_num;
 };
 
@@ -2268,13 +2384,189 @@ static int dap_lookup_cs_component_cs_component(int retval,
 
 	/* Found! */
 	lookup->component_base = v->component_base;
+	lookup->component_pid = v->pid;
 	lookup->ap_num = v->ap->ap_num;
 	return CORESIGHT_COMPONENT_FOUND;
 }
 
+/*
+ * The topology cache file holds one line per successful lookup:
+ *	dpidr targetid ap_num apid ap_base type core_id component_base pidr
+ * all in hex. The first seven fields are the key, a new lookup result
+ * replaces the line with the same key.
+ */
+struct dap_topology_key {
+	uint32_t dpidr;
+	uint32_t targetid;
+	uint64_t ap_num;
+	uint32_t apid;
+	uint64_t ap_base;
+	uint32_t type;
+	uint32_t core_id;
+};
+
+#define DAP_TOPOLOGY_KEY_FMT "%08" PRIx32 " %08" PRIx32 " %" PRIx64 " %08" PRIx32 \
+	" %" PRIx64 " %02" PRIx32 " %" PRIx32
+#define DAP_TOPOLOGY_LINE_MAX 256
+
+static int dap_topology_key_init(struct adiv5_ap *ap, uint8_t type, int32_t core_id,
+		struct dap_topology_key *key)
+{
+	struct adiv5_dap *dap = ap->dap;
+	target_addr_t ap_base;
+
+	memset(key, 0, sizeof(*key));
+	key->ap_num = ap->ap_num;
+	key->type = type;
+	key->core_id = core_id;
+
+	int retval = dap_queue_dp_read(dap, DP_DPIDR, &key->dpidr);
+	if (retval == ERROR_OK)
+		retval = dap_run(dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if ((key->dpidr & DP_DPIDR_VERSION_MASK) >= (2UL << DP_DPIDR_VERSION_SHIFT)) {
+		retval = dap_queue_dp_read(dap, DP_TARGETID, &key->targetid);
+		if (retval == ERROR_OK)
+			retval = dap_run(dap);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/* the DPIDR alone is shared by many chips, the AP and the ROM table
+	 * it points to tell them apart better */
+	retval = dap_get_debugbase(ap, &ap_base, &key->apid);
+	key->ap_base = ap_base;
+	return retval;
+}
+
+/* parse a cache line, return true if it has the current layout */
+static bool dap_topology_cache_parse(const char *line, struct dap_topology_key *key,
+		uint64_t *base, uint64_t *pidr)
+{
+	return sscanf(line, "%" SCNx32 " %" SCNx32 " %" SCNx64 " %" SCNx32 " %" SCNx64
+			" %" SCNx32 " %" SCNx32 " %" SCNx64 " %" SCNx64,
+			&key->dpidr, &key->targetid, &key->ap_num, &key->apid, &key->ap_base,
+			&key->type, &key->core_id, base, pidr) == 9;
+}
+
+static bool dap_topology_key_equal(const struct dap_topology_key *a,
+		const struct dap_topology_key *b)
+{
+	return a->dpidr == b->dpidr && a->targetid == b->targetid
+		&& a->ap_num == b->ap_num && a->apid == b->apid
+		&& a->ap_base == b->ap_base && a->type == b->type
+		&& a->core_id == b->core_id;
+}
+
+static bool dap_topology_cache_find(const char *filename, const struct dap_topology_key *key,
+		target_addr_t *addr, uint64_t *pidr)
+{
+	FILE *f = fopen(filename, "r");
+	if (!f)
+		return false;
+
+	char line[DAP_TOPOLOGY_LINE_MAX];
+	bool found = false;
+	while (fgets(line, sizeof(line), f)) {
+		struct dap_topology_key c_key;
+		uint64_t c_base, c_pidr;
+		if (dap_topology_cache_parse(line, &c_key, &c_base, &c_pidr)
+				&& dap_topology_key_equal(&c_key, key)) {
+			*addr = c_base;
+			*pidr = c_pidr;
+			found = true;
+		}
+	}
+
+	fclose(f);
+	return found;
+}
+
+/* replace the entry of this key, keeping all other lines of the file */
+static void dap_topology_cache_store(const char *filename, const struct dap_topology_key *key,
+		target_addr_t addr, uint64_t pidr)
+{
+	char *lines = NULL;
+	size_t len = 0;
+
+	FILE *f = fopen(filename, "r");
+	if (f) {
+		char line[DAP_TOPOLOGY_LINE_MAX];
+		while (fgets(line, sizeof(line), f)) {
+			struct dap_topology_key c_key;
+			uint64_t c_base, c_pidr;
+			if (dap_topology_cache_parse(line, &c_key, &c_base, &c_pidr)
+					&& dap_topology_key_equal(&c_key, key))
+				continue;
+
+			size_t line_len = strlen(line);
+			char *p = realloc(lines, len + line_len);
+			if (!p) {
+				free(lines);
+				fclose(f);
+				LOG_ERROR("Out of memory");
+				return;
+			}
+			lines = p;
+			memcpy(lines + len, line, line_len);
+			len += line_len;
+		}
+		fclose(f);
+	}
+
+	f = fopen(filename, "w");
+	if (!f) {
+		free(lines);
+		LOG_WARNING("Cannot write topology cache %s", filename);
+		return;
+	}
+
+	if (len)
+		fwrite(lines, 1, len, f);
+	fprintf(f, DAP_TOPOLOGY_KEY_FMT " %" PRIx64 " %" PRIx64 "\n",
+		key->dpidr, key->targetid, key->ap_num, key->apid, key->ap_base,
+		key->type, key->core_id, (uint64_t)addr, pidr);
+	if (fclose(f))
+		LOG_WARNING("Cannot write topology cache %s", filename);
+	free(lines);
+}
+
+/* Check that the cached component is still the one being looked for */
+static bool dap_topology_cache_valid(struct adiv5_ap *ap, uint8_t type, target_addr_t addr,
+		uint64_t pidr)
+{
+	struct cs_component_vals v;
+
+	if (!IS_ALIGNED(addr, ARM_CS_ALIGN))
+		return false;
+	if (rtp_read_cs_regs(CS_ACCESS_MEM_AP, ap, addr, &v) != ERROR_OK)
+		return false;
+
+	return is_valid_arm_cs_cidr(v.cid)
+		&& ARM_CS_CIDR_CLASS(v.cid) == ARM_CS_CLASS_0X9_CS_COMPONENT
+		&& (v.devtype_memtype & ARM_CS_C9_DEVTYPE_MASK) == type
+		&& v.pid == pidr;
+}
+
 int dap_lookup_cs_component(struct adiv5_ap *ap, uint8_t type,
 		target_addr_t *addr, int32_t core_id)
 {
+	struct adiv5_dap *dap = ap->dap;
+	struct dap_topology_key key;
+	uint64_t pidr;
+	bool use_cache = dap->topology_cache
+		&& dap_topology_key_init(ap, type, core_id, &key) == ERROR_OK;
+
+	if (use_cache && dap_topology_cache_find(dap->topology_cache, &key, addr, &pidr)) {
+		if (dap_topology_cache_valid(ap, type, *addr, pidr)) {
+			LOG_DEBUG("CS lookup cached at 0x%" PRIx64, *addr);
+			return ERROR_OK;
+		}
+		LOG_DEBUG("CS lookup cache entry 0x%" PRIx64 " is stale", *addr);
+	}
+
 	struct dap_lookup_data lookup = {
 		.type = type,
 		.idx  = core_id,
@@ -2296,6 +2588,9 @@ int dap_lookup_cs_component(struct adiv5_ap *ap, uint8_t type,
 		}
 		LOG_DEBUG("CS lookup found at 0x%" PRIx64, lookup.component_base);
 		*addr = lookup.component_base;
+		if (use_cache)
+			dap_topology_cache_store(dap->topology_cache, &key, *addr,
+				lookup.component_pid);
 		return ERROR_OK;
 	}
 	if (retval != ERROR_OK) {
@@ -2881,6 +3176,52 @@ COMMAND_HANDLER(dap_ti_be_32_quirks_command)
 		"TI BE-32 quirks mode");
 }
 
+COMMAND_HANDLER(dap_coalesce_reads_command)
+{
+	struct adiv5_dap *dap = adiv5_get_dap(CMD_DATA);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		if (!enable && dap->num_pending_reads) {
+			int retval = dap_issue_pending_reads(dap);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		dap->coalesce_reads = enable;
+	}
+
+	command_print(CMD, "read coalescing %s, %" PRIu64 " TAR writes saved",
+		dap->coalesce_reads ? "enabled" : "disabled", dap->coalesce_saved);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dap_topology_cache_command)
+{
+	struct adiv5_dap *dap = adiv5_get_dap(CMD_DATA);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		free(dap->topology_cache);
+		dap->topology_cache = NULL;
+		if (strcmp(CMD_ARGV[0], "off")) {
+			dap->topology_cache = strdup(CMD_ARGV[0]);
+			if (!dap->topology_cache) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+		}
+	}
+
+	command_print(CMD, "topology cache %s", dap->topology_cache ? dap->topology_cache : "off");
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(dap_nu_npcx_quirks_command)
 {
 	struct adiv5_dap *dap = adiv5_get_dap(CMD_DATA);
@@ -2967,5 +3308,20 @@ const struct command_registration dap_instance_commands[] = {
 		.help = "set/get quirks mode for Nuvoton NPCX controllers",
 		.usage = "[enable]",
 	},
+	{
+		.name = "coalesce_reads",
+		.handler = dap_coalesce_reads_command,
+		.mode = COMMAND_ANY,
+		.help = "enable or disable grouping of scattered MEM-AP word reads "
+			"by 16 byte block, show the TAR writes saved",
+		.usage = "['enable'|'disable']",
+	},
+	{
+		.name = "topology_cache",
+		.handler = dap_topology_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "set file caching the CoreSight component lookups, or 'off'",
+		.usage = "[filename|'off']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
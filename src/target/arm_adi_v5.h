@@ -329,6 +329,16 @@ struct adiv5_ap {
 };
 
 
+/* Maximum number of mem_ap_read_u32() calls held back for coalescing */
+#define DAP_MAX_PENDING_READS 64
+
+/* A mem_ap_read_u32() call held back for coalescing */
+struct dap_pending_read {
+	struct adiv5_ap *ap;
+	target_addr_t address;
+	uint32_t *value;
+};
+
 /**
  * This represents an ARM Debug Interface (v5) Debug Access Port (DAP).
  * A DAP has two types of component:  one Debug Port (DP), which is a
@@ -401,6 +411,21 @@ struct adiv5_dap {
 	 * The work around is to repeat the data in all 4 bytes of DRW */
 	bool nu_npcx_quirks;
 
+	/**
+	 * When set, mem_ap_read_u32() calls are held back until any other DAP
+	 * access and then issued grouped by 16 byte block, so reads from the
+	 * same block share one TAR write and use the banked data registers.
+	 * Reads are reordered against each other, never against writes.
+	 */
+	bool coalesce_reads;
+	struct dap_pending_read pending_reads[DAP_MAX_PENDING_READS];
+	unsigned int num_pending_reads;
+	/* TAR writes avoided by coalescing reads */
+	uint64_t coalesce_saved;
+
+	/* File caching the result of CoreSight component lookups, or NULL */
+	char *topology_cache;
+
 	/**
 	 * STLINK adapter need to know if last AP operation was read or write, and
 	 * in case of write has to flush it with a dummy read from DP_RDBUFF
@@ -540,6 +565,17 @@ static inline int dap_send_sequence(struct adiv5_dap *dap,
 	return dap->ops->send_sequence(dap, seq);
 }
 
+/**
+ * Queue the MEM-AP word reads held back while read coalescing is enabled,
+ * reordered so reads from the same 16 byte block share one TAR write.
+ * Called before any other DAP access so queue order is kept.
+ *
+ * @param dap The DAP holding the pending reads.
+ *
+ * @return ERROR_OK for success, else a fault code.
+ */
+int dap_issue_pending_reads(struct adiv5_dap *dap);
+
 /**
  * Queue a DP register read.
  * Note that not all DP registers are readable; also, that JTAG and SWD
@@ -556,6 +592,11 @@ static inline int dap_queue_dp_read(struct adiv5_dap *dap,
 		unsigned reg, uint32_t *data)
 {
 	assert(dap->ops);
+	if (dap->num_pending_reads) {
+		int retval = dap_issue_pending_reads(dap);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 	return dap->ops->queue_dp_read(dap, reg, data);
 }
 
@@ -574,6 +615,11 @@ static inline int dap_queue_dp_write(struct adiv5_dap *dap,
 		unsigned reg, uint32_t data)
 {
 	assert(dap->ops);
+	if (dap->num_pending_reads) {
+		int retval = dap_issue_pending_reads(dap);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 	return dap->ops->queue_dp_write(dap, reg, data);
 }
 
@@ -595,6 +641,11 @@ static inline int dap_queue_ap_read(struct adiv5_ap *ap,
 		ap->refcount = 1;
 		LOG_ERROR("BUG: refcount AP#0x%" PRIx64 " used without get", ap->ap_num);
 	}
+	if (ap->dap->num_pending_reads) {
+		int retval = dap_issue_pending_reads(ap->dap);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 	return ap->dap->ops->queue_ap_read(ap, reg, data);
 }
 
@@ -615,6 +666,11 @@ static inline int dap_queue_ap_write(struct adiv5_ap *ap,
 		ap->refcount = 1;
 		LOG_ERROR("BUG: refcount AP#0x%" PRIx64 " used without get", ap->ap_num);
 	}
+	if (ap->dap->num_pending_reads) {
+		int retval = dap_issue_pending_reads(ap->dap);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 	return ap->dap->ops->queue_ap_write(ap, reg, data);
 }
 
@@ -632,6 +688,11 @@ static inline int dap_queue_ap_write(struct adiv5_ap *ap,
 static inline int dap_queue_ap_abort(struct adiv5_dap *dap, uint8_t *ack)
 {
 	assert(dap->ops);
+	if (dap->num_pending_reads) {
+		int retval = dap_issue_pending_reads(dap);
+		if (retval != ERROR_OK)
+			return retval;
+	}
 	return dap->ops->queue_ap_abort(dap, ack);
 }
 
@@ -645,11 +706,7 @@ static inline int dap_queue_ap_abort(struct adiv5_dap *dap, uint8_t *ack)
  *
  * @return ERROR_OK for success, else a fault code.
  */
-static inline int dap_run(struct adiv5_dap *dap)
-{
-	assert(dap->ops);
-	return dap->ops->run(dap);
-}
+int dap_run(struct adiv5_dap *dap);
 
 static inline int dap_sync(struct adiv5_dap *dap)
 {
@@ -718,6 +775,10 @@ int mem_ap_read_buf(struct adiv5_ap *ap,
 int mem_ap_write_buf(struct adiv5_ap *ap,
 		const uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address);
 
+/* Queued MEM-AP memory mapped bus block write, the caller runs the queue. */
+int mem_ap_write_buf_queued(struct adiv5_ap *ap,
+		const uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address);
+
 /* Synchronous, non-incrementing buffer functions for accessing fifos. */
 int mem_ap_read_buf_noincr(struct adiv5_ap *ap,
 		uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address);
@@ -171,6 +171,7 @@ int dap_cleanup_all(void)
 		if (dap->ops && dap->ops->quit)
 			dap->ops->quit(dap);
 
+		free(dap->topology_cache);
 		free(obj->name);
 		free(obj);
 	}
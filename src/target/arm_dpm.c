@@ -205,6 +205,35 @@ static int dpm_read_reg_u64(struct arm_dpm *dpm, struct reg *r, unsigned regnum)
 	return retval;
 }
 
+/* Turns the value "MOV r0, pc" leaves in r0 into the PC of the core */
+static uint32_t dpm_adjust_pc(struct arm_dpm *dpm, uint32_t value)
+{
+	/* NOTE: this seems like a slightly awkward place to update
+	 * this value ... but if the PC gets written (the only way
+	 * to change what we compute), the arch spec says subsequent
+	 * reads return values which are "unpredictable".  So this
+	 * is always right except in those broken-by-intent cases.
+	 */
+	switch (dpm->arm->core_state) {
+		case ARM_STATE_ARM:
+			value -= 8;
+			break;
+		case ARM_STATE_THUMB:
+		case ARM_STATE_THUMB_EE:
+			value -= 4;
+			break;
+		case ARM_STATE_JAZELLE:
+			/* core-specific ... ? */
+			LOG_WARNING("Jazelle PC adjustment unknown");
+			break;
+		default:
+			LOG_WARNING("unknown core state");
+			break;
+	}
+
+	return value;
+}
+
 /* just read the register -- rely on the core mode being right */
 int arm_dpm_read_reg(struct arm_dpm *dpm, struct reg *r, unsigned regnum)
 {
@@ -221,29 +250,7 @@ int arm_dpm_read_reg(struct arm_dpm *dpm, struct reg *r, unsigned regnum)
 		case 15:/* PC
 			 * "MOV r0, pc"; then return via DCC */
 			retval = dpm->instr_read_data_r0(dpm, 0xe1a0000f, &value);
-
-			/* NOTE: this seems like a slightly awkward place to update
-			 * this value ... but if the PC gets written (the only way
-			 * to change what we compute), the arch spec says subsequent
-			 * reads return values which are "unpredictable".  So this
-			 * is always right except in those broken-by-intent cases.
-			 */
-			switch (dpm->arm->core_state) {
-				case ARM_STATE_ARM:
-					value -= 8;
-					break;
-				case ARM_STATE_THUMB:
-				case ARM_STATE_THUMB_EE:
-					value -= 4;
-					break;
-				case ARM_STATE_JAZELLE:
-					/* core-specific ... ? */
-					LOG_WARNING("Jazelle PC adjustment unknown");
-					break;
-				default:
-					LOG_WARNING("unknown core state");
-					break;
-			}
+			value = dpm_adjust_pc(dpm, value);
 			break;
 		case ARM_VFP_V3_D0 ... ARM_VFP_V3_D31:
 			return dpm_read_reg_u64(dpm, r, regnum);
@@ -405,8 +412,11 @@ int arm_dpm_read_current_registers(struct arm_dpm *dpm)
 	/* update core mode and state, plus shadow mapping for R8..R14 */
 	arm_set_cpsr(arm, cpsr);
 
-	/* REVISIT we can probably avoid reading R1..R14, saving time... */
-	for (unsigned i = 2; i < 16; i++) {
+	/* Only LR and PC are needed right away, for semihosting and resume.
+	 * R2..R13 are left invalid and read on first get, or in one batch by
+	 * register_get_many() for GDB.
+	 */
+	for (unsigned int i = 14; i < 16; i++) {
 		r = arm_reg_current(arm, i);
 		if (r->valid)
 			continue;
@@ -685,22 +695,33 @@ static enum arm_mode dpm_mapmode(struct arm *arm,
  * of registers.
  */
 
+/* Maps a register number and mode to the ones arm_dpm_read_reg() and
+ * arm_dpm_modeswitch() need, returns false for invalid registers. */
+static bool arm_dpm_map_core_reg(struct arm_dpm *dpm, int *regnum, enum arm_mode *mode)
+{
+	if (*regnum < 0 || (*regnum > 16 && *regnum < ARM_VFP_V3_D0) ||
+		(*regnum > ARM_VFP_V3_FPSCR))
+		return false;
+
+	if (*regnum == 16) {
+		if (*mode != ARM_MODE_ANY)
+			*regnum = 17;
+	} else {
+		*mode = dpm_mapmode(dpm->arm, *regnum, *mode);
+	}
+
+	return true;
+}
+
 static int arm_dpm_read_core_reg(struct target *target, struct reg *r,
 	int regnum, enum arm_mode mode)
 {
 	struct arm_dpm *dpm = target_to_arm(target)->dpm;
 	int retval;
 
-	if (regnum < 0 || (regnum > 16 && regnum < ARM_VFP_V3_D0) ||
-		(regnum > ARM_VFP_V3_FPSCR))
+	if (!arm_dpm_map_core_reg(dpm, &regnum, &mode))
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	if (regnum == 16) {
-		if (mode != ARM_MODE_ANY)
-			regnum = 17;
-	} else
-		mode = dpm_mapmode(dpm->arm, regnum, mode);
-
 	/* REVISIT what happens if we try to read SPSR in a core mode
 	 * which has no such register?
 	 */
@@ -728,6 +749,145 @@ fail:
 	return retval;
 }
 
+/*
+ * Queues the reads of the core registers of the given mode still to get:
+ * R0..R14 through DCC first, which clobbers nothing, then PC, CPSR and
+ * SPSR through R0 once R0 is known. VFP registers, and whatever fails,
+ * are left invalid for the caller to read one by one.
+ */
+static void arm_dpm_read_mode_regs_queued(struct target *target,
+	struct reg **reg_list, unsigned int count, enum arm_mode mode)
+{
+	struct arm_dpm *dpm = target_to_arm(target)->dpm;
+	struct reg *r0 = dpm->arm->core_cache->reg_list;
+	struct arm_dpm_read_op ops[36];
+	struct reg *regs[36];
+	int regnums[36];
+
+	for (int pass = 0; pass < 2; pass++) {
+		unsigned int n = 0;
+
+		if (pass == 1 && !r0->valid)
+			return;
+
+		for (unsigned int i = 0; i < count && n + 2 <= ARRAY_SIZE(ops); i++) {
+			struct reg *r = reg_list[i];
+			struct arm_reg *arm_reg = r->arch_info;
+			int regnum = arm_reg->num;
+			enum arm_mode reg_mode = arm_reg->mode;
+
+			if (r->valid || arm_reg->target != target
+					|| !arm_dpm_map_core_reg(dpm, &regnum, &reg_mode)
+					|| reg_mode != mode || regnum > 17)
+				continue;
+
+			if (pass == 0 && regnum <= 14) {
+				/* "MCR p14, 0, Rnum, c0, c5, 0" */
+				ops[n].opcode = ARMV4_5_MCR(14, 0, regnum, 0, 5, 0);
+			} else if (pass == 1 && regnum >= 15) {
+				/* "MOV r0, pc", "MRS r0, CPSR" or "MRS r0, SPSR" */
+				ops[n].opcode = regnum == 15 ? 0xe1a0000f : ARMV4_5_MRS(0, regnum & 1);
+				ops[n].words = 0;
+				n++;
+				ops[n].opcode = ARMV4_5_MCR(14, 0, 0, 0, 5, 0);
+			} else {
+				continue;
+			}
+			ops[n].words = 1;
+			regnums[n] = regnum;
+			regs[n++] = r;
+		}
+
+		if (n == 0)
+			continue;
+
+		if (dpm->instr_read_data_queued(dpm, ops, n) != ERROR_OK) {
+			/* R0 may hold PC or a PSR now */
+			if (pass == 1)
+				r0->dirty = true;
+			return;
+		}
+
+		for (unsigned int i = 0; i < n; i++) {
+			uint32_t value = ops[i].value;
+
+			if (ops[i].words == 0)
+				continue;
+			if (regnums[i] == 15)
+				value = dpm_adjust_pc(dpm, value);
+			buf_set_u32(regs[i]->value, 0, 32, value);
+			regs[i]->valid = true;
+			regs[i]->dirty = false;
+			LOG_DEBUG("READ: %s, %8.8x", regs[i]->name, (unsigned int)value);
+		}
+		if (pass == 1)
+			r0->dirty = true;
+	}
+}
+
+/*
+ * Reads all the registers in a single prepare/finish sequence. Those of
+ * the current mode come first, then the banked ones grouped by mode, so
+ * there is one mode switch per mode rather than two per register.
+ */
+static int arm_dpm_read_core_regs(struct target *target, struct reg **reg_list,
+	unsigned int count)
+{
+	struct arm_dpm *dpm = target_to_arm(target)->dpm;
+	enum arm_mode mode = ARM_MODE_ANY;
+	bool switched = false;
+	int retval;
+
+	retval = dpm->prepare(dpm);
+	if (retval != ERROR_OK)
+		return retval;
+
+	while (retval == ERROR_OK) {
+		enum arm_mode next_mode = ARM_MODE_ANY;
+		bool pending = false;
+
+		if (dpm->instr_read_data_queued)
+			arm_dpm_read_mode_regs_queued(target, reg_list, count, mode);
+
+		for (unsigned int i = 0; i < count; i++) {
+			struct reg *r = reg_list[i];
+			struct arm_reg *arm_reg = r->arch_info;
+			int regnum = arm_reg->num;
+			enum arm_mode reg_mode = arm_reg->mode;
+
+			/* left to get */
+			if (r->valid || arm_reg->target != target
+					|| !arm_dpm_map_core_reg(dpm, &regnum, &reg_mode))
+				continue;
+
+			if (reg_mode != mode) {
+				if (!pending)
+					next_mode = reg_mode;
+				pending = true;
+				continue;
+			}
+
+			retval = arm_dpm_read_reg(dpm, r, regnum);
+			if (retval != ERROR_OK)
+				break;
+		}
+
+		if (retval != ERROR_OK || !pending)
+			break;
+
+		retval = arm_dpm_modeswitch(dpm, next_mode);
+		mode = next_mode;
+		switched = true;
+	}
+
+	/* always clean up, regardless of error */
+	if (switched)
+		arm_dpm_modeswitch(dpm, ARM_MODE_ANY);
+
+	/* (void) */ dpm->finish(dpm);
+	return retval;
+}
+
 static int arm_dpm_write_core_reg(struct target *target, struct reg *r,
 	int regnum, enum arm_mode mode, uint8_t *value)
 {
@@ -788,9 +948,10 @@ static int arm_dpm_full_context(struct target *target)
 		did_read = false;
 
 		/* We "know" arm_dpm_read_current_registers() was called so
-		 * the unmapped registers (R0..R7, PC, AND CPSR) and some
-		 * view of R8..R14 are current.  We also "know" oddities of
-		 * register mapping: special cases for R8..R12 and SPSR.
+		 * R0, R1, PC, CPSR and the current LR are current; R2..R7
+		 * read fine in whatever mode is picked below.  We also "know"
+		 * oddities of register mapping: special cases for R8..R12
+		 * and SPSR.
 		 *
 		 * Pick some mode with unread registers and read them all.
 		 * Repeat until done.
@@ -1103,6 +1264,7 @@ int arm_dpm_setup(struct arm_dpm *dpm)
 	/* register access setup */
 	arm->full_context = arm_dpm_full_context;
 	arm->read_core_reg = arm_dpm_read_core_reg;
+	arm->read_core_regs = arm_dpm_read_core_regs;
 	arm->write_core_reg = arm_dpm_write_core_reg;
 
 	if (!arm->core_cache) {
@@ -36,6 +36,16 @@ struct dpm_wp {
 	struct dpm_bpwp bpwp;
 };
 
+/** One instruction of arm_dpm::instr_read_data_queued() */
+struct arm_dpm_read_op {
+	uint32_t opcode;
+	/** DCC words to read after the instruction: 0, 1 (DTRTX) or 2 (DTRTX
+	 * then DTRRX, for a 64 bit value) */
+	unsigned int words;
+	/** value read */
+	uint64_t value;
+};
+
 /**
  * This wraps an implementation of DPM primitives.  Each interface
  * provider supplies a structure like this, which is the glue between
@@ -108,6 +118,15 @@ struct arm_dpm {
 	int (*instr_read_data_r0_64)(struct arm_dpm *dpm,
 			uint32_t opcode, uint64_t *data);
 
+	/**
+	 * Optional. Runs the instructions in order, reading DCC after those
+	 * which write it, in a single DAP transaction instead of polling for
+	 * each one to complete. On error, all values and the registers the
+	 * instructions use are unknown.
+	 */
+	int (*instr_read_data_queued)(struct arm_dpm *dpm,
+			struct arm_dpm_read_op *ops, unsigned int count);
+
 	struct reg *(*arm_reg_current)(struct arm *arm,
 			unsigned regnum);
 
@@ -592,6 +592,23 @@ static int armv4_5_get_core_reg(struct reg *reg)
 	return retval;
 }
 
+static int armv4_5_get_core_regs(struct reg **reg_list, unsigned int count)
+{
+	struct arm_reg *reg_arch_info = reg_list[0]->arch_info;
+	struct target *target = reg_arch_info->target;
+
+	/* without batch support, get reads them one by one */
+	if (!reg_arch_info->arm->read_core_regs)
+		return ERROR_OK;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_TARGET_ERROR(target, "not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	return reg_arch_info->arm->read_core_regs(target, reg_list, count);
+}
+
 static int armv4_5_set_core_reg(struct reg *reg, uint8_t *buf)
 {
 	struct arm_reg *reg_arch_info = reg->arch_info;
@@ -641,6 +658,7 @@ static int armv4_5_set_core_reg(struct reg *reg, uint8_t *buf)
 static const struct reg_arch_type arm_reg_type = {
 	.get = armv4_5_get_core_reg,
 	.set = armv4_5_set_core_reg,
+	.get_many = armv4_5_get_core_regs,
 };
 
 struct reg_cache *arm_build_reg_cache(struct target *target, struct arm *arm)
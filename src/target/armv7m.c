@@ -33,6 +33,7 @@
 #include "algorithm.h"
 #include "register.h"
 #include "semihosting_common.h"
+#include <helper/align.h>
 #include <helper/log.h>
 #include <helper/binarybuffer.h>
 
@@ -929,6 +930,76 @@ cleanup:
 	return retval;
 }
 
+/** Writes memory from a LZ4 block, inflated by code running on the target. */
+int armv7m_write_compressed(struct target *target, target_addr_t address,
+		uint32_t size, const uint8_t *compressed, uint32_t compressed_size)
+{
+	struct working_area *lz4_algorithm;
+	struct armv7m_algorithm armv7m_info;
+	struct reg_param reg_params[3];
+	int retval;
+
+	static const uint8_t lz4_code[] = {
+#include "../../contrib/loaders/decompress/armv7m_lz4.inc"
+	};
+
+	/* the code followed by the compressed data, sent in one go */
+	const uint32_t code_size = ALIGN_UP(sizeof(lz4_code), 4);
+	uint8_t *buffer = malloc(code_size + compressed_size);
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	memcpy(buffer, lz4_code, sizeof(lz4_code));
+	memcpy(buffer + code_size, compressed, compressed_size);
+
+	retval = target_alloc_working_area_try(target, code_size + compressed_size, &lz4_algorithm);
+	if (retval != ERROR_OK) {
+		free(buffer);
+		return retval;
+	}
+
+	retval = target_write_buffer(target, lz4_algorithm->address,
+			code_size + compressed_size, buffer);
+	free(buffer);
+	if (retval != ERROR_OK)
+		goto cleanup;
+
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARM_MODE_THREAD;
+
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, lz4_algorithm->address + code_size);
+	buf_set_u32(reg_params[1].value, 0, 32, compressed_size);
+	buf_set_u32(reg_params[2].value, 0, 32, address);
+
+	unsigned int timeout = 1000 * (1 + (size / (64 * 1024)));
+
+	retval = target_run_algorithm(target, 0, NULL, 3, reg_params, lz4_algorithm->address,
+			lz4_algorithm->address + (sizeof(lz4_code) - 2),
+			timeout, &armv7m_info);
+
+	if (retval != ERROR_OK) {
+		LOG_ERROR("error executing cortex_m lz4 algorithm");
+	} else if (buf_get_u32(reg_params[0].value, 0, 32) != address + size) {
+		LOG_ERROR("lz4 algorithm wrote up to 0x%8.8" PRIx32 " instead of " TARGET_ADDR_FMT,
+				buf_get_u32(reg_params[0].value, 0, 32), address + size);
+		retval = ERROR_FAIL;
+	}
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+
+cleanup:
+	target_free_working_area(target, lz4_algorithm);
+
+	return retval;
+}
+
 /** Checks an array of memory regions whether they are erased. */
 int armv7m_blank_check_memory(struct target *target,
 	struct target_memory_check_block *blocks, int num_blocks, uint8_t erased_value)
@@ -1603,6 +1603,22 @@ static int armv8_get_core_reg(struct reg *reg)
 	return arm->read_core_reg(target, reg, armv8_reg->num, arm->core_mode);
 }
 
+static int armv8_get_core_regs(struct reg **reg_list, unsigned int count)
+{
+	struct arm_reg *armv8_reg = reg_list[0]->arch_info;
+	struct target *target = armv8_reg->target;
+	struct arm *arm = target_to_arm(target);
+
+	/* without batch support, get reads them one by one */
+	if (!arm->read_core_regs)
+		return ERROR_OK;
+
+	if (target->state != TARGET_HALTED)
+		return ERROR_TARGET_NOT_HALTED;
+
+	return arm->read_core_regs(target, reg_list, count);
+}
+
 static int armv8_set_core_reg(struct reg *reg, uint8_t *buf)
 {
 	struct arm_reg *armv8_reg = reg->arch_info;
@@ -1636,6 +1652,7 @@ static int armv8_set_core_reg(struct reg *reg, uint8_t *buf)
 static const struct reg_arch_type armv8_reg_type = {
 	.get = armv8_get_core_reg,
 	.set = armv8_set_core_reg,
+	.get_many = armv8_get_core_regs,
 };
 
 static int armv8_get_core_reg32(struct reg *reg)
@@ -1664,6 +1681,43 @@ static int armv8_get_core_reg32(struct reg *reg)
 	return retval;
 }
 
+static int armv8_get_core_regs32(struct reg **reg_list, unsigned int count)
+{
+	struct arm_reg *armv8_reg = reg_list[0]->arch_info;
+	struct target *target = armv8_reg->target;
+	struct arm *arm = target_to_arm(target);
+
+	/* without batch support, get reads them one by one */
+	if (!arm->read_core_regs)
+		return ERROR_OK;
+
+	if (target->state != TARGET_HALTED)
+		return ERROR_TARGET_NOT_HALTED;
+
+	/* read the corresponding Aarch64 registers */
+	struct reg **reg64_list = malloc(count * sizeof(*reg64_list));
+	if (!reg64_list)
+		return ERROR_FAIL;
+
+	unsigned int count64 = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		armv8_reg = reg_list[i]->arch_info;
+		if (armv8_reg->target == target)
+			reg64_list[count64++] = arm->core_cache->reg_list + armv8_reg->num;
+	}
+
+	int retval = arm->read_core_regs(target, reg64_list, count64);
+	free(reg64_list);
+
+	for (unsigned int i = 0; i < count; i++) {
+		armv8_reg = reg_list[i]->arch_info;
+		if (armv8_reg->target == target)
+			reg_list[i]->valid = arm->core_cache->reg_list[armv8_reg->num].valid;
+	}
+
+	return retval;
+}
+
 static int armv8_set_core_reg32(struct reg *reg, uint8_t *buf)
 {
 	struct arm_reg *armv8_reg = reg->arch_info;
@@ -1697,6 +1751,7 @@ static int armv8_set_core_reg32(struct reg *reg, uint8_t *buf)
 static const struct reg_arch_type armv8_reg32_type = {
 	.get = armv8_get_core_reg32,
 	.set = armv8_set_core_reg32,
+	.get_many = armv8_get_core_regs32,
 };
 
 /** Builds cache of architecturally defined registers.  */
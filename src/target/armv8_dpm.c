@@ -416,6 +416,62 @@ static int dpmv8_instr_read_data_r0_64(struct arm_dpm *dpm,
 	return dpmv8_read_dcc_64(armv8, data, &dpm->dscr);
 }
 
+/*
+ * ARMv8 has no DCC stall mode, so the instructions are queued without
+ * waiting for ITE or TXfull. An ITR write before the previous instruction
+ * completed, or a DTRTX read before the value arrived, sets EDSCR.ERR and
+ * the core ignores the instructions that follow, so one DSCR read at the
+ * end tells whether all of them ran.
+ */
+static int dpmv8_instr_read_data_queued(struct arm_dpm *dpm,
+	struct arm_dpm_read_op *ops, unsigned int count)
+{
+	struct armv8_common *armv8 = dpm->arm->arch_info;
+	bool t32 = armv8_dpm_get_core_state(dpm) != ARM_STATE_AARCH64;
+	uint32_t dscr;
+	int retval = ERROR_OK;
+
+	uint32_t *words = calloc(count, 2 * sizeof(*words));
+	if (!words)
+		return ERROR_FAIL;
+
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; i++) {
+		retval = mem_ap_write_u32(armv8->debug_ap,
+				armv8->debug_base + CPUV8_DBG_ITR,
+				t32 ? T32_FMTITR(ops[i].opcode) : ops[i].opcode);
+		if (retval == ERROR_OK && ops[i].words > 0)
+			retval = mem_ap_read_u32(armv8->debug_ap,
+					armv8->debug_base + CPUV8_DBG_DTRTX, &words[2 * i]);
+		if (retval == ERROR_OK && ops[i].words > 1)
+			retval = mem_ap_read_u32(armv8->debug_ap,
+					armv8->debug_base + CPUV8_DBG_DTRRX, &words[2 * i + 1]);
+	}
+	if (retval == ERROR_OK)
+		retval = mem_ap_read_u32(armv8->debug_ap,
+				armv8->debug_base + CPUV8_DBG_DSCR, &dscr);
+	if (retval == ERROR_OK)
+		retval = dap_run(armv8->debug_ap->dap);
+	if (retval != ERROR_OK)
+		goto done;
+
+	dpm->dscr = dscr;
+	if ((dscr & (DSCR_ERR | DSCR_ITE)) != DSCR_ITE) {
+		LOG_DEBUG("queued DCC reads failed, DSCR 0x%08" PRIx32, dscr);
+		if (dscr & DSCR_ERR)
+			mem_ap_write_atomic_u32(armv8->debug_ap,
+					armv8->debug_base + CPUV8_DBG_DRCR, DRCR_CSE);
+		retval = ERROR_FAIL;
+		goto done;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		ops[i].value = words[2 * i] | (uint64_t)words[2 * i + 1] << 32;
+
+done:
+	free(words);
+	return retval;
+}
+
 #if 0
 static int dpmv8_bpwp_enable(struct arm_dpm *dpm, unsigned index_t,
 	target_addr_t addr, uint32_t control)
@@ -996,6 +1052,112 @@ fail:
 	return retval;
 }
 
+/*
+ * Queues the reads of the AArch64 core registers still to get: X0..X30
+ * through DBGDTR_EL0 first, which clobbers nothing, then SP, PC and
+ * CPSR through X0 once X0 is known. Whatever fails is left invalid for
+ * the caller to read one by one.
+ */
+static void armv8_dpm_read_core_regs_queued(struct target *target,
+	struct reg **reg_list, unsigned int count)
+{
+	struct arm *arm = target_to_arm(target);
+	struct armv8_common *armv8 = arm->arch_info;
+	struct arm_dpm *dpm = arm->dpm;
+	struct arm_dpm_read_op ops[ARMV8_XPSR + 1];
+	struct reg *regs[ARMV8_XPSR + 1];
+	struct reg *r0 = arm->core_cache->reg_list + ARMV8_R0;
+
+	for (int pass = 0; pass < 2; pass++) {
+		unsigned int n = 0;
+
+		if (pass == 1 && !r0->valid)
+			return;
+
+		for (unsigned int i = 0; i < count && n + 2 <= ARRAY_SIZE(ops); i++) {
+			struct reg *r = reg_list[i];
+			struct arm_reg *arm_reg = r->arch_info;
+
+			if (r->valid || arm_reg->target != target)
+				continue;
+
+			if (pass == 0 && arm_reg->num >= ARMV8_R0 && arm_reg->num <= ARMV8_R30) {
+				ops[n].opcode = ARMV8_MSR_GP(SYSTEM_DBG_DBGDTR_EL0, arm_reg->num);
+				ops[n].words = 2;
+				regs[n++] = r;
+			} else if (pass == 1 && (arm_reg->num == ARMV8_SP || arm_reg->num == ARMV8_PC)) {
+				ops[n].opcode = arm_reg->num == ARMV8_SP ? ARMV8_MOVFSP_64(0) : ARMV8_MRS_DLR(0);
+				ops[n].words = 0;
+				n++;
+				ops[n].opcode = ARMV8_MSR_GP(SYSTEM_DBG_DBGDTR_EL0, 0);
+				ops[n].words = 2;
+				regs[n++] = r;
+			} else if (pass == 1 && arm_reg->num == ARMV8_XPSR) {
+				ops[n].opcode = ARMV8_MRS_DSPSR(0);
+				ops[n].words = 0;
+				n++;
+				ops[n].opcode = armv8_opcode(armv8, WRITE_REG_DTRTX);
+				ops[n].words = 1;
+				regs[n++] = r;
+			}
+		}
+
+		if (n == 0)
+			continue;
+
+		if (dpm->instr_read_data_queued(dpm, ops, n) != ERROR_OK) {
+			/* X0 may hold SP, PC or CPSR now */
+			if (pass == 1)
+				r0->dirty = true;
+			return;
+		}
+
+		for (unsigned int i = 0; i < n; i++) {
+			if (ops[i].words == 0)
+				continue;
+			buf_set_u64(regs[i]->value, 0, regs[i]->size, ops[i].value);
+			regs[i]->valid = true;
+			regs[i]->dirty = false;
+			LOG_DEBUG("READ: %s, %16.8llx", regs[i]->name, (unsigned long long)ops[i].value);
+		}
+		if (pass == 1)
+			r0->dirty = true;
+	}
+}
+
+/* Reads all the registers in a single prepare/finish sequence */
+static int armv8_dpm_read_core_regs(struct target *target, struct reg **reg_list,
+	unsigned int count)
+{
+	struct arm *arm = target_to_arm(target);
+	struct arm_dpm *dpm = arm->dpm;
+	int retval;
+
+	retval = dpm->prepare(dpm);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (dpm->instr_read_data_queued && arm->core_state == ARM_STATE_AARCH64)
+		armv8_dpm_read_core_regs_queued(target, reg_list, count);
+
+	for (unsigned int i = 0; i < count; i++) {
+		struct reg *r = reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+
+		/* left to get */
+		if (r->valid || arm_reg->target != target
+				|| arm_reg->num < 0 || (unsigned int)arm_reg->num >= arm->core_cache->num_regs)
+			continue;
+
+		retval = dpmv8_read_reg(dpm, r, arm_reg->num);
+		if (retval != ERROR_OK)
+			break;
+	}
+
+	/* (void) */ dpm->finish(dpm);
+	return retval;
+}
+
 static int armv8_dpm_write_core_reg(struct target *target, struct reg *r,
 	int regnum, enum arm_mode mode, uint8_t *value)
 {
@@ -1409,6 +1571,7 @@ int armv8_dpm_setup(struct arm_dpm *dpm)
 	/* register access setup */
 	arm->full_context = armv8_dpm_full_context;
 	arm->read_core_reg = armv8_dpm_read_core_reg;
+	arm->read_core_regs = armv8_dpm_read_core_regs;
 	arm->write_core_reg = armv8_dpm_write_core_reg;
 
 	if (!arm->core_cache) {
@@ -1435,6 +1598,7 @@ int armv8_dpm_setup(struct arm_dpm *dpm)
 	dpm->instr_read_data_dcc_64 = dpmv8_instr_read_data_dcc_64;
 	dpm->instr_read_data_r0 = dpmv8_instr_read_data_r0;
 	dpm->instr_read_data_r0_64 = dpmv8_instr_read_data_r0_64;
+	dpm->instr_read_data_queued = dpmv8_instr_read_data_queued;
 
 	dpm->arm_reg_current = armv8_reg_current;
 
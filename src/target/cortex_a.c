@@ -584,6 +584,59 @@ static int cortex_a_instr_read_data_r0_r1(struct arm_dpm *dpm,
 	return retval;
 }
 
+/* In DCC stall mode, an ITR write waits for the previous instruction to
+ * complete and a DTRTX read for the value to arrive, so the instructions
+ * and reads can be queued without polling DSCR in between. */
+static int cortex_a_instr_read_data_queued(struct arm_dpm *dpm,
+	struct arm_dpm_read_op *ops, unsigned int count)
+{
+	struct cortex_a_common *a = dpm_to_a(dpm);
+	struct adiv5_ap *ap = a->armv7a_common.debug_ap;
+	uint32_t base = a->armv7a_common.debug_base;
+	uint32_t dscr;
+	int retval;
+
+	uint32_t *words = calloc(count, sizeof(*words));
+	if (!words)
+		return ERROR_FAIL;
+
+	retval = mem_ap_read_atomic_u32(ap, base + CPUDBG_DSCR, &dscr);
+	if (retval != ERROR_OK)
+		goto done;
+
+	dscr &= ~DSCR_EXT_DCC_MASK;
+	retval = mem_ap_write_u32(ap, base + CPUDBG_DSCR, dscr | DSCR_EXT_DCC_STALL_MODE);
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; i++) {
+		retval = mem_ap_write_u32(ap, base + CPUDBG_ITR, ops[i].opcode);
+		if (retval == ERROR_OK && ops[i].words)
+			retval = mem_ap_read_u32(ap, base + CPUDBG_DTRTX, &words[i]);
+	}
+	/* back to non-blocking mode, which the other DPM operations expect */
+	if (retval == ERROR_OK)
+		retval = mem_ap_write_u32(ap, base + CPUDBG_DSCR, dscr | DSCR_EXT_DCC_NON_BLOCKING);
+	if (retval == ERROR_OK)
+		retval = mem_ap_read_u32(ap, base + CPUDBG_DSCR, &dscr);
+	if (retval == ERROR_OK)
+		retval = dap_run(ap->dap);
+	if (retval != ERROR_OK)
+		goto done;
+
+	if (dscr & (DSCR_STICKY_ABORT_PRECISE | DSCR_STICKY_ABORT_IMPRECISE
+			| DSCR_STICKY_UNDEFINED)) {
+		LOG_DEBUG("queued DCC reads failed, DSCR 0x%08" PRIx32, dscr);
+		mem_ap_write_atomic_u32(ap, base + CPUDBG_DRCR, DRCR_CLEAR_EXCEPTIONS);
+		retval = ERROR_FAIL;
+		goto done;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		ops[i].value = words[i];
+
+done:
+	free(words);
+	return retval;
+}
+
 static int cortex_a_bpwp_enable(struct arm_dpm *dpm, unsigned index_t,
 	uint32_t addr, uint32_t control)
 {
@@ -663,6 +716,7 @@ static int cortex_a_dpm_setup(struct cortex_a_common *a, uint32_t didr)
 	dpm->instr_read_data_dcc = cortex_a_instr_read_data_dcc;
 	dpm->instr_read_data_r0 = cortex_a_instr_read_data_r0;
 	dpm->instr_read_data_r0_r1 = cortex_a_instr_read_data_r0_r1;
+	dpm->instr_read_data_queued = cortex_a_instr_read_data_queued;
 
 	dpm->bpwp_enable = cortex_a_bpwp_enable;
 	dpm->bpwp_disable = cortex_a_bpwp_disable;
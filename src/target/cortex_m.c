@@ -2168,6 +2168,42 @@ static int cortex_m_write_memory(struct target *target, target_addr_t address,
 	return mem_ap_write_buf(armv7m->debug_ap, buffer, size, count, address);
 }
 
+static int cortex_m_write_async_fifo(struct target *target, target_addr_t address,
+	uint32_t size, const uint8_t *buffer,
+	target_addr_t wp_addr, uint32_t wp,
+	target_addr_t rp_addr, uint32_t *rp)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct adiv5_ap *ap = armv7m->debug_ap;
+	int retval = ERROR_OK;
+
+	/* mem_ap_*_u32() transfer the pointers as bus words, which match
+	 * the target byte order on little endian targets only */
+	if (target->endianness != TARGET_LITTLE_ENDIAN)
+		return ERROR_NOT_IMPLEMENTED;
+
+	/* bytes up to the first word boundary, words, then the remaining bytes */
+	uint32_t head = MIN(size, (4 - (address & 3)) & 3);
+	uint32_t words = (size - head) / 4;
+	uint32_t tail = size - head - 4 * words;
+
+	if (head)
+		retval = mem_ap_write_buf_queued(ap, buffer, 1, head, address);
+	if (retval == ERROR_OK && words)
+		retval = mem_ap_write_buf_queued(ap, buffer + head, 4, words, address + head);
+	if (retval == ERROR_OK && tail)
+		retval = mem_ap_write_buf_queued(ap, buffer + head + 4 * words, 1, tail,
+				address + head + 4 * words);
+	if (retval == ERROR_OK)
+		retval = mem_ap_write_u32(ap, wp_addr, wp);
+	if (retval == ERROR_OK)
+		retval = mem_ap_read_u32(ap, rp_addr, rp);
+	if (retval == ERROR_OK)
+		retval = dap_run(ap->dap);
+
+	return retval;
+}
+
 static int cortex_m_init_target(struct command_context *cmd_ctx,
 	struct target *target)
 {
@@ -2214,7 +2250,7 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 	gettimeofday(&timeout, NULL);
 	timeval_add_time(&timeout, seconds, 0);
 
-	LOG_TARGET_INFO(target, "Starting Cortex-M profiling. Sampling DWT_PCSR as fast as we can...");
+	LOG_TARGET_DEBUG(target, "Starting Cortex-M profiling. Sampling DWT_PCSR as fast as we can...");
 
 	/* Make sure the target is running */
 	target_poll(target);
@@ -2250,7 +2286,7 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 
 		gettimeofday(&now, NULL);
 		if (sample_count >= max_num_samples || timeval_compare(&now, &timeout) > 0) {
-			LOG_TARGET_INFO(target, "Profiling completed. %" PRIu32 " samples.", sample_count);
+			LOG_TARGET_DEBUG(target, "Profiling completed. %" PRIu32 " samples.", sample_count);
 			break;
 		}
 	}
@@ -2259,6 +2295,36 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 	return retval;
 }
 
+int cortex_m_sample_pc(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	int retval = ERROR_OK;
+
+	if (armv7m->debug_ap) {
+		retval = mem_ap_read_buf_noincr(armv7m->debug_ap, (void *)samples,
+				4, max_num_samples, DWT_PCSR);
+	} else {
+		for (uint32_t i = 0; i < max_num_samples && retval == ERROR_OK; i++)
+			retval = target_read_u32(target, DWT_PCSR, &samples[i]);
+	}
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* PCSR is read as zero without PC sampling support */
+	if (samples[0] == 0)
+		return ERROR_NOT_IMPLEMENTED;
+
+	/* and as all ones while the core is halted or sleeping */
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < max_num_samples; i++) {
+		if (samples[i] != 0xffffffff)
+			samples[count++] = samples[i];
+	}
+	*num_samples = count;
+
+	return ERROR_OK;
+}
 
 /* REVISIT cache valid/dirty bits are unmaintained.  We could set "valid"
  * on r/w if the core is not running, and clear on resume or reset ... or
@@ -3090,6 +3156,8 @@ struct target_type cortexm_target = {
 
 	.read_memory = cortex_m_read_memory,
 	.write_memory = cortex_m_write_memory,
+	.write_async_fifo = cortex_m_write_async_fifo,
+	.write_compressed = armv7m_write_compressed,
 	.checksum_memory = armv7m_checksum_memory,
 	.blank_check_memory = armv7m_blank_check_memory,
 
@@ -3111,4 +3179,5 @@ struct target_type cortexm_target = {
 	.deinit_target = cortex_m_deinit_target,
 
 	.profiling = cortex_m_profiling,
+	.sample_pc = cortex_m_sample_pc,
 };
@@ -663,6 +663,7 @@ struct target_type hla_target = {
 
 	.read_memory = adapter_read_memory,
 	.write_memory = adapter_write_memory,
+	.write_compressed = armv7m_write_compressed,
 	.checksum_memory = armv7m_checksum_memory,
 	.blank_check_memory = armv7m_blank_check_memory,
 
@@ -675,4 +676,5 @@ struct target_type hla_target = {
 	.add_watchpoint = cortex_m_add_watchpoint,
 	.remove_watchpoint = cortex_m_remove_watchpoint,
 	.profiling = cortex_m_profiling,
+	.sample_pc = cortex_m_sample_pc,
 };
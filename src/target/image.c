@@ -23,6 +23,8 @@
 
 #include "image.h"
 #include "target.h"
+#include <helper/binarybuffer.h>
+#include <helper/crc32.h>
 #include <helper/log.h>
 #include <server/server.h>
 
@@ -126,25 +128,24 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 	struct image_ihex *ihex = image->type_private;
 	struct fileio *fileio = ihex->fileio;
 	uint32_t full_address;
-	uint32_t cooked_bytes;
 	bool end_rec = false;
+	/* file position of the current and of the next line */
+	size_t line_pos = 0, next_line_pos = 0;
 
 	/* we can't determine the number of sections that we'll have to create ahead of time,
 	 * so we locally hold them until parsing is finished */
 
-	size_t filesize;
-	int retval;
-	retval = fileio_size(fileio, &filesize);
-	if (retval != ERROR_OK)
-		return retval;
-
-	ihex->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
+	ihex->section_pos = malloc(sizeof(*ihex->section_pos) * IMAGE_MAX_SECTIONS);
+	if (!ihex->section_pos) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 	image->num_sections = 0;
 
 	while (!fileio_feof(fileio)) {
 		full_address = 0x0;
-		section[image->num_sections].private = &ihex->buffer[cooked_bytes];
+		ihex->section_pos[image->num_sections] = next_line_pos;
+		section[image->num_sections].private = NULL;
 		section[image->num_sections].base_address = 0x0;
 		section[image->num_sections].size = 0x0;
 		section[image->num_sections].flags = 0;
@@ -157,6 +158,9 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 			uint8_t cal_checksum = 0;
 			size_t bytes_read = 0;
 
+			line_pos = next_line_pos;
+			next_line_pos += strlen(lpsz_line);
+
 			/* skip comments and blank lines */
 			if ((lpsz_line[0] == '#') || (strlen(lpsz_line + strspn(lpsz_line, "\n\t\r ")) == 0))
 				continue;
@@ -186,21 +190,20 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 						}
 						section[image->num_sections].size = 0x0;
 						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
+						section[image->num_sections].private = NULL;
+						ihex->section_pos[image->num_sections] = line_pos;
 					}
 					section[image->num_sections].base_address =
 						(full_address & 0xffff0000) | address;
 					full_address = (full_address & 0xffff0000) | address;
 				}
 
+				/* only check the data now, it is read by image_read_section() */
 				while (count-- > 0) {
 					unsigned value;
 					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					ihex->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
+					cal_checksum += (uint8_t)value;
 					bytes_read += 2;
-					cooked_bytes += 1;
 					section[image->num_sections].size += 1;
 					full_address++;
 				}
@@ -241,8 +244,8 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 						}
 						section[image->num_sections].size = 0x0;
 						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
+						section[image->num_sections].private = NULL;
+						ihex->section_pos[image->num_sections] = line_pos;
 					}
 					section[image->num_sections].base_address =
 						(full_address & 0xffff) | (upper_address << 4);
@@ -280,8 +283,8 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 						}
 						section[image->num_sections].size = 0x0;
 						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
+						section[image->num_sections].private = NULL;
+						ihex->section_pos[image->num_sections] = line_pos;
 					}
 					section[image->num_sections].base_address =
 						(full_address & 0xffff) | (upper_address << 16);
@@ -758,25 +761,24 @@ static int image_mot_buffer_complete_inner(struct image *image,
 	struct image_mot *mot = image->type_private;
 	struct fileio *fileio = mot->fileio;
 	uint32_t full_address;
-	uint32_t cooked_bytes;
 	bool end_rec = false;
+	/* file position of the current and of the next line */
+	size_t line_pos = 0, next_line_pos = 0;
 
 	/* we can't determine the number of sections that we'll have to create ahead of time,
 	 * so we locally hold them until parsing is finished */
 
-	int retval;
-	size_t filesize;
-	retval = fileio_size(fileio, &filesize);
-	if (retval != ERROR_OK)
-		return retval;
-
-	mot->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
+	mot->section_pos = malloc(sizeof(*mot->section_pos) * IMAGE_MAX_SECTIONS);
+	if (!mot->section_pos) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 	image->num_sections = 0;
 
 	while (!fileio_feof(fileio)) {
 		full_address = 0x0;
-		section[image->num_sections].private = &mot->buffer[cooked_bytes];
+		mot->section_pos[image->num_sections] = next_line_pos;
+		section[image->num_sections].private = NULL;
 		section[image->num_sections].base_address = 0x0;
 		section[image->num_sections].size = 0x0;
 		section[image->num_sections].flags = 0;
@@ -789,6 +791,9 @@ static int image_mot_buffer_complete_inner(struct image *image,
 			uint8_t cal_checksum = 0;
 			uint32_t bytes_read = 0;
 
+			line_pos = next_line_pos;
+			next_line_pos += strlen(lpsz_line);
+
 			/* skip comments and blank lines */
 			if ((lpsz_line[0] == '#') || (strlen(lpsz_line + strspn(lpsz_line, "\n\t\r ")) == 0))
 				continue;
@@ -854,22 +859,26 @@ static int image_mot_buffer_complete_inner(struct image *image,
 					 */
 					if (section[image->num_sections].size != 0) {
 						image->num_sections++;
+						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
+							/* too many sections */
+							LOG_ERROR("Too many sections found in S19 file");
+							return ERROR_IMAGE_FORMAT_ERROR;
+						}
 						section[image->num_sections].size = 0x0;
 						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&mot->buffer[cooked_bytes];
+						section[image->num_sections].private = NULL;
+						mot->section_pos[image->num_sections] = line_pos;
 					}
 					section[image->num_sections].base_address = address;
 					full_address = address;
 				}
 
+				/* only check the data now, it is read by image_read_section() */
 				while (count-- > 0) {
 					unsigned value;
 					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					mot->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
+					cal_checksum += (uint8_t)value;
 					bytes_read += 2;
-					cooked_bytes += 1;
 					section[image->num_sections].size += 1;
 					full_address++;
 				}
@@ -954,6 +963,156 @@ static int image_mot_buffer_complete(struct image *image)
 	return retval;
 }
 
+/**
+ * Decode the payload of an IHEX data record. Records carrying no section
+ * data yield zero bytes. The record was already checked when the image
+ * was opened.
+ */
+static int image_ihex_decode_record(const char *line, uint8_t *data, uint32_t *count)
+{
+	uint32_t address;
+	uint32_t record_type;
+
+	*count = 0;
+	if (line[0] != ':')
+		return ERROR_OK;
+
+	if (sscanf(line, ":%2" SCNx32 "%4" SCNx32 "%2" SCNx32, count, &address,
+		&record_type) != 3)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	if (record_type != 0) {
+		*count = 0;
+		return ERROR_OK;
+	}
+
+	if (unhexify(data, line + 9, *count) != *count)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	return ERROR_OK;
+}
+
+/**
+ * Decode the payload of an S1, S2 or S3 record, all other records yield
+ * zero bytes.
+ */
+static int image_mot_decode_record(const char *line, uint8_t *data, uint32_t *count)
+{
+	uint32_t record_type;
+	uint32_t length;
+
+	*count = 0;
+	if (line[0] != 'S')
+		return ERROR_OK;
+
+	if (sscanf(line, "S%1" SCNx32 "%2" SCNx32, &record_type, &length) != 2)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	if (record_type < 1 || record_type > 3)
+		return ERROR_OK;
+
+	/* address is record_type + 1 bytes, followed by the data and the checksum */
+	uint32_t address_size = record_type + 1;
+	if (length < address_size + 1)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	*count = length - address_size - 1;
+	if (unhexify(data, line + 4 + 2 * address_size, *count) != *count)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	return ERROR_OK;
+}
+
+/**
+ * Read section data of a text image straight from the file. Sequential
+ * reads resume at the record where the previous read stopped, others
+ * restart at the first record of the section.
+ */
+static int image_text_read_section(struct fileio *fileio,
+	const size_t *section_pos,
+	struct image_text_cursor *cursor,
+	int (*decode_record)(const char *line, uint8_t *data, uint32_t *count),
+	int section,
+	uint32_t offset,
+	uint32_t size,
+	uint8_t *buffer,
+	size_t *size_read)
+{
+	size_t line_pos;
+	uint32_t skip;
+	int retval;
+
+	*size_read = 0;
+
+	if (cursor->valid && cursor->section == (unsigned int)section
+		&& cursor->offset == offset) {
+		line_pos = cursor->line_pos;
+		skip = cursor->line_skip;
+	} else {
+		line_pos = section_pos[section];
+		skip = offset;
+	}
+	cursor->valid = false;
+
+	retval = fileio_seek(fileio, line_pos);
+	if (retval != ERROR_OK)
+		return retval;
+
+	char *line = malloc(1023);
+	if (!line) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	uint8_t data[256];
+	while (*size_read < size) {
+		uint32_t count;
+
+		retval = fileio_fgets(fileio, 1023, line);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("unexpected end of image file");
+			retval = ERROR_IMAGE_FORMAT_ERROR;
+			break;
+		}
+
+		retval = decode_record(line, data, &count);
+		if (retval != ERROR_OK)
+			break;
+
+		size_t record_pos = line_pos;
+		line_pos += strlen(line);
+
+		if (skip >= count) {
+			skip -= count;
+			continue;
+		}
+
+		uint32_t n = MIN(count - skip, size - *size_read);
+		memcpy(buffer + *size_read, data + skip, n);
+		*size_read += n;
+		skip += n;
+
+		if (skip < count) {
+			/* the next read starts in the middle of this record */
+			line_pos = record_pos;
+		} else {
+			skip = 0;
+		}
+	}
+
+	if (retval == ERROR_OK) {
+		cursor->valid = true;
+		cursor->section = section;
+		cursor->offset = offset + size;
+		cursor->line_pos = line_pos;
+		cursor->line_skip = skip;
+	}
+
+	free(line);
+
+	return retval;
+}
+
 int image_open(struct image *image, const char *url, const char *type_string)
 {
 	int retval = ERROR_OK;
@@ -987,8 +1146,11 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		struct image_ihex *image_ihex;
 
 		image_ihex = image->type_private = malloc(sizeof(struct image_ihex));
+		image_ihex->section_pos = NULL;
+		image_ihex->cursor.valid = false;
 
-		retval = fileio_open(&image_ihex->fileio, url, FILEIO_READ, FILEIO_TEXT);
+		/* binary mode, the records are located by their file position */
+		retval = fileio_open(&image_ihex->fileio, url, FILEIO_READ, FILEIO_BINARY);
 		if (retval != ERROR_OK)
 			goto free_mem_on_error;
 
@@ -997,6 +1159,7 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			LOG_ERROR(
 				"failed buffering IHEX image, check server output for additional information");
 			fileio_close(image_ihex->fileio);
+			free(image_ihex->section_pos);
 			goto free_mem_on_error;
 		}
 	} else if (image->type == IMAGE_ELF) {
@@ -1038,8 +1201,11 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		struct image_mot *image_mot;
 
 		image_mot = image->type_private = malloc(sizeof(struct image_mot));
+		image_mot->section_pos = NULL;
+		image_mot->cursor.valid = false;
 
-		retval = fileio_open(&image_mot->fileio, url, FILEIO_READ, FILEIO_TEXT);
+		/* binary mode, the records are located by their file position */
+		retval = fileio_open(&image_mot->fileio, url, FILEIO_READ, FILEIO_BINARY);
 		if (retval != ERROR_OK)
 			goto free_mem_on_error;
 
@@ -1048,6 +1214,7 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			LOG_ERROR(
 				"failed buffering S19 image, check server output for additional information");
 			fileio_close(image_mot->fileio);
+			free(image_mot->section_pos);
 			goto free_mem_on_error;
 		}
 	} else if (image->type == IMAGE_BUILDER) {
@@ -1112,10 +1279,11 @@ int image_read_section(struct image *image,
 		if (retval != ERROR_OK)
 			return retval;
 	} else if (image->type == IMAGE_IHEX) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
-		*size_read = size;
+		struct image_ihex *image_ihex = image->type_private;
 
-		return ERROR_OK;
+		return image_text_read_section(image_ihex->fileio, image_ihex->section_pos,
+			&image_ihex->cursor, image_ihex_decode_record,
+			section, offset, size, buffer, size_read);
 	} else if (image->type == IMAGE_ELF) {
 		return image_elf_read_section(image, section, offset, size, buffer, size_read);
 	} else if (image->type == IMAGE_MEMORY) {
@@ -1157,10 +1325,11 @@ int image_read_section(struct image *image,
 			address += (size_in_cache > size) ? size : size_in_cache;
 		}
 	} else if (image->type == IMAGE_SRECORD) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
-		*size_read = size;
+		struct image_mot *image_mot = image->type_private;
 
-		return ERROR_OK;
+		return image_text_read_section(image_mot->fileio, image_mot->section_pos,
+			&image_mot->cursor, image_mot_decode_record,
+			section, offset, size, buffer, size_read);
 	} else if (image->type == IMAGE_BUILDER) {
 		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
 		*size_read = size;
@@ -1219,8 +1388,8 @@ void image_close(struct image *image)
 
 		fileio_close(image_ihex->fileio);
 
-		free(image_ihex->buffer);
-		image_ihex->buffer = NULL;
+		free(image_ihex->section_pos);
+		image_ihex->section_pos = NULL;
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf = image->type_private;
 
@@ -1249,8 +1418,8 @@ void image_close(struct image *image)
 
 		fileio_close(image_mot->fileio);
 
-		free(image_mot->buffer);
-		image_mot->buffer = NULL;
+		free(image_mot->section_pos);
+		image_mot->section_pos = NULL;
 	} else if (image->type == IMAGE_BUILDER) {
 		for (unsigned int i = 0; i < image->num_sections; i++) {
 			free(image->sections[i].private);
@@ -1270,31 +1439,14 @@ int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *c
 	uint32_t crc = 0xffffffff;
 	LOG_DEBUG("Calculating checksum");
 
-	static uint32_t crc32_table[256];
-
-	static bool first_init;
-	if (!first_init) {
-		/* Initialize the CRC table and the decoding table.  */
-		unsigned int i, j, c;
-		for (i = 0; i < 256; i++) {
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
-		}
-
-		first_init = true;
-	}
-
 	while (nbytes > 0) {
-		int run = nbytes;
+		uint32_t run = nbytes;
 		if (run > 32768)
 			run = 32768;
+		/* as per gdb */
+		crc = crc32_be(CRC32_POLY_BE, crc, buffer, run);
+		buffer += run;
 		nbytes -= run;
-		while (run--) {
-			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-		}
 		keep_alive();
 		if (openocd_is_shutdown_pending())
 			return ERROR_SERVER_INTERRUPTED;
@@ -60,9 +60,20 @@ struct image_binary {
 	struct fileio *fileio;
 };
 
+/* Read position in a text (IHEX or S19) image. Data records are decoded
+ * from the file on demand instead of buffering the whole image. */
+struct image_text_cursor {
+	bool valid;
+	unsigned int section;
+	uint32_t offset;		/* section offset of the next byte to read */
+	size_t line_pos;		/* file position of the record holding it */
+	uint32_t line_skip;		/* data bytes of that record already read */
+};
+
 struct image_ihex {
 	struct fileio *fileio;
-	uint8_t *buffer;
+	size_t *section_pos;	/* file position where each section starts */
+	struct image_text_cursor cursor;
 };
 
 struct image_memory {
@@ -88,7 +99,8 @@ struct image_elf {
 
 struct image_mot {
 	struct fileio *fileio;
-	uint8_t *buffer;
+	size_t *section_pos;	/* file position where each section starts */
+	struct image_text_cursor cursor;
 };
 
 int image_open(struct image *image, const char *url, const char *type_string);
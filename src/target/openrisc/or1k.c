@@ -1211,7 +1211,7 @@ static int or1k_profiling(struct target *target, uint32_t *samples,
 	gettimeofday(&timeout, NULL);
 	timeval_add_time(&timeout, seconds, 0);
 
-	LOG_INFO("Starting or1k profiling. Sampling npc as fast as we can...");
+	LOG_DEBUG("Starting or1k profiling. Sampling npc as fast as we can...");
 
 	/* Make sure the target is running */
 	target_poll(target);
@@ -1237,7 +1237,7 @@ static int or1k_profiling(struct target *target, uint32_t *samples,
 
 		gettimeofday(&now, NULL);
 		if ((sample_count >= max_num_samples) || timeval_compare(&now, &timeout) > 0) {
-			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+			LOG_DEBUG("Profiling completed. %" PRIu32 " samples.", sample_count);
 			break;
 		}
 	}
@@ -102,6 +102,54 @@ void register_cache_invalidate(struct reg_cache *cache)
 	}
 }
 
+/**
+ * Make the values of the registers in reg_list valid, reading all those of
+ * a type having get_many in one batch per type. Registers whose type has no
+ * get_many, or which get_many leaves invalid, are read one by one with get.
+ * NULL, not existing and already valid registers are skipped.
+ */
+int register_get_many(struct reg **reg_list, unsigned int count)
+{
+	struct reg **batch = malloc(count * sizeof(*batch));
+	if (!batch && count)
+		return ERROR_FAIL;
+
+	int retval = ERROR_OK;
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; i++) {
+		struct reg *reg = reg_list[i];
+		if (!reg || !reg->exist || reg->valid || !reg->type->get_many)
+			continue;
+
+		/* batch all the pending registers of this type, in list order */
+		unsigned int batch_size = 0;
+		bool done = false;
+		for (unsigned int j = 0; j < count && !done; j++) {
+			struct reg *other = reg_list[j];
+			if (!other || !other->exist || other->valid || other->type != reg->type)
+				continue;
+			/* an earlier register of this type was left invalid by get_many */
+			if (j < i)
+				done = true;
+			else
+				batch[batch_size++] = other;
+		}
+		if (!done)
+			retval = reg->type->get_many(batch, batch_size);
+	}
+	free(batch);
+
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; i++) {
+		struct reg *reg = reg_list[i];
+		if (!reg || !reg->exist || reg->valid)
+			continue;
+		retval = reg->type->get(reg);
+		if (retval != ERROR_OK)
+			LOG_DEBUG("Could not read register %s", reg->name);
+	}
+
+	return retval;
+}
+
 static int register_get_dummy_core_reg(struct reg *reg)
 {
 	return ERROR_OK;
@@ -122,7 +122,8 @@ struct reg {
 	uint8_t *value;
 	/* The stored value needs to be written to the target. */
 	bool dirty;
-	/* When true, value is valid. */
+	/* When true, value is valid. When false, the value is read from the
+	 * target by the next get (or get_many) of the register. */
 	bool valid;
 	/* When false, the register doesn't actually exist in the target. */
 	bool exist;
@@ -151,6 +152,11 @@ struct reg_cache {
 struct reg_arch_type {
 	int (*get)(struct reg *reg);
 	int (*set)(struct reg *reg, uint8_t *buf);
+	/* Optional. Read the values of the count registers in reg_list, all of
+	 * this type and not valid, in as few target round trips as possible.
+	 * Registers that cannot be read this way are left invalid; their get
+	 * is called afterwards and reports the error for them. */
+	int (*get_many)(struct reg **reg_list, unsigned int count);
 };
 
 struct reg *register_get_by_number(struct reg_cache *first,
@@ -160,6 +166,7 @@ struct reg *register_get_by_name(struct reg_cache *first,
 struct reg_cache **register_get_last_cache_p(struct reg_cache **first);
 void register_unlink_cache(struct reg_cache **cache_p, const struct reg_cache *cache);
 void register_cache_invalidate(struct reg_cache *cache);
+int register_get_many(struct reg **reg_list, unsigned int count);
 
 void register_init_dummy(struct reg *reg);
 
@@ -18,6 +18,9 @@
 
 #include "target.h"
 
+/* upper limit of data read from an up-channel per polling cycle */
+#define RTT_MAX_READ_SIZE	(64 * 1024)
+
 static int read_rtt_channel(struct target *target,
 		const struct rtt_control *ctrl, unsigned int channel_index,
 		enum rtt_channel_type type, struct rtt_channel *channel)
@@ -372,7 +375,7 @@ int target_rtt_read_callback(struct target *target,
 	for (size_t i = 0; i < num_channels; i++) {
 		int ret;
 		struct rtt_channel channel;
-		uint8_t buffer[1024];
+		uint8_t *buffer;
 		size_t length;
 
 		if (!sinks[i])
@@ -396,16 +399,26 @@ int target_rtt_read_callback(struct target *target,
 			continue;
 		}
 
-		length = sizeof(buffer);
+		/* drain the whole channel at once, one batch for all sinks */
+		length = MIN(channel.size, RTT_MAX_READ_SIZE);
+		buffer = malloc(length);
+		if (!buffer) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+
 		ret = read_from_channel(target, &channel, buffer, &length);
 
 		if (ret != ERROR_OK) {
 			LOG_ERROR("rtt: Failed to read from up-channel %zu", i);
+			free(buffer);
 			return ret;
 		}
 
 		for (struct rtt_sink_list *sink = sinks[i]; sink; sink = sink->next)
 			sink->read(i, buffer, length, sink->user_data);
+
+		free(buffer);
 	}
 
 	return ERROR_OK;
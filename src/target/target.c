@@ -31,6 +31,7 @@
 #endif
 
 #include <helper/align.h>
+#include <helper/lz4.h>
 #include <helper/nvp.h>
 #include <helper/time_support.h>
 #include <jtag/jtag.h>
@@ -61,6 +62,7 @@ static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
+static void profile_background_free(void);
 
 static struct target_type *target_types[] = {
 	&arm7tdmi_target,
@@ -111,6 +113,9 @@ static int64_t target_timer_next_event_value;
 static LIST_HEAD(target_reset_callback_list);
 static LIST_HEAD(target_trace_callback_list);
 static const int polling_interval = TARGET_DEFAULT_POLLING_INTERVAL;
+/* longest interval between polls of a target in a stable state, in
+ * polling periods, 1 disables the adaptive polling */
+static unsigned int poll_backoff_max = 1;
 static LIST_HEAD(empty_smp_targets);
 
 enum nvp_assert {
@@ -504,6 +509,42 @@ int target_poll(struct target *target)
 	return ERROR_OK;
 }
 
+/* Poll the target in the next polling period, the state is about to change */
+static void target_poll_soon(struct target *target)
+{
+	target->poll_schedule.interval = 1;
+	target->poll_schedule.countdown = 0;
+}
+
+/* Double the interval between polls as long as the state doesn't change */
+static void target_poll_reschedule(struct target *target)
+{
+	struct poll_schedule *ps = &target->poll_schedule;
+
+	if (target->state != ps->last_state) {
+		ps->last_state = target->state;
+		ps->state_changes++;
+		ps->interval = 1;
+	} else {
+		ps->interval = MIN(2 * MAX(ps->interval, 1U), poll_backoff_max);
+	}
+	ps->countdown = ps->interval - 1;
+}
+
+/* True if the target, or any target of its SMP group, has to be polled now */
+static bool target_poll_due(struct target *target)
+{
+	if (!target->smp)
+		return target->poll_schedule.countdown == 0;
+
+	struct target_list *head;
+	foreach_smp_target(head, target->smp_targets) {
+		if (head->target->poll_schedule.countdown == 0)
+			return true;
+	}
+	return false;
+}
+
 int target_halt(struct target *target)
 {
 	int retval;
@@ -519,6 +560,7 @@ int target_halt(struct target *target)
 
 	target->halt_issued = true;
 	target->halt_issued_time = timeval_ms();
+	target_poll_soon(target);
 
 	return ERROR_OK;
 }
@@ -585,6 +627,7 @@ int target_resume(struct target *target, int current, target_addr_t address,
 	if (retval != ERROR_OK)
 		return retval;
 
+	target_poll_soon(target);
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_END);
 
 	return retval;
@@ -789,6 +832,7 @@ int target_run_algorithm(struct target *target,
 	}
 
 	target->running_alg = true;
+	target_memory_written(target);
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_param,
@@ -834,6 +878,7 @@ int target_start_algorithm(struct target *target,
 	}
 
 	target->running_alg = true;
+	target_memory_written(target);
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_params,
@@ -884,6 +929,35 @@ done:
 	return retval;
 }
 
+/**
+ * Write a chunk to the FIFO of an asynchronous algorithm, update the
+ * write pointer and read back the read pointer, in a single adapter
+ * transaction when the target supports it.
+ */
+static int target_write_async_fifo(struct target *target, target_addr_t address,
+		uint32_t size, const uint8_t *buffer,
+		target_addr_t wp_addr, uint32_t wp,
+		target_addr_t rp_addr, uint32_t *rp)
+{
+	int retval;
+
+	if (target->type->write_async_fifo) {
+		target_memory_written(target);
+		retval = target->type->write_async_fifo(target, address, size, buffer,
+				wp_addr, wp, rp_addr, rp);
+		if (retval != ERROR_NOT_IMPLEMENTED)
+			return retval;
+	}
+
+	retval = target_write_buffer(target, address, size, buffer);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = target_write_u32(target, wp_addr, wp);
+	if (retval != ERROR_OK)
+		return retval;
+	return target_read_u32(target, rp_addr, rp);
+}
+
 /**
  * Streams data to a circular buffer on target intended for consumption by code
  * running asynchronously on target.
@@ -935,7 +1009,6 @@ int target_run_flash_async_algorithm(struct target *target,
 		uint32_t entry_point, uint32_t exit_point, void *arch_info)
 {
 	int retval;
-	int timeout = 0;
 
 	const uint8_t *buffer_orig = buffer;
 
@@ -945,9 +1018,18 @@ int target_run_flash_async_algorithm(struct target *target,
 	uint32_t rp_addr = buffer_start + 4;
 	uint32_t fifo_start_addr = buffer_start + 8;
 	uint32_t fifo_end_addr = buffer_start + buffer_size;
+	uint32_t fifo_size = fifo_end_addr - fifo_start_addr;
 
 	uint32_t wp = fifo_start_addr;
 	uint32_t rp = fifo_start_addr;
+	uint32_t last_rp = fifo_start_addr;
+	bool rp_valid = false;
+
+	/* Data consumed by the target, to pace the polling of a full fifo */
+	uint64_t consumed = 0;
+	unsigned int underruns = 0;
+	int64_t start_ms = timeval_ms();
+	int64_t progress_ms = start_ms;
 
 	/* validate block_size is 2^n */
 	assert(IS_PWR_OF_2(block_size));
@@ -973,11 +1055,15 @@ int target_run_flash_async_algorithm(struct target *target,
 
 	while (count > 0) {
 
-		retval = target_read_u32(target, rp_addr, &rp);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("failed to get read pointer");
-			break;
+		/* The read pointer comes with the previous fifo write, if any */
+		if (!rp_valid) {
+			retval = target_read_u32(target, rp_addr, &rp);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("failed to get read pointer");
+				break;
+			}
 		}
+		rp_valid = false;
 
 		LOG_DEBUG("offs 0x%zx count 0x%" PRIx32 " wp 0x%" PRIx32 " rp 0x%" PRIx32,
 			(size_t) (buffer - buffer_orig), count, wp, rp);
@@ -993,6 +1079,13 @@ int target_run_flash_async_algorithm(struct target *target,
 			break;
 		}
 
+		int64_t now_ms = timeval_ms();
+		if (rp != last_rp) {
+			consumed += (rp - last_rp + fifo_size) % fifo_size;
+			last_rp = rp;
+			progress_ms = now_ms;
+		}
+
 		/* Count the number of bytes available in the fifo without
 		 * crossing the wrap around. Make sure to not fill it completely,
 		 * because that would make wp == rp and that's the empty condition. */
@@ -1005,53 +1098,75 @@ int target_run_flash_async_algorithm(struct target *target,
 			thisrun_bytes = fifo_end_addr - wp - block_size;
 
 		if (thisrun_bytes == 0) {
-			/* Throttle polling a bit if transfer is (much) faster than flash
-			 * programming. The exact delay shouldn't matter as long as it's
-			 * less than buffer size / flash speed. This is very unlikely to
-			 * run when using high latency connections such as USB. */
-			alive_sleep(2);
-
-			/* to stop an infinite loop on some targets check and increment a timeout
+			/* to stop an infinite loop on some targets check for a timeout
 			 * this issue was observed on a stellaris using the new ICDI interface */
-			if (timeout++ >= 2500) {
+			if (now_ms - progress_ms > 5000) {
 				LOG_ERROR("timeout waiting for algorithm, a target reset is recommended");
 				return ERROR_FLASH_OPERATION_FAILED;
 			}
+
+			/* Throttle polling if transfer is (much) faster than flash
+			 * programming. Sleep up to 2 ms, but less than the target
+			 * needs to drain a quarter of the fifo at the rate measured
+			 * so far, so it does not run dry meanwhile. This is very
+			 * unlikely to run when using high latency connections such
+			 * as USB. */
+			uint64_t rate = 0;
+			if (now_ms > start_ms)
+				rate = consumed / (now_ms - start_ms);
+			unsigned int delay = 2;
+			if (rate && fifo_size / 4 / rate < delay)
+				delay = fifo_size / 4 / rate;
+			if (delay)
+				alive_sleep(delay);
+			else
+				keep_alive();
 			continue;
 		}
 
-		/* reset our timeout */
-		timeout = 0;
-
 		/* Limit to the amount of data we actually want to write */
 		if (thisrun_bytes > count * block_size)
 			thisrun_bytes = count * block_size;
 
+		/* The target idles until the first chunk arrives. Hand it half
+		 * of the fifo first, so it programs while the rest is sent. Later
+		 * underruns mean the transfer is the bottleneck, splitting the
+		 * chunk would only add round trips. */
+		if (buffer == buffer_orig) {
+			if (thisrun_bytes >= 2 * (uint32_t)block_size)
+				thisrun_bytes = ALIGN_DOWN(thisrun_bytes / 2, block_size);
+		} else if (wp == rp) {
+			underruns++;
+		}
+
 		/* Force end of large blocks to be word aligned */
 		if (thisrun_bytes >= 16)
 			thisrun_bytes -= (rp + thisrun_bytes) & 0x03;
 
-		/* Write data to fifo */
-		retval = target_write_buffer(target, wp, thisrun_bytes, buffer);
-		if (retval != ERROR_OK)
-			break;
-
 		/* Update counters and wrap write pointer */
+		uint32_t chunk_addr = wp;
+		const uint8_t *chunk = buffer;
 		buffer += thisrun_bytes;
 		count -= thisrun_bytes / block_size;
 		wp += thisrun_bytes;
 		if (wp >= fifo_end_addr)
 			wp = fifo_start_addr;
 
-		/* Store updated write pointer to target */
-		retval = target_write_u32(target, wp_addr, wp);
+		/* Write data to fifo, store the updated write pointer to target
+		 * and get the read pointer for the next round */
+		retval = target_write_async_fifo(target, chunk_addr, thisrun_bytes, chunk,
+				wp_addr, wp, rp_addr, &rp);
 		if (retval != ERROR_OK)
 			break;
+		rp_valid = true;
 
 		/* Avoid GDB timeouts */
 		keep_alive();
 	}
 
+	LOG_DEBUG("fifo underruns %u, target consumed %" PRIu64 " bytes in %" PRId64 " ms",
+		underruns, consumed, timeval_ms() - start_ms);
+
 	if (retval != ERROR_OK) {
 		/* abort flash write algorithm on target */
 		target_write_u32(target, wp_addr, 0);
@@ -1262,6 +1377,19 @@ int target_read_phys_memory(struct target *target,
 	return target->type->read_phys_memory(target, address, size, count, buffer);
 }
 
+void target_memory_written(struct target *target)
+{
+	target->memory_writes++;
+
+	if (target->smp) {
+		struct target_list *head;
+		foreach_smp_target(head, target->smp_targets) {
+			if (head->target != target)
+				head->target->memory_writes++;
+		}
+	}
+}
+
 int target_write_memory(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t count, const uint8_t *buffer)
 {
@@ -1273,6 +1401,7 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_memory_written(target);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1287,6 +1416,7 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_memory_written(target);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1471,6 +1601,17 @@ static int target_profiling(struct target *target, uint32_t *samples,
 			num_samples, seconds);
 }
 
+int target_sample_pc(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples)
+{
+	*num_samples = 0;
+
+	if (!target->type->sample_pc)
+		return ERROR_NOT_IMPLEMENTED;
+
+	return target->type->sample_pc(target, samples, max_num_samples, num_samples);
+}
+
 static int handle_target(void *priv);
 
 static int target_init_one(struct command_context *cmd_ctx,
@@ -2203,6 +2344,8 @@ static void target_destroy(struct target *target)
 
 	target_free_all_working_areas(target);
 
+	free(target->gdb_mem_cache);
+
 	/* release the targets SMP list */
 	if (target->smp) {
 		struct target_list *head, *tmp;
@@ -2237,6 +2380,8 @@ void target_quit(void)
 	}
 	target_event_callbacks = NULL;
 
+	profile_background_free();
+
 	struct target_timer_callback *pt = target_timer_callbacks;
 	while (pt) {
 		struct target_timer_callback *t = pt->next;
@@ -2295,7 +2440,7 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 	gettimeofday(&timeout, NULL);
 	timeval_add_time(&timeout, seconds, 0);
 
-	LOG_INFO("Starting profiling. Halting and resuming the"
+	LOG_DEBUG("Starting profiling. Halting and resuming the"
 			" target as often as we can...");
 
 	uint32_t sample_count = 0;
@@ -2326,7 +2471,7 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 
 		gettimeofday(&now, NULL);
 		if ((sample_count >= max_num_samples) || timeval_compare(&now, &timeout) >= 0) {
-			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+			LOG_DEBUG("Profiling completed. %" PRIu32 " samples.", sample_count);
 			break;
 		}
 	}
@@ -2360,9 +2505,47 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
+	target_memory_written(target);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
+/* Compressing smaller buffers does not make up for running the inflate code */
+#define TARGET_COMPRESSED_WRITE_MIN	4096
+
+int target_write_buffer_compressed(struct target *target, target_addr_t address,
+		uint32_t size, const uint8_t *buffer, uint32_t *sent)
+{
+	*sent = size;
+
+	if (!target->type->write_compressed || size < TARGET_COMPRESSED_WRITE_MIN
+			|| target->state != TARGET_HALTED)
+		return target_write_buffer(target, address, size, buffer);
+
+	/* give up on data which does not shrink by at least 1/8 */
+	size_t limit = size - size / 8;
+	size_t compressed_size = 0;
+	uint8_t *compressed = malloc(limit);
+	if (compressed)
+		compressed_size = lz4_compress(buffer, size, compressed, limit);
+
+	int retval = ERROR_FAIL;
+	if (compressed_size) {
+		target_memory_written(target);
+		retval = target->type->write_compressed(target, address, size,
+				compressed, compressed_size);
+		if (retval == ERROR_OK)
+			*sent = compressed_size;
+	}
+	free(compressed);
+
+	if (retval == ERROR_OK)
+		return ERROR_OK;
+
+	if (compressed_size)
+		LOG_DEBUG("compressed write failed, sending %" PRIu32 " bytes uncompressed", size);
+	return target_write_buffer(target, address, size, buffer);
+}
+
 static int target_write_buffer_default(struct target *target,
 	target_addr_t address, uint32_t count, const uint8_t *buffer)
 {
@@ -2960,6 +3143,10 @@ static int handle_target(void *priv)
 		recursive = 0;
 	}
 
+	/* Targets of an SMP group are polled together, as soon as one is due */
+	for (struct target *target = all_targets; target; target = target->next)
+		target->poll_schedule.due = target_poll_due(target);
+
 	/* Poll targets for state changes unless that's globally disabled.
 	 * Skip targets that are currently disabled.
 	 */
@@ -2980,10 +3167,18 @@ static int handle_target(void *priv)
 		}
 		target->backoff.count = 0;
 
+		if (!target->poll_schedule.due) {
+			target->poll_schedule.countdown--;
+			target->poll_schedule.skipped++;
+			continue;
+		}
+
 		/* only poll target if we've got power and srst isn't asserted */
 		if (!power_dropout && !srst_asserted) {
 			/* polling may fail silently until the target has been examined */
 			retval = target_poll(target);
+			target->poll_schedule.polls++;
+			target_poll_reschedule(target);
 			if (retval != ERROR_OK) {
 				/* 100ms polling interval. Increase interval between polling up to 5000ms */
 				if (target->backoff.times * polling_interval < 5000) {
@@ -3182,6 +3377,37 @@ COMMAND_HANDLER(handle_poll_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_poll_backoff_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int max_ms;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], max_ms);
+		poll_backoff_max = MAX(max_ms / polling_interval, 1U);
+		for (struct target *target = all_targets; target; target = target->next)
+			target_poll_soon(target);
+	}
+
+	command_print(CMD, "poll backoff up to %u ms", poll_backoff_max * polling_interval);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_poll_stats_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	for (struct target *target = all_targets; target; target = target->next) {
+		struct poll_schedule *ps = &target->poll_schedule;
+		command_print(CMD, "%s: %" PRIu64 " polls, %" PRIu64 " skipped, %" PRIu64
+			" state changes, polled every %u ms", target_name(target), ps->polls,
+			ps->skipped, ps->state_changes, MAX(ps->interval, 1U) * polling_interval);
+	}
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_wait_halt_command)
 {
 	if (CMD_ARGC > 1)
@@ -3343,9 +3569,6 @@ void target_handle_md_output(struct command_invocation *cmd,
 	const unsigned line_bytecnt = 32;
 	unsigned line_modulo = line_bytecnt / size;
 
-	char output[line_bytecnt * 4 + 1];
-	unsigned output_len = 0;
-
 	const char *value_fmt;
 	switch (size) {
 	case 8:
@@ -3366,13 +3589,15 @@ void target_handle_md_output(struct command_invocation *cmd,
 		return;
 	}
 
+	/* format straight into one buffer, handed to the interpreter in large
+	 * blocks, rather than allocating and appending a string per line */
+	struct command_output_buffer out;
+	command_output_buffer_init(&out, cmd);
+
 	for (unsigned i = 0; i < count; i++) {
-		if (i % line_modulo == 0) {
-			output_len += snprintf(output + output_len,
-					sizeof(output) - output_len,
-					TARGET_ADDR_FMT ": ",
+		if (i % line_modulo == 0)
+			command_output_buffer_printf(&out, TARGET_ADDR_FMT ": ",
 					(address + (i * size)));
-		}
 
 		uint64_t value = 0;
 		const uint8_t *value_ptr = buffer + i * size;
@@ -3389,15 +3614,13 @@ void target_handle_md_output(struct command_invocation *cmd,
 		case 1:
 			value = *value_ptr;
 		}
-		output_len += snprintf(output + output_len,
-				sizeof(output) - output_len,
-				value_fmt, value);
+		command_output_buffer_printf(&out, value_fmt, value);
 
-		if ((i % line_modulo == line_modulo - 1) || (i == count - 1)) {
-			command_print(cmd, "%s", output);
-			output_len = 0;
-		}
+		if ((i % line_modulo == line_modulo - 1) || (i == count - 1))
+			command_output_buffer_printf(&out, "\n");
 	}
+
+	command_output_buffer_done(&out);
 }
 
 COMMAND_HANDLER(handle_md_command)
@@ -4197,14 +4420,26 @@ static void write_string(FILE *f, char *s)
 
 typedef unsigned char UNIT[2];  /* unit of profiling */
 
-/* Dump a gmon.out histogram file. */
-static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filename, bool with_range,
-			uint32_t start_address, uint32_t end_address, struct target *target, uint32_t duration_ms)
+/* Dump a gmon.out histogram file from already counted buckets. */
+static int write_gmon_histogram(const uint32_t *buckets, uint32_t num_buckets,
+		uint32_t min, uint32_t max, float sample_rate, const char *filename,
+		struct target *target)
 {
 	uint32_t i;
+
+	/* The buckets are 16 bit. Scale them all down by the same factor
+	 * rather than clamping the hot ones, which would distort the profile,
+	 * and the sample rate along so the times stay right. */
+	uint32_t max_count = 0;
+	for (i = 0; i < num_buckets; i++)
+		max_count = MAX(max_count, buckets[i]);
+	uint32_t divisor = max_count / 65535 + (max_count % 65535 ? 1 : 0);
+	if (divisor > 1)
+		sample_rate /= divisor;
+
 	FILE *f = fopen(filename, "w");
 	if (!f)
-		return;
+		return ERROR_FAIL;
 	write_string(f, "gmon");
 	write_long(f, 0x00000001, target); /* Version */
 	write_long(f, 0, target); /* padding */
@@ -4214,6 +4449,42 @@ static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filen
 	uint8_t zero = 0;  /* GMON_TAG_TIME_HIST */
 	write_data(f, &zero, 1);
 
+	/* append binary memory gmon.out &profile_hist_hdr ((char*)&profile_hist_hdr + sizeof(struct gmon_hist_hdr)) */
+	write_long(f, min, target);			/* low_pc */
+	write_long(f, max, target);			/* high_pc */
+	write_long(f, num_buckets, target);	/* # of buckets */
+	write_long(f, sample_rate, target);
+	write_string(f, "seconds");
+	for (i = 0; i < (15-strlen("seconds")); i++)
+		write_data(f, &zero, 1);
+	write_string(f, "s");
+
+	/*append binary memory gmon.out profile_hist_data (profile_hist_data + profile_hist_hdr.hist_size) */
+
+	char *data = malloc(2 * num_buckets);
+	if (data) {
+		for (i = 0; i < num_buckets; i++) {
+			uint32_t val;
+			val = buckets[i];
+			if (divisor > 1)
+				val /= divisor;
+			data[i * 2] = val&0xff;
+			data[i * 2 + 1] = (val >> 8) & 0xff;
+		}
+		write_data(f, data, num_buckets * 2);
+		free(data);
+	}
+
+	fclose(f);
+	return data ? ERROR_OK : ERROR_FAIL;
+}
+
+/* Dump a gmon.out histogram file. */
+static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filename, bool with_range,
+			uint32_t start_address, uint32_t end_address, struct target *target, uint32_t duration_ms)
+{
+	uint32_t i;
+
 	/* figure out bucket size */
 	uint32_t min;
 	uint32_t max;
@@ -4252,12 +4523,9 @@ static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filen
 	uint32_t num_buckets = address_space / sizeof(UNIT);
 	if (num_buckets > max_buckets)
 		num_buckets = max_buckets;
-	int *buckets = malloc(sizeof(int) * num_buckets);
-	if (!buckets) {
-		fclose(f);
+	uint32_t *buckets = calloc(num_buckets, sizeof(uint32_t));
+	if (!buckets)
 		return;
-	}
-	memset(buckets, 0, sizeof(int) * num_buckets);
 	for (i = 0; i < sample_num; i++) {
 		uint32_t address = samples[i];
 
@@ -4271,36 +4539,313 @@ static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filen
 		buckets[index_t]++;
 	}
 
-	/* append binary memory gmon.out &profile_hist_hdr ((char*)&profile_hist_hdr + sizeof(struct gmon_hist_hdr)) */
-	write_long(f, min, target);			/* low_pc */
-	write_long(f, max, target);			/* high_pc */
-	write_long(f, num_buckets, target);	/* # of buckets */
 	float sample_rate = sample_num / (duration_ms / 1000.0);
-	write_long(f, sample_rate, target);
-	write_string(f, "seconds");
-	for (i = 0; i < (15-strlen("seconds")); i++)
-		write_data(f, &zero, 1);
-	write_string(f, "s");
+	write_gmon_histogram(buckets, num_buckets, min, max, sample_rate, filename, target);
+	free(buckets);
+}
 
-	/*append binary memory gmon.out profile_hist_data (profile_hist_data + profile_hist_hdr.hist_size) */
+/* Background profiling. The PC is sampled in short bursts from a timer
+ * callback while the target runs, and the samples are counted right away
+ * in a histogram, so memory does not grow with the profiling time.
+ *
+ * Without a fixed address range, the histogram covers an aligned window of
+ * PROFILE_HIST_BUCKETS buckets. A sample outside of the window doubles the
+ * bucket width, merging neighbouring buckets, until the window includes it. */
+#define PROFILE_HIST_BUCKETS		(64 * 1024)
+#define PROFILE_BURST_SAMPLES		256
+#define PROFILE_POLL_MS				10
+#define PROFILE_STREAM_DEFAULT_MS	1000
+
+struct profile_background {
+	struct target *target;
+	/* samples of the current burst */
+	uint32_t burst[PROFILE_BURST_SAMPLES];
+
+	uint32_t *buckets;
+	uint32_t num_buckets;
+	/* address window covered by the buckets, high is exclusive */
+	uint64_t low;
+	uint64_t high;
+	bool fixed_range;
+
+	uint64_t samples;
+	uint64_t outside;
+	unsigned int errors;
+	int64_t start_ms;
+
+	/* periodic snapshot, if enabled */
+	char *stream_file;
+	unsigned int stream_ms;
+	int64_t next_stream_ms;
+};
 
-	char *data = malloc(2 * num_buckets);
-	if (data) {
-		for (i = 0; i < num_buckets; i++) {
-			int val;
-			val = buckets[i];
-			if (val > 65535)
-				val = 65535;
-			data[i * 2] = val&0xff;
-			data[i * 2 + 1] = (val >> 8) & 0xff;
+static struct profile_background *profile_background;
+
+static void profile_hist_widen(struct profile_background *p)
+{
+	uint64_t span = p->high - p->low;
+	uint64_t width = span / p->num_buckets;
+	uint64_t new_low = p->low & ~(2 * span - 1);
+	uint32_t n = p->num_buckets;
+
+	/* the new window starts either at the old one, or one old span below */
+	if (new_low == p->low) {
+		for (uint32_t i = 0; i < n; i++) {
+			uint32_t count = p->buckets[i];
+			p->buckets[i] = 0;
+			p->buckets[i / 2] += count;
 		}
-		free(buckets);
-		write_data(f, data, num_buckets * 2);
-		free(data);
-	} else
-		free(buckets);
+	} else {
+		for (uint32_t i = n; i-- > 0;) {
+			uint32_t count = p->buckets[i];
+			p->buckets[i] = 0;
+			p->buckets[n / 2 + i / 2] += count;
+		}
+	}
 
-	fclose(f);
+	p->low = new_low;
+	p->high = new_low + 2 * span;
+	LOG_DEBUG("profile histogram now 0x%" PRIx64 "-0x%" PRIx64 ", %" PRIu64 " bytes per bucket",
+		p->low, p->high, 2 * width);
+}
+
+static void profile_hist_add(struct profile_background *p, uint32_t pc)
+{
+	if (!p->fixed_range) {
+		if (!p->samples && !p->outside) {
+			uint64_t span = (uint64_t)p->num_buckets * sizeof(UNIT);
+			p->low = pc & ~(span - 1);
+			p->high = p->low + span;
+		}
+		while (pc < p->low || pc >= p->high)
+			profile_hist_widen(p);
+	}
+
+	if (pc < p->low || pc >= p->high) {
+		p->outside++;
+		return;
+	}
+
+	uint64_t index = (pc - p->low) * p->num_buckets / (p->high - p->low);
+	p->buckets[index]++;
+	p->samples++;
+}
+
+static int profile_background_write(struct profile_background *p, const char *filename)
+{
+	uint32_t first = 0;
+	uint32_t last = p->num_buckets - 1;
+
+	if (!p->samples)
+		return ERROR_FAIL;
+
+	/* only write the used part of an automatic window */
+	if (!p->fixed_range) {
+		while (!p->buckets[first])
+			first++;
+		while (!p->buckets[last])
+			last--;
+	}
+
+	uint64_t width = (p->high - p->low) / p->num_buckets;
+	uint64_t min = p->low + first * width;
+	uint64_t max = p->low + (last + 1) * width;
+	if (p->fixed_range) {
+		min = p->low;
+		max = p->high;
+	}
+	if (max > UINT32_MAX)
+		max = UINT32_MAX;
+
+	int64_t duration_ms = timeval_ms() - p->start_ms;
+	float sample_rate = p->samples / (MAX(duration_ms, 1) / 1000.0);
+
+	return write_gmon_histogram(p->buckets + first, last - first + 1, min, max,
+		sample_rate, filename, p->target);
+}
+
+static int profile_background_callback(void *priv)
+{
+	struct profile_background *p = priv;
+	struct target *target = p->target;
+
+	/* the target is left to the regular polling, a halt is only
+	 * noticed there and no samples are taken until it runs again */
+	if (target->state == TARGET_RUNNING) {
+		uint32_t num_samples = 0;
+		int retval = target_sample_pc(target, p->burst, PROFILE_BURST_SAMPLES,
+				&num_samples);
+		if (retval != ERROR_OK)
+			p->errors++;
+		for (uint32_t i = 0; i < num_samples; i++)
+			profile_hist_add(p, p->burst[i]);
+	}
+
+	if (p->stream_file && p->samples && timeval_ms() >= p->next_stream_ms) {
+		if (profile_background_write(p, p->stream_file) != ERROR_OK)
+			p->errors++;
+		p->next_stream_ms = timeval_ms() + p->stream_ms;
+	}
+
+	return ERROR_OK;
+}
+
+static void profile_background_free(void)
+{
+	if (!profile_background)
+		return;
+
+	target_unregister_timer_callback(profile_background_callback, profile_background);
+	free(profile_background->stream_file);
+	free(profile_background->buckets);
+	free(profile_background);
+	profile_background = NULL;
+}
+
+COMMAND_HANDLER(handle_profile_background_command)
+{
+	struct profile_background *p = profile_background;
+	int retval;
+
+	if (!strcmp(CMD_ARGV[0], "start")) {
+		if (CMD_ARGC != 1 && CMD_ARGC != 3)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		if (p) {
+			command_print(CMD, "background profiling already running on %s",
+				target_name(p->target));
+			return ERROR_FAIL;
+		}
+
+		struct target *target = get_current_target(CMD_CTX);
+		uint32_t pc, num_samples;
+		retval = target_sample_pc(target, &pc, 1, &num_samples);
+		if (retval == ERROR_NOT_IMPLEMENTED) {
+			command_print(CMD, "target %s can not sample its PC while running",
+				target_name(target));
+			return ERROR_FAIL;
+		}
+		if (retval != ERROR_OK)
+			return retval;
+
+		uint32_t start_address = 0;
+		uint32_t end_address = 0;
+		if (CMD_ARGC == 3) {
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], start_address);
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], end_address);
+			if (start_address > end_address || (end_address - start_address) < 2) {
+				command_print(CMD, "Error: end - start < 2");
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+
+		p = calloc(1, sizeof(*p));
+		if (!p) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		p->target = target;
+		p->start_ms = timeval_ms();
+		p->num_buckets = PROFILE_HIST_BUCKETS;
+		if (CMD_ARGC == 3) {
+			p->fixed_range = true;
+			p->low = start_address;
+			p->high = end_address;
+			p->num_buckets = MIN((end_address - start_address) / sizeof(UNIT),
+				128 * 1024U);
+		}
+		p->buckets = calloc(p->num_buckets, sizeof(uint32_t));
+		if (!p->buckets) {
+			free(p);
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+
+		retval = target_register_timer_callback(profile_background_callback,
+				PROFILE_POLL_MS, TARGET_TIMER_TYPE_PERIODIC, p);
+		if (retval != ERROR_OK) {
+			free(p->buckets);
+			free(p);
+			return retval;
+		}
+		profile_background = p;
+		return ERROR_OK;
+	}
+
+	if (!p) {
+		command_print(CMD, "background profiling is not running");
+		return ERROR_FAIL;
+	}
+
+	if (!strcmp(CMD_ARGV[0], "stop")) {
+		if (CMD_ARGC != 1)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		profile_background_free();
+		return ERROR_OK;
+	}
+
+	if (!strcmp(CMD_ARGV[0], "snapshot")) {
+		if (CMD_ARGC != 2)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		if (!p->samples) {
+			command_print(CMD, "no samples collected yet");
+			return ERROR_FAIL;
+		}
+		retval = profile_background_write(p, CMD_ARGV[1]);
+		if (retval != ERROR_OK) {
+			command_print(CMD, "failed to write %s", CMD_ARGV[1]);
+			return retval;
+		}
+		command_print(CMD, "Wrote %s", CMD_ARGV[1]);
+		return ERROR_OK;
+	}
+
+	if (!strcmp(CMD_ARGV[0], "stream")) {
+		if (CMD_ARGC != 2 && CMD_ARGC != 3)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		unsigned int interval_ms = PROFILE_STREAM_DEFAULT_MS;
+		if (CMD_ARGC == 3) {
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], interval_ms);
+			if (interval_ms < PROFILE_POLL_MS) {
+				command_print(CMD, "interval must be at least %u ms", PROFILE_POLL_MS);
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+
+		free(p->stream_file);
+		p->stream_file = NULL;
+		if (CMD_ARGC == 2 && !strcmp(CMD_ARGV[1], "off"))
+			return ERROR_OK;
+
+		p->stream_file = strdup(CMD_ARGV[1]);
+		if (!p->stream_file) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		p->stream_ms = interval_ms;
+		p->next_stream_ms = timeval_ms();
+		return ERROR_OK;
+	}
+
+	if (!strcmp(CMD_ARGV[0], "status")) {
+		if (CMD_ARGC != 1)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		int64_t duration_ms = timeval_ms() - p->start_ms;
+		command_print(CMD, "target %s, %" PRIu64 " samples in %" PRId64 " ms, "
+			"%" PRIu64 " outside of the range, %u errors",
+			target_name(p->target), p->samples, duration_ms, p->outside, p->errors);
+		if (p->samples)
+			command_print(CMD, "range 0x%8.8" PRIx64 "-0x%8.8" PRIx64 ", %" PRIu64
+				" bytes per bucket", p->low, p->high,
+				(p->high - p->low) / p->num_buckets);
+		if (p->stream_file)
+			command_print(CMD, "writing %s every %u ms", p->stream_file, p->stream_ms);
+		return ERROR_OK;
+	}
+
+	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
 /* profiling samples the CPU PC as quickly as OpenOCD is able,
@@ -4309,6 +4854,9 @@ COMMAND_HANDLER(handle_profile_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
 
+	if (CMD_ARGC > 0 && (CMD_ARGV[0][0] < '0' || CMD_ARGV[0][0] > '9'))
+		return CALL_COMMAND_HANDLER(handle_profile_background_command);
+
 	if ((CMD_ARGC != 2) && (CMD_ARGC != 4))
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
@@ -4339,6 +4887,7 @@ COMMAND_HANDLER(handle_profile_command)
 		return ERROR_FAIL;
 	}
 
+	LOG_INFO("Starting profiling for %" PRIu32 " seconds...", offset);
 	uint64_t timestart_ms = timeval_ms();
 	/**
 	 * Some cores let us sample the PC without the
@@ -4352,6 +4901,7 @@ COMMAND_HANDLER(handle_profile_command)
 		return retval;
 	}
 	uint32_t duration_ms = timeval_ms() - timestart_ms;
+	LOG_INFO("Profiling completed. %" PRIu32 " samples.", num_of_samples);
 
 	assert(num_of_samples <= MAX_PROFILE_SAMPLE_NUM);
 
@@ -4446,8 +4996,9 @@ COMMAND_HANDLER(handle_target_read_memory)
 		return ERROR_COMMAND_ARGUMENT_INVALID;
 	}
 
-	if (count > 65536) {
-		command_print(CMD, "read_memory: too large read request, exceeds 64K elements");
+	/* keep the output, up to 19 characters per element, within a Tcl string */
+	if (count > 64 * 1024 * 1024) {
+		command_print(CMD, "read_memory: too large read request, exceeds 64M elements");
 		return ERROR_COMMAND_ARGUMENT_INVALID;
 	}
 
@@ -4455,13 +5006,18 @@ COMMAND_HANDLER(handle_target_read_memory)
 
 	const size_t buffersize = 4096;
 	uint8_t *buffer = malloc(buffersize);
+	uint64_t *values = malloc(buffersize / width * sizeof(*values));
 
-	if (!buffer) {
+	if (!buffer || !values) {
 		LOG_ERROR("Failed to allocate memory");
+		free(buffer);
+		free(values);
 		return ERROR_FAIL;
 	}
 
-	char *separator = "";
+	struct command_output_buffer out;
+	command_output_buffer_init(&out, CMD);
+
 	while (count > 0) {
 		const unsigned int max_chunk_len = buffersize / width;
 		const size_t chunk_len = MIN(count, max_chunk_len);
@@ -4480,40 +5036,42 @@ COMMAND_HANDLER(handle_target_read_memory)
 			 * FIXME: we append the errmsg to the list of value already read.
 			 * Add a way to flush and replace old output, but LOG_DEBUG() it
 			 */
+			command_output_buffer_done(&out);
 			command_print(CMD, "read_memory: failed to read memory");
 			free(buffer);
+			free(values);
 			return retval;
 		}
 
-		for (size_t i = 0; i < chunk_len ; i++) {
-			uint64_t v = 0;
-
-			switch (width) {
-			case 8:
-				v = target_buffer_get_u64(target, &buffer[i * width]);
-				break;
-			case 4:
-				v = target_buffer_get_u32(target, &buffer[i * width]);
-				break;
-			case 2:
-				v = target_buffer_get_u16(target, &buffer[i * width]);
-				break;
-			case 1:
-				v = buffer[i];
-				break;
-			}
-
-			command_print_sameline(CMD, "%s0x%" PRIx64, separator, v);
-			separator = " ";
+		switch (width) {
+		case 8:
+			for (size_t i = 0; i < chunk_len; i++)
+				values[i] = target_buffer_get_u64(target, &buffer[i * width]);
+			break;
+		case 4:
+			for (size_t i = 0; i < chunk_len; i++)
+				values[i] = target_buffer_get_u32(target, &buffer[i * width]);
+			break;
+		case 2:
+			for (size_t i = 0; i < chunk_len; i++)
+				values[i] = target_buffer_get_u16(target, &buffer[i * width]);
+			break;
+		case 1:
+			for (size_t i = 0; i < chunk_len; i++)
+				values[i] = buffer[i];
+			break;
 		}
 
+		command_output_buffer_hex_list(&out, values, chunk_len);
+
 		count -= chunk_len;
 		addr += chunk_len * width;
 	}
 
 	free(buffer);
+	free(values);
 
-	return ERROR_OK;
+	return command_output_buffer_done(&out);
 }
 
 static int target_jim_write_memory(Jim_Interp *interp, int argc,
@@ -6522,8 +7080,11 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.name = "profile",
 		.handler = handle_profile_command,
 		.mode = COMMAND_EXEC,
-		.usage = "seconds filename [start end]",
-		.help = "profiling samples the CPU PC",
+		.usage = "seconds filename [start end] | "
+			"'start' [start end] | 'stop' | 'snapshot' filename | "
+			"'stream' (filename [interval_ms] | 'off') | 'status'",
+		.help = "profiling samples the CPU PC, either for the given time "
+			"or in the background",
 	},
 	/** @todo don't register virt2phys() unless target supports it */
 	{
@@ -6548,6 +7109,21 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.help = "poll target state; or reconfigure background polling",
 		.usage = "['on'|'off']",
 	},
+	{
+		.name = "poll_backoff",
+		.handler = handle_poll_backoff_command,
+		.mode = COMMAND_ANY,
+		.help = "set the longest interval between background polls of "
+			"a target whose state doesn't change",
+		.usage = "[max_ms]",
+	},
+	{
+		.name = "poll_stats",
+		.handler = handle_poll_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show background polling statistics of all targets",
+		.usage = "",
+	},
 	{
 		.name = "wait_halt",
 		.handler = handle_wait_halt_command,
@@ -106,6 +106,17 @@ struct backoff_timer {
 	int count;
 };
 
+/* adaptive background polling, see 'poll_backoff' */
+struct poll_schedule {
+	unsigned int interval;		/* polling periods between two polls */
+	unsigned int countdown;		/* polling periods left before the next poll */
+	enum target_state last_state;
+	bool due;
+	uint64_t polls;
+	uint64_t skipped;
+	uint64_t state_changes;
+};
+
 /* split target registers into multiple class */
 enum target_register_class {
 	REG_CLASS_ALL,
@@ -139,6 +150,16 @@ struct target {
 	 */
 	bool running_alg;
 
+	/**
+	 * Incremented by every memory write and algorithm run through the
+	 * target API, so caches of target memory notice writes from any
+	 * source. See target_memory_written().
+	 */
+	unsigned int memory_writes;
+
+	/** Memory read cache of the GDB server, shared by its connections */
+	struct gdb_mem_cache *gdb_mem_cache;
+
 	struct target_event_action *event_action;
 
 	bool reset_halt;						/* attempt resetting the CPU into the halted mode? */
@@ -184,6 +205,7 @@ struct target {
 	bool rtos_auto_detect;				/* A flag that indicates that the RTOS has been specified as "auto"
 										 * and must be detected when symbols are offered */
 	struct backoff_timer backoff;
+	struct poll_schedule poll_schedule;
 	int smp;							/* Unique non-zero number for each SMP group */
 	struct list_head *smp_targets;		/* list all targets in this smp group/cluster
 										 * The head of the list is shared between the
@@ -652,8 +674,26 @@ int target_write_phys_memory(struct target *target,
  */
 int target_write_buffer(struct target *target,
 		target_addr_t address, uint32_t size, const uint8_t *buffer);
+
+/**
+ * Record that the memory of the target may have changed, also for the
+ * other targets of its SMP group, which share the memory.
+ */
+void target_memory_written(struct target *target);
 int target_read_buffer(struct target *target,
 		target_addr_t address, uint32_t size, uint8_t *buffer);
+
+/**
+ * Write a buffer to target RAM like target_write_buffer(), but send it
+ * compressed if the target can inflate it on its own and the data
+ * compresses well enough to make up for running the code doing so.
+ * Otherwise fall back to target_write_buffer(). The target must be
+ * halted to use compression.
+ *
+ * @param sent set to the number of bytes actually transferred
+ */
+int target_write_buffer_compressed(struct target *target,
+		target_addr_t address, uint32_t size, const uint8_t *buffer, uint32_t *sent);
 int target_checksum_memory(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t *crc);
 int target_blank_check_memory(struct target *target,
@@ -784,6 +824,14 @@ void target_handle_md_output(struct command_invocation *cmd,
 int target_profiling_default(struct target *target, uint32_t *samples, uint32_t
 		max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
+/**
+ * Sample the PC of a running target without disturbing it.
+ *
+ * Returns ERROR_NOT_IMPLEMENTED if the target can't do so.
+ */
+int target_sample_pc(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples);
+
 #define ERROR_TARGET_INVALID	(-300)
 #define ERROR_TARGET_INIT_FAILED (-301)
 #define ERROR_TARGET_TIMEOUT	(-302)
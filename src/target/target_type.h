@@ -132,6 +132,29 @@ struct target_type {
 	int (*write_buffer)(struct target *target, target_addr_t address,
 			uint32_t size, const uint8_t *buffer);
 
+	/**
+	 * Optional. Write @a size bytes to the FIFO of an asynchronous
+	 * algorithm at @a address, then store the write pointer @a wp at
+	 * @a wp_addr and read the read pointer at @a rp_addr, in this order
+	 * and with as few adapter round trips as possible. Both pointers are
+	 * 32 bit words in target byte order. May return ERROR_NOT_IMPLEMENTED
+	 * before any access, the caller then uses separate accesses.
+	 * See target_run_flash_async_algorithm().
+	 */
+	int (*write_async_fifo)(struct target *target, target_addr_t address,
+			uint32_t size, const uint8_t *buffer,
+			target_addr_t wp_addr, uint32_t wp,
+			target_addr_t rp_addr, uint32_t *rp);
+
+	/**
+	 * Optional. Write @a size bytes to RAM at @a address from the
+	 * @a compressed_size bytes of a LZ4 block, inflated on the target.
+	 * Do @b not call this function directly, use
+	 * target_write_buffer_compressed() instead.
+	 */
+	int (*write_compressed)(struct target *target, target_addr_t address,
+			uint32_t size, const uint8_t *compressed, uint32_t compressed_size);
+
 	int (*checksum_memory)(struct target *target, target_addr_t address,
 			uint32_t count, uint32_t *checksum);
 	int (*blank_check_memory)(struct target *target,
@@ -300,6 +323,13 @@ struct target_type {
 	int (*profiling)(struct target *target, uint32_t *samples,
 			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
+	/* Sample the PC of a running target, up to max_num_samples values,
+	 * without polling, halting or resuming it. Samples taken while the
+	 * core was not running are dropped, so *num_samples may be less.
+	 * Returns ERROR_NOT_IMPLEMENTED if the core can't be sampled so. */
+	int (*sample_pc)(struct target *target, uint32_t *samples,
+			uint32_t max_num_samples, uint32_t *num_samples);
+
 	/* Return the number of address bits this target supports. This will
 	 * typically be 32 for 32-bit targets, and 64 for 64-bit targets. If not
 	 * implemented, it's assumed to be 32. */